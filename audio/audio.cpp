@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <hardware/dma.h>
 #include <hardware/interp.h>
+#include <hardware/timer.h>
 
 #include "simple_serialize.pio.h"
 
@@ -123,6 +124,9 @@ namespace audio
         inline constexpr size_t HALF_RING_SAMPLES = 64;
         inline constexpr size_t HALF_RING_OVERSAMPLING_SAMPLES = HALF_RING_SAMPLES * OVERSAMPLING_RATE;
 
+        // 次の割り込みまでに半分のリングを埋め終わればよい
+        inline constexpr uint32_t HALF_RING_DEADLINE_US = HALF_RING_SAMPLES * 1000000 / AUDIO_SAMPLE_RATE;
+
         using UnitSequence = std::array<uint32_t, UNIT_SEQUENCE_WORDS>;
         UnitSequence unitSequenceTable_[UNIT_SEQUENCE_BITS];
 
@@ -133,6 +137,7 @@ namespace audio
         int halfRingDBID_ = 0;
 
         SampleFillFunc sampleFillFunc_;
+        LoadReportFunc loadReportFunc_;
 
         void
         initUnitSequenceTable()
@@ -254,6 +259,7 @@ namespace audio
         void __not_in_flash_func(irqHandler)()
         {
             gpio_put(6, 1);
+            auto t0 = time_us_32();
 
             // どっちのDMAも同時に終わっているはずなので同時に再開
             startAudioDMA(halfRingDBID_);
@@ -261,6 +267,11 @@ namespace audio
             halfRingDBID_ ^= 1;
             updateHalfRing(halfRingDBID_);
 
+            if (loadReportFunc_)
+            {
+                loadReportFunc_(time_us_32() - t0, HALF_RING_DEADLINE_US);
+            }
+
             gpio_put(6, 0);
         }
     }
@@ -281,6 +292,11 @@ namespace audio
         initDMA();
     }
 
+    void setLoadReportFunc(LoadReportFunc &&f)
+    {
+        loadReportFunc_ = std::move(f);
+    }
+
     void startAudioStream(SampleFillFunc &&f)
     {
         sampleFillFunc_ = std::move(f);
@@ -11,11 +11,16 @@
 
 namespace audio
 {
-    inline constexpr size_t AUDIO_CHANNELS = 1;
+    inline constexpr size_t AUDIO_CHANNELS = 2;
 
     using SampleFillFunc = std::function<void(std::array<int16_t *, AUDIO_CHANNELS> &buffers,
                                               size_t nSamples)>;
 
+    // 1 ブロックの処理にかかった時間と締め切り [us]
+    using LoadReportFunc = std::function<void(uint32_t elapsedUs, uint32_t deadlineUs)>;
+
     void initializeAudio(std::initializer_list<int> pins, pio_hw_t *pio);
     void startAudioStream(SampleFillFunc &&f);
+    // startAudioStream() の前に設定する
+    void setLoadReportFunc(LoadReportFunc &&f);
 }
@@ -14,6 +14,7 @@
 #include <string>
 #include <optional>
 
+#include <pm_piano/note_cache.h>
 #include <pm_piano/piano.h>
 #include <audio/audio.h>
 #include <math.h>
@@ -41,6 +42,9 @@ void __not_in_flash_func(core1_main)()
     }
 
     int phase = 0;
+    audio::setLoadReportFunc(
+        [](uint32_t elapsedUs, uint32_t deadlineUs)
+        { piano_.reportLoad(elapsedUs, deadlineUs); });
     audio::startAudioStream(
         [&](std::array<int16_t *, audio::AUDIO_CHANNELS> & buffers, size_t nSamples) __attribute__((always_inline)) {
 #if 0
@@ -54,7 +58,7 @@ void __not_in_flash_func(core1_main)()
                 --nSamples;
             };
 #else
-            piano_.update(buffers[0], nSamples, midiIn_);
+            piano_.update(buffers[0], buffers[1], nSamples, midiIn_);
 #endif
         });
 
@@ -105,6 +109,37 @@ int main()
 #define PIN_AUDIO_R 3
     audio::initializeAudio({PIN_AUDIO_L, PIN_AUDIO_R}, pio0);
 
+    // 低音の弦を半分のレートで計算する (setHalfRateBelow) のは使わない
+    // 固定小数点では倍音の減衰の速さが全レートと最大 24dB/s 違う (pm_piano_multirate)
+    // 固定小数点のビルドは USE_HALF_RATE が 0 なので、全部の音を全レートで計算する
+    // 遅延線のメモリは音域ごとに一番長い音の分だけ取る (pm_piano_memory -r で確かめた)
+    // 一番長い音の分で 12 ボイス揃えるより少ない SRAM (29.4KB 対 42.5KB) で 22 ボイスになる
+    // 実際に鳴らす数は処理時間を見て Piano (LoadGovernor) が決める
+    using physical_modeling_piano::NoteManager;
+    static const NoteManager::VoiceRegister voiceRegisters[] = {
+        {48, 4},
+        {60, 4},
+        {84, 6},
+        {NoteManager::NOTE_END, 8},
+    };
+#if USE_PREBUILT_NOTE_TABLE
+    // 鍵ごとの係数はビルドのときに作った表から読む
+    // 表は CMake が既定のパラメータ・全レートで作る (ここで変えたら PICO_PIANO_COEFGEN_ARGS も合わせる)
+    piano_.initialize(voiceRegisters, sizeof(voiceRegisters) / sizeof(voiceRegisters[0]));
+#else
+    // 鍵ごとの係数は前の起動で flash に残したものを読む (読めなければ計算して残す)
+    // flash を書くので Wi-Fi/Bluetooth ともう一方のコアを動かす前にする
+    physical_modeling_piano::NoteCache noteCache;
+    piano_.setNoteTable(noteCache.getWords(), noteCache.getWordCount());
+    piano_.initialize(voiceRegisters, sizeof(voiceRegisters) / sizeof(voiceRegisters[0]));
+    if (!piano_.isNoteTableLoaded())
+    {
+        physical_modeling_piano::CoefficientWriter w;
+        piano_.writeNoteTable(w);
+        printf("note cache: %s\n", noteCache.store(w.getWords().data(), w.getWords().size()) ? "stored" : "failed");
+    }
+#endif
+
     if (cyw43_arch_init())
     {
         printf("Wi-Fi init failed");
@@ -128,8 +163,6 @@ int main()
 
     midiIn_.setActive(true);
 
-    piano_.initialize(9);
-
     multicore_launch_core1(core1_main);
 
     piano_.worker();
@@ -4,6 +4,7 @@
  */
 
 #include "allocator.h"
+#include <algorithm>
 
 namespace physical_modeling_piano
 {
@@ -34,16 +35,22 @@ SimpleLinearAllocator::allocate(size_t size, size_t align)
 void
 PoolAllocator::initialize(size_t unitSize, size_t n)
 {
-    buffer_.resize(unitSize * n);
-    unitSize_ = unitSize;
+    // 空きの番号を書くので 1 ワードはいる
+    unitSize_ = std::max<size_t>(sizeof(uint32_t), (unitSize + 3) & ~size_t(3));
+    nUnits_   = n;
+    nFree_    = n;
+    buffer_.resize(unitSize_ / sizeof(uint32_t) * n);
 
-    for (size_t i = 0; i < n - 1; ++i)
+    for (size_t i = 0; i + 1 < n; ++i)
     {
         auto p = getUnit(i);
         *p     = i + 1;
     }
-    *getUnit(n - 1) = 0xffffffff;
-    freeTop_        = 0;
+    if (n)
+    {
+        *getUnit(n - 1) = 0xffffffff;
+    }
+    freeTop_ = n ? 0 : 0xffffffff;
 }
 
 void*
@@ -56,6 +63,7 @@ PoolAllocator::allocate()
 
     auto p   = getUnit(freeTop_);
     freeTop_ = *p;
+    --nFree_;
 
     return p;
 }
@@ -66,11 +74,12 @@ PoolAllocator::free(void* p)
     auto p0  = reinterpret_cast<char*>(buffer_.data());
     auto pp  = reinterpret_cast<char*>(p);
     auto idx = (pp - p0) / unitSize_;
-    assert(pp - p0 <= buffer_.size());
     assert(pp >= p0);
+    assert(size_t(pp - p0) < buffer_.size() * sizeof(uint32_t));
     assert(p0 + idx * unitSize_ == p);
     *reinterpret_cast<uint32_t*>(p) = freeTop_;
     freeTop_                        = idx;
+    ++nFree_;
 }
 
 uint32_t*
@@ -25,20 +25,26 @@ public:
     explicit operator bool() const { return p_; }
 };
 
+// 同じ大きさのブロックを n 個持つ (空いているブロックの先頭に次の空きの番号を書いておく)
 class PoolAllocator
 {
     std::vector<uint32_t> buffer_;
     size_t unitSize_{};
+    size_t nUnits_{};
+    size_t nFree_{};
     uint32_t freeTop_{};
 
 public:
     PoolAllocator() = default;
     PoolAllocator(size_t unitSize, size_t n) { initialize(unitSize, n); }
+    // unitSize は 4 バイト単位に切り上げる
     void initialize(size_t unitSize, size_t n);
-    void* allocate();
+    void* allocate(); // 空きがなければ nullptr
     void free(void* p);
 
     size_t getUnitSize() const { return unitSize_; }
+    size_t getUnitCount() const { return nUnits_; }
+    size_t getFreeCount() const { return nFree_; }
 
 protected:
     uint32_t* getUnit(size_t i);
@@ -0,0 +1,142 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 16:10:22
+ */
+
+#include "coefficients.h"
+#include "note.h"
+#include "note_table_id.h"
+#include <stdio.h>
+
+namespace physical_modeling_piano
+{
+    namespace
+    {
+        // 表の中身を決めるもの
+        // SystemParameters は Note::initialize() が見るものだけ (響板のものは入れない)
+        void writeHeader(CoefficientWriter &w, size_t nNotes, const SystemParameters &p)
+        {
+            w.value(note_table::MAGIC);
+            w.value(note_table::VERSION);
+            w.value(uint32_t(0)); // 語数 (write() の最後で埋める)
+            w.value(uint32_t(0)); // チェックサム
+            w.value(SystemParameters::sampleRate);
+            w.value(uint32_t(USE_FIXED_POINT));
+            w.value(uint32_t(NOTE_TABLE_BUILD_ID)); // ソースが違うビルドの表 (前のファームの flash) は読まない
+            w.value(uint32_t(nNotes));
+
+            w.value(p.youngsModulus);
+            w.value(p.stringDensity);
+            w.value(p.bridgeImpedance);
+            w.value(p.stringLossC1);
+            w.value(p.stringLossC3);
+            w.value(p.hammerPosition);
+            for (auto &t : p.tune)
+            {
+                w.value(t);
+            }
+            w.value(p.voiceSilenceLevel);
+            w.value(p.voiceSilenceTime);
+            w.value(p.voiceQuietLevel);
+            w.value(p.halfRateFrequency);
+        }
+
+        enum HeaderWord
+        {
+            SIZE_WORD = 2,
+            CHECKSUM_WORD = 3,
+            CONFIG_WORD = 4, // ここから音の数までで表の形が決まる
+            PARAMETER_WORD = 8,
+        };
+    }
+
+    namespace note_table
+    {
+        uint32_t
+        computeChecksum(const uint32_t *words, size_t n)
+        {
+            // 語ごとの FNV-1a
+            // CRC-32 は 4bit ずつの表引きだと読む時間の大半になったので、1 語に乗算 1 回のこちらにする
+            uint32_t h = 2166136261u;
+            for (size_t i = 0; i < n; ++i)
+            {
+                h = (h ^ words[i]) * 16777619u;
+            }
+            return h;
+        }
+
+        void
+        write(CoefficientWriter &w, Note *notes, size_t nNotes, const SystemParameters &sysParams)
+        {
+            const size_t begin = w.getWords().size();
+            writeHeader(w, nNotes, sysParams);
+            for (size_t i = 0; i < nNotes; ++i)
+            {
+                notes[i].transferCoefficients(w);
+            }
+            const auto *p = w.getWords().data() + begin;
+            const size_t n = w.getWords().size() - begin;
+            w.setWord(begin + SIZE_WORD, uint32_t(n));
+            w.setWord(begin + CHECKSUM_WORD, computeChecksum(p + CONFIG_WORD, n - CONFIG_WORD));
+        }
+
+        size_t
+        getSize(const uint32_t *words, size_t nWords)
+        {
+            if (nWords < PARAMETER_WORD || words[0] != MAGIC || words[1] != VERSION)
+            {
+                return 0;
+            }
+            const size_t n = words[SIZE_WORD];
+            return n >= PARAMETER_WORD && n <= nWords ? n : 0;
+        }
+
+        bool
+        read(Note *notes, size_t nNotes, const uint32_t *words, size_t nWords,
+             const SystemParameters *sysParams)
+        {
+            nWords = getSize(words, nWords);
+            if (!nWords)
+            {
+                printf("note table: not found\n");
+                return false;
+            }
+
+            CoefficientWriter expected;
+            writeHeader(expected, nNotes, sysParams ? *sysParams : SystemParameters{});
+            const auto &header = expected.getWords();
+            if (nWords < header.size() ||
+                memcmp(words + CONFIG_WORD, header.data() + CONFIG_WORD,
+                       (PARAMETER_WORD - CONFIG_WORD) * sizeof(uint32_t)))
+            {
+                printf("note table: format mismatch\n");
+                return false;
+            }
+            if (sysParams &&
+                memcmp(words + PARAMETER_WORD, header.data() + PARAMETER_WORD,
+                       (header.size() - PARAMETER_WORD) * sizeof(uint32_t)))
+            {
+                printf("note table: made with different parameters\n");
+                return false;
+            }
+            if (computeChecksum(words + CONFIG_WORD, nWords - CONFIG_WORD) != words[CHECKSUM_WORD])
+            {
+                printf("note table: checksum mismatch\n");
+                return false;
+            }
+
+            CoefficientReader r(words + header.size(), nWords - header.size());
+            for (size_t i = 0; i < nNotes; ++i)
+            {
+                notes[i].transferCoefficients(r);
+            }
+            if (!r.isValid() || r.getRemaining())
+            {
+                printf("note table: broken (%zd words left)\n", r.getRemaining());
+                return false;
+            }
+            return true;
+        }
+    } // namespace note_table
+
+} // namespace physical_modeling_piano
@@ -0,0 +1,127 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 16:10:22
+ */
+#ifndef _7E2C41D9_3B8A_4F0E_9D57_A1C64E0B92F3
+#define _7E2C41D9_3B8A_4F0E_9D57_A1C64E0B92F3
+
+#include "fixed.h"
+#include "sys_params.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+#include "platform.h"
+
+namespace physical_modeling_piano
+{
+    class Note;
+
+    namespace detail
+    {
+        inline uint32_t toWord(float v)
+        {
+            uint32_t w;
+            memcpy(&w, &v, sizeof(w));
+            return w;
+        }
+        template <class T, int S>
+        uint32_t toWord(const FixedPoint<T, S> &v)
+        {
+            return uint32_t(int32_t(v.get()));
+        }
+        template <class T>
+        std::enable_if_t<std::is_integral<T>::value, uint32_t> toWord(T v)
+        {
+            return uint32_t(v);
+        }
+
+        inline void fromWord(float &v, uint32_t w) { memcpy(&v, &w, sizeof(v)); }
+        template <class T, int S>
+        void fromWord(FixedPoint<T, S> &v, uint32_t w)
+        {
+            v.set(T(int32_t(w)));
+        }
+        template <class T>
+        std::enable_if_t<std::is_integral<T>::value> fromWord(T &v, uint32_t w)
+        {
+            v = T(w);
+        }
+    } // namespace detail
+
+    // 係数を 32bit の語の列に書き出す / 読み込む
+    // 各クラスの transferCoefficients(io) がメンバを決まった順に io.value() に渡すので、
+    // 同じ関数で書き出しも読み込みもする
+    // 語は値そのもの (float はビット列、固定小数点は整数の値) なので、構造体の並びが違うところでも読める
+    class CoefficientWriter
+    {
+        std::vector<uint32_t> words_;
+
+    public:
+        template <class T>
+        void value(const T &v) { words_.push_back(detail::toWord(v)); }
+
+        const std::vector<uint32_t> &getWords() const { return words_; }
+        // 書いた後で i 語目を埋める (大きさやチェックサムのように後で決まるもの)
+        void setWord(size_t i, uint32_t w) { words_[i] = w; }
+    };
+
+    class CoefficientReader
+    {
+        const uint32_t *p_;
+        const uint32_t *end_;
+        bool overrun_ = false;
+
+    public:
+        CoefficientReader(const uint32_t *words, size_t n) : p_(words), end_(words + n) {}
+
+        template <class T>
+        void value(T &v)
+        {
+            if (p_ == end_)
+            {
+                overrun_ = true;
+                return;
+            }
+            detail::fromWord(v, *p_++);
+        }
+
+        // 足りない分を読もうとしたら false
+        bool isValid() const { return !overrun_; }
+        size_t getRemaining() const { return end_ - p_; }
+    };
+
+    // 鍵ごとの Note の係数の表
+    //   MAGIC, VERSION, 全体の語数, チェックサム (ここより後の語の FNV-1a),
+    //   構成 (サンプリング周波数と USE_FIXED_POINT とソースのハッシュ), 音の数,
+    //   係数に効く SystemParameters の値, 音ごとの Note::transferCoefficients() の並び
+    // そのままファイルや flash に置いて、次の起動で計算の代わりに読める (NoteCache)
+    namespace note_table
+    {
+        constexpr uint32_t MAGIC = 0x544e4d50; // "PMNT"
+        constexpr uint32_t VERSION = 3;
+
+        void write(CoefficientWriter &w, Note *notes, size_t nNotes, const SystemParameters &sysParams);
+
+        // words の先頭に表があれば、その語数 (MAGIC と VERSION と語数を見るだけ、なければ 0)
+        // nWords は表を置いた領域の大きさ (表はそれより短くてよい)
+        size_t getSize(const uint32_t *words, size_t nWords);
+
+        // sysParams が nullptr なら作ったときのパラメータと同じかどうかは見ない
+        // 合わないか壊れていたら false (notes は途中まで書き換わっている)
+        bool read(Note *notes, size_t nNotes, const uint32_t *words, size_t nWords,
+                  const SystemParameters *sysParams);
+
+        uint32_t computeChecksum(const uint32_t *words, size_t n);
+    } // namespace note_table
+
+    // ビルドのときに作った表 (tools/coefgen.cpp が出力するソースにある)
+    // USE_PREBUILT_NOTE_TABLE のときは NoteManager がこれを読む
+    extern const uint32_t prebuiltNoteTable[];
+    extern const size_t prebuiltNoteTableSize;
+
+} // namespace physical_modeling_piano
+
+#endif /* _7E2C41D9_3B8A_4F0E_9D57_A1C64E0B92F3 */
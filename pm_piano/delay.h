@@ -15,10 +15,19 @@
 namespace physical_modeling_piano
 {
 
+// p < size * 2 を [0, size) に戻す
+inline size_t
+wrapDelayIndex(size_t p, size_t size)
+{
+    return p < size ? p : p - size;
+}
+
+// バッファの長さは 2 のべきに丸めず、必要な分 (遅延 + 1) だけ取る
+// 位置は 1 回の比較で折り返す
 template <class T = float>
 class DelayState
 {
-    size_t mask_   = 0;
+    size_t size_   = 0;
     size_t cursor_ = 0;
     T* buffer_{};
 
@@ -28,9 +37,10 @@ public:
 
     void attachBuffer(T* buffer, size_t size)
     {
+        assert(size > 0);
         buffer_ = buffer;
-        mask_   = size - 1;
-        assert(((size & (size - 1)) == 0) && "size must be pow of 2");
+        size_   = size;
+        cursor_ = 0;
     }
 
     template <size_t N>
@@ -43,10 +53,10 @@ public:
     {
         if (delay)
         {
-            auto r = buffer_[(cursor_ - delay) & mask_];
+            auto r = buffer_[wrapDelayIndex(cursor_ + size_ - delay, size_)];
 
             buffer_[cursor_] = in;
-            cursor_          = (cursor_ + 1) & mask_;
+            cursor_          = wrapDelayIndex(cursor_ + 1, size_);
             return r;
         }
         else
@@ -55,13 +65,103 @@ public:
         }
     }
 
+    // 遅延がバッファいっぱい (size - 1 > 0) のとき
+    // 一番古い位置が次に書く位置なので、折り返しの計算は 1 回で済む
+    inline T updateFull(const T& in)
+    {
+        assert(size_ > 1);
+        const size_t next = wrapDelayIndex(cursor_ + 1, size_);
+        auto r            = buffer_[next];
+
+        buffer_[cursor_] = in;
+        cursor_          = next;
+        return r;
+    }
+
     void clear(size_t delay)
     {
-        //        printf("delay = %zd/%zd\n", delay, mask_);
-        assert(delay <= mask_);
+        //        printf("delay = %zd/%zd\n", delay, size_);
+        assert(delay < size_);
         memset(buffer_, 0, sizeof(T) * (delay + 1));
         cursor_ = delay;
     }
+
+    void clearAll()
+    {
+        memset(buffer_, 0, sizeof(T) * size_);
+        cursor_ = 0;
+    }
+
+    // ブロック処理用
+    // n <= delay なら n サンプル分の出力は全部読み出し済みの入力から決まるので、
+    // 読み出し位置と書き込み位置を先頭から 1 サンプルずつ読んでから書けば
+    // update() を n 回呼ぶのと同じになる (n, delay <= size)
+    struct Block
+    {
+        T* buffer;
+        size_t size;
+        size_t readPos;
+        size_t writePos;
+
+        const T& read(size_t i) const { return buffer[wrapDelayIndex(readPos + i, size)]; }
+        T& write(size_t i) const { return buffer[wrapDelayIndex(writePos + i, size)]; }
+
+        // i から読み出しも書き込みも折り返さずに続く数
+        // 内側のループはこの区間ごとに readPtr(i), writePtr(i) から直接読み書きすれば折り返しの比較がいらない
+        size_t getContiguous(size_t i) const
+        {
+            return size - std::max(wrapDelayIndex(readPos + i, size), wrapDelayIndex(writePos + i, size));
+        }
+        const T* readPtr(size_t i) const { return &read(i); }
+        T* writePtr(size_t i) const { return &write(i); }
+    };
+
+    Block getBlock(size_t delay) const
+    {
+        assert(delay <= size_);
+        return {buffer_, size_, wrapDelayIndex(cursor_ + size_ - delay, size_), cursor_};
+    }
+
+    // 書き込み位置から delay 戻った位置 (delay <= size、size なら書き込み位置と同じ)
+    // 1 本のバッファに複数の遅延線を並べて 1 つのカーソルで回すときに使う
+    T& tap(size_t delay) const
+    {
+        assert(delay <= size_);
+        return buffer_[wrapDelayIndex(cursor_ + size_ - delay, size_)];
+    }
+
+    // ブロック処理で tap(delay) から n サンプル分を順に読み書きする
+    struct Tap
+    {
+        T* buffer;
+        size_t size;
+        size_t pos;
+
+        T& at(size_t i) const { return buffer[wrapDelayIndex(pos + i, size)]; }
+        T* ptr(size_t i) const { return &at(i); }
+        // i から折り返さずに続く数
+        size_t getContiguous(size_t i) const { return size - wrapDelayIndex(pos + i, size); }
+    };
+
+    Tap getTap(size_t delay) const
+    {
+        assert(delay <= size_);
+        return {buffer_, size_, wrapDelayIndex(cursor_ + size_ - delay, size_)};
+    }
+
+    void advance(size_t n) { cursor_ = wrapDelayIndex(cursor_ + n, size_); }
+
+    // VoiceBank がレーンに展開するため
+    T* getBuffer() const { return buffer_; }
+    size_t getSize() const { return size_; }
+    size_t getCursor() const { return cursor_; }
+    // バッファの中身をそのまま別の場所に移したとき
+    void setBuffer(T* buffer) { buffer_ = buffer; }
+    void setCursor(size_t cursor)
+    {
+        assert(cursor < size_);
+        cursor_ = cursor;
+    }
 };
 
 template <size_t Size>
@@ -81,16 +181,11 @@ public:
     float update(float in) { return state_.update(in, delay_); }
 };
 
+// delay サンプルの遅延に要るバッファの長さ
 inline size_t
 computeDelayBufferSize(size_t delay)
 {
-    delay += 1;
-    if (delay == 1)
-    {
-        return 1;
-    }
-    int lz = __builtin_clz((uint32_t)delay - 1);
-    return 1 << (32 - lz);
+    return delay + 1;
 }
 
 } // namespace physical_modeling_piano
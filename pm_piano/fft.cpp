@@ -0,0 +1,134 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 14:11:48
+ */
+
+#include "fft.h"
+#include <assert.h>
+#include <math.h>
+
+namespace physical_modeling_piano
+{
+    void
+    RealFFT::initialize(size_t n)
+    {
+        assert(n >= 4 && (n & (n - 1)) == 0);
+        n_ = n;
+
+        const size_t m = n / 2;
+        twiddle_.resize(m / 2);
+        for (size_t k = 0; k < m / 2; ++k)
+        {
+            const double w = -2 * M_PI * k / m;
+            twiddle_[k] = Complex(cos(w), sin(w));
+        }
+
+        realTwiddle_.resize(m + 1);
+        for (size_t k = 0; k <= m; ++k)
+        {
+            const double w = -2 * M_PI * k / n;
+            realTwiddle_[k] = Complex(cos(w), sin(w));
+        }
+
+        int bits = 0;
+        while ((size_t(1) << bits) < m)
+        {
+            ++bits;
+        }
+        bitReverse_.resize(m);
+        for (size_t i = 0; i < m; ++i)
+        {
+            uint32_t r = 0;
+            for (int b = 0; b < bits; ++b)
+            {
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            }
+            bitReverse_[i] = r;
+        }
+
+        work_.resize(m);
+    }
+
+    void
+    RealFFT::transform(Complex *v, bool inverse) const
+    {
+        const size_t m = n_ / 2;
+        for (size_t i = 0; i < m; ++i)
+        {
+            const size_t j = bitReverse_[i];
+            if (i < j)
+            {
+                std::swap(v[i], v[j]);
+            }
+        }
+
+        for (size_t len = 2; len <= m; len <<= 1)
+        {
+            const size_t half = len / 2;
+            const size_t step = m / len;
+            for (size_t i = 0; i < m; i += len)
+            {
+                for (size_t k = 0; k < half; ++k)
+                {
+                    auto w = twiddle_[k * step];
+                    if (inverse)
+                    {
+                        w = std::conj(w);
+                    }
+                    const auto a = v[i + k];
+                    const auto b = multiply(v[i + k + half], w);
+                    v[i + k] = a + b;
+                    v[i + k + half] = a - b;
+                }
+            }
+        }
+    }
+
+    void
+    RealFFT::forward(Complex *out, const float *in)
+    {
+        // 偶数番を実部、奇数番を虚部に詰めて半分の長さで変換する
+        const size_t m = n_ / 2;
+        auto *z = work_.data();
+        for (size_t k = 0; k < m; ++k)
+        {
+            z[k] = Complex(in[2 * k], in[2 * k + 1]);
+        }
+        transform(z, false);
+
+        // 偶数番と奇数番のスペクトルに分けて組み直す
+        for (size_t k = 0; k <= m; ++k)
+        {
+            const auto zk = z[k == m ? 0 : k];
+            const auto zmk = std::conj(z[k == 0 ? 0 : m - k]);
+            const auto even = (zk + zmk) * 0.5f;
+            const auto d = (zk - zmk) * 0.5f;
+            const Complex odd(d.imag(), -d.real()); // / i
+            out[k] = even + multiply(realTwiddle_[k], odd);
+        }
+    }
+
+    void
+    RealFFT::inverse(float *out, const Complex *in)
+    {
+        const size_t m = n_ / 2;
+        auto *z = work_.data();
+        for (size_t k = 0; k < m; ++k)
+        {
+            const auto xk = in[k];
+            const auto xmk = std::conj(in[m - k]);
+            const auto even = (xk + xmk) * 0.5f;
+            const auto odd = multiply(xk - xmk, std::conj(realTwiddle_[k])) * 0.5f;
+            z[k] = even + Complex(-odd.imag(), odd.real()); // + i * odd
+        }
+        transform(z, true);
+
+        const float scale = 1.0f / m;
+        for (size_t k = 0; k < m; ++k)
+        {
+            out[2 * k] = z[k].real() * scale;
+            out[2 * k + 1] = z[k].imag() * scale;
+        }
+    }
+
+} // namespace physical_modeling_piano
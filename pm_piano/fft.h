@@ -0,0 +1,56 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 14:05:21
+ */
+#ifndef _580C6BC5_CEEF_1D36_B88C_A6D36EFED0AB
+#define _580C6BC5_CEEF_1D36_B88C_A6D36EFED0AB
+
+#include <complex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "platform.h"
+
+namespace physical_modeling_piano
+{
+    // 実数列の FFT (長さは 2 のべき)
+    // 長さ n の実数列を n/2 点の複素 FFT 1 回で変換し、0..n/2 の n/2 + 1 本のビンを返す
+    // 係数表は initialize() で作るので、変換中にメモリの確保はしない
+    class RealFFT
+    {
+    public:
+        using Complex = std::complex<float>;
+
+        // std::complex の operator* は inf/NaN の扱いのためにライブラリ呼び出しになるので使わない
+        static Complex multiply(const Complex &a, const Complex &b)
+        {
+            return Complex(a.real() * b.real() - a.imag() * b.imag(),
+                           a.real() * b.imag() + a.imag() * b.real());
+        }
+
+    public:
+        void initialize(size_t n);
+
+        size_t getSize() const { return n_; }
+        size_t getBinCount() const { return n_ / 2 + 1; }
+
+        // out は getBinCount() 個
+        void forward(Complex *out, const float *in);
+        // 逆変換 (1/n も掛ける)
+        void inverse(float *out, const Complex *in);
+
+    protected:
+        void transform(Complex *v, bool inverse) const;
+
+    private:
+        size_t n_ = 0;
+        std::vector<Complex> twiddle_;     // n/2 点の複素 FFT 用 exp(-2πik/(n/2))
+        std::vector<Complex> realTwiddle_; // 実数への組み直し用 exp(-2πik/n)
+        std::vector<uint32_t> bitReverse_;
+        std::vector<Complex> work_;
+    };
+
+} // namespace physical_modeling_piano
+
+#endif /* _580C6BC5_CEEF_1D36_B88C_A6D36EFED0AB */
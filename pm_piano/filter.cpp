@@ -4,6 +4,7 @@
  */
 
 #include "filter.h"
+#include <algorithm>
 #include <math.h>
 #include <stdio.h>
 
@@ -90,11 +91,20 @@ makeBiquadFilter(
 }
 
 void
-makeLossFilter(float ca[2], float cb[2], float f0, float fs, float c1, float c3)
+makeLossFilter(
+    float ca[2], float cb[2], float f0, float fs, float c1, float c3, int decimation)
 {
     float g  = 1 - c1 / f0;
     float b  = 4 * c3 + f0;
     float a1 = (-b + sqrtf(b * b - 16 * c3 * c3)) / (4 * c3);
+    if (decimation > 1)
+    {
+        // 同じ周波数 [Hz] では ω が decimation 倍になるので、
+        // 低域の |H| の ω^2 の係数 a1 / (1 + a1)^2 を decimation^2 で割った極にする
+        // 1 周期あたりの損失 g はレートによらない
+        float q = a1 / ((1 + a1) * (1 + a1)) / (decimation * decimation);
+        a1      = q < 0 ? (1 - 2 * q - sqrtf(1 - 4 * q)) / (2 * q) : 0;
+    }
     cb[0]    = g * (1 + a1);
     cb[1]    = 0;
     ca[0]    = 1;
@@ -263,6 +273,92 @@ makeThirianDispersionFilter(float* ca, float* cb, float B, float f, int M)
     dumpFilter("thirian dispersion", 2, ca, cb);
 }
 
+namespace
+{
+
+// 2 次の全域通過フィルタの位相遅延 [サンプル]
+// 分子は分母の係数の逆順なので、位相の遅れは 2ω + 2 arg(A(e^jω)) (A は最小位相なので折り返さない)
+float
+allpassPhaseDelay(const float* ca, float omega)
+{
+    float re = ca[0] + ca[1] * cosf(omega) + ca[2] * cosf(2 * omega);
+    float im = -(ca[1] * sinf(omega) + ca[2] * sinf(2 * omega));
+    return (2 * omega + 2 * atan2f(im, re)) / omega;
+}
+
+} // namespace
+
+void
+makeThirianDispersionFilter(
+    float* ca, float* cb, float B, float f, int M, float Fs, int decimation)
+{
+    makeThirianDispersionFilter(ca, cb, B, f, M);
+    float D = Db(B, f, M);
+    if (decimation <= 1 || D <= 1.0f)
+    {
+        return;
+    }
+
+    // 倍音の周波数で、基音との位相遅延 [秒] の差をそのままのレートのものにそろえる D を探す
+    // 各段は同じものなので 1 段で比べればよい
+    const float full[3] = {ca[0], ca[1], ca[2]};
+    const float FsLow   = Fs / decimation;
+    const int K         = std::max(2, std::min(16, (int)(0.45f * FsLow / f)));
+    auto error          = [&](float d) {
+        float c[3];
+        float b[3];
+        thirian(2, c, b, d);
+        float e  = 0;
+        float pf1 = 0;
+        float ph1 = 0;
+        for (int k = 1; k <= K; ++k)
+        {
+            float omega = 2 * PI * k * f / Fs;
+            float pf    = allpassPhaseDelay(full, omega) / Fs;
+            float ph    = allpassPhaseDelay(c, omega * decimation) / FsLow;
+            if (k == 1)
+            {
+                pf1 = pf;
+                ph1 = ph;
+            }
+            float diff = (ph - ph1) - (pf - pf1);
+            e += diff * diff;
+        }
+        return e;
+    };
+
+    // 黄金分割探索
+    constexpr float R = 0.618034f;
+    float lo          = 1.001f;
+    float hi          = D;
+    float x1          = hi - R * (hi - lo);
+    float x2          = lo + R * (hi - lo);
+    float e1          = error(x1);
+    float e2          = error(x2);
+    for (int i = 0; i < 40; ++i)
+    {
+        if (e1 < e2)
+        {
+            hi = x2;
+            x2 = x1;
+            e2 = e1;
+            x1 = hi - R * (hi - lo);
+            e1 = error(x1);
+        }
+        else
+        {
+            lo = x1;
+            x1 = x2;
+            e1 = e2;
+            x2 = lo + R * (hi - lo);
+            e2 = error(x2);
+        }
+    }
+    thirian(2, ca, cb, 0.5f * (lo + hi));
+
+    dumpFilter("thirian dispersion (decimated)", 2, ca, cb);
+}
+
 } // namespace detail
 
 } // namespace physical_modeling_piano
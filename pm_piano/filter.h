@@ -11,7 +11,7 @@
 #include <stdio.h>
 #include <utility>
 
-#include <pico/platform.h>
+#include "platform.h"
 
 namespace physical_modeling_piano
 {
@@ -39,10 +39,14 @@ namespace physical_modeling_piano
         void makeBiquadFilter(
             float *ca, float *cb, float f0, float fs, float Q, BiquadFilterType type);
 
+        // decimation: 1/decimation のレートで回すとき、同じ周波数で同じ減衰になるようにする
         void makeLossFilter(
-            float ca[2], float cb[2], float f0, float fs, float c1, float c3);
+            float ca[2], float cb[2], float f0, float fs, float c1, float c3, int decimation = 1);
 
         void makeThirianDispersionFilter(float *ca, float *cb, float B, float f, int M);
+        // Fs / decimation のレートで、Fs で作ったものと倍音の位置での位相遅延 [秒] の差が同じになるようにする
+        void makeThirianDispersionFilter(
+            float *ca, float *cb, float B, float f, int M, float Fs, int decimation);
 
     } // namespace detail
 
@@ -102,6 +106,27 @@ namespace physical_modeling_piano
             return _filter<N>(in, state.data());
         }
 
+        // buf を in-place でフィルタする
+        // 各サンプルは TV に変換してから通す
+        template <size_t N, class TV, class TB, class TH>
+        void __time_critical_func(filterBlock)(TB *buf, size_t n, TH *history) const
+        {
+            TH h[N];
+            for (size_t i = 0; i < N; ++i)
+            {
+                h[i] = history[i];
+            }
+            for (size_t i = 0; i < n; ++i)
+            {
+                TV in = buf[i];
+                buf[i] = _filter<N>(in, h);
+            }
+            for (size_t i = 0; i < N; ++i)
+            {
+                history[i] = h[i];
+            }
+        }
+
         float computeGroupDelay(int N, float f, float Fs) const
         {
             assert(N + 1 <= Size);
@@ -135,6 +160,20 @@ namespace physical_modeling_piano
             }
         }
 
+        // 係数の書き出し / 読み込み (coefficients.h)
+        template <class IO>
+        void transferCoefficients(IO &io)
+        {
+            for (auto &v : a)
+            {
+                io.value(v);
+            }
+            for (auto &v : b)
+            {
+                io.value(v);
+            }
+        }
+
     protected:
         template <class TV, class TH, int I>
         __attribute__((always_inline)) void proc(const TV &in, const TV &out, TH *__restrict__ history, I2T<I>) const
@@ -181,6 +220,11 @@ namespace physical_modeling_piano
 
         void clear(State &st) const { st.clear(); }
 
+        const Constant &getCoefficients() const { return constant_; }
+
+        template <class IO>
+        void transferCoefficients(IO &io) { constant_.transferCoefficients(io); }
+
     protected:
         Constant &getConstant() { return constant_; }
 
@@ -203,7 +247,7 @@ namespace physical_modeling_piano
         {
             assert(n >= 1);
             assert(n <= N_MAX);
-            setDimImpl(n, std::make_index_sequence<N_MAX - 1>());
+            setDimImpl(n, std::make_index_sequence<N_MAX>());
         }
 
         TV __time_critical_func(filter)(const TV &in, State &st) const
@@ -211,6 +255,13 @@ namespace physical_modeling_piano
             return (constant_.*filterFunc_)(in, st);
         }
 
+        // 次数の分岐をブロックあたり 1 回にする
+        template <class TB>
+        void __time_critical_func(filterBlock)(TB *buf, size_t n, State &st) const
+        {
+            filterBlockImpl(buf, n, st, std::make_index_sequence<N_MAX>());
+        }
+
         float computeGroupDelay(float f, float Fs) const
         {
             return constant_.computeGroupDelay(n_, f, Fs);
@@ -220,11 +271,23 @@ namespace physical_modeling_piano
 
         void clear(State &st) const { st.clear(n_); }
 
+        size_t getDim() const { return n_; }
+        const Constant &getCoefficients() const { return constant_; }
+
         void copy(const float *sa, const float *sb, size_t size)
         {
             constant_.copy(sa, sb, size);
         }
 
+        // 読み込んだときは次数から filterFunc_ を選び直す
+        template <class IO>
+        void transferCoefficients(IO &io)
+        {
+            constant_.transferCoefficients(io);
+            io.value(n_);
+            setDim(n_ < 1 ? 1 : n_ > N_MAX ? N_MAX : n_);
+        }
+
     protected:
         Constant &getConstant() { return constant_; }
 
@@ -239,6 +302,12 @@ namespace physical_modeling_piano
             filterFunc_ = funcTable[n - 1];
         }
 
+        template <class TB, size_t... I>
+        void filterBlockImpl(TB *buf, size_t n, State &st, std::index_sequence<I...>) const
+        {
+            (void)((n_ == I + 1 && (constant_.template filterBlock<I + 1, TV>(buf, n, st.data()), true)) || ...);
+        }
+
     private:
         Constant constant_;
         FilterFunc filterFunc_;
@@ -283,15 +352,15 @@ public:
     public:
         struct State
         {
-            TH h0;
+            TH h0{};
         };
 
     public:
-        void initialize(float f0, float fs, float c1, float c3)
+        void initialize(float f0, float fs, float c1, float c3, int decimation = 1)
         {
             float ca[2];
             float cb[2];
-            detail::makeLossFilter(ca, cb, f0, fs, c1, c3);
+            detail::makeLossFilter(ca, cb, f0, fs, c1, c3, decimation);
             ma1_ = -ca[1];
             b0_ = cb[0];
         }
@@ -317,6 +386,16 @@ public:
         }
 
         void clear(State &st) const { st.h0 = 0; }
+
+        const TC &getB0() const { return b0_; }
+        const TC &getMA1() const { return ma1_; }
+
+        template <class IO>
+        void transferCoefficients(IO &io)
+        {
+            io.value(ma1_);
+            io.value(b0_);
+        }
     };
 #endif
 
@@ -332,6 +411,28 @@ public:
             detail::makeThirianDispersionFilter(ca, cb, B, f, M);
             this->copy(ca, cb);
         }
+        void initialize(float B, float f, int M, float Fs, int decimation)
+        {
+            float ca[3];
+            float cb[3];
+            detail::makeThirianDispersionFilter(ca, cb, B, f, M, Fs, decimation);
+            this->copy(ca, cb);
+        }
+    };
+
+    ////
+    // 1 次固定の Thirian フィルタ
+    template <class TC = float, class TH = float>
+    class FirstOrderThirianFilter : public FixedSizeIIRFilter<1, TC, TH>
+    {
+    public:
+        void initialize(float D)
+        {
+            float ca[2];
+            float cb[2];
+            detail::thirian(1, ca, cb, D);
+            this->copy(ca, cb);
+        }
     };
 
     ////
@@ -9,9 +9,10 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <utility>
 
-#include <pico/platform.h>
+#include "platform.h"
 
 namespace physical_modeling_piano
 {
@@ -391,8 +392,10 @@ namespace physical_modeling_piano
     inline uint32_t
     getAbsMask(float v)
     {
-        return 0;
-        //    return *(uint32_t*)(&v) & 0x7fffffff;
+        // 正の float はビット列の大小と値の大小が一致する
+        uint32_t r;
+        memcpy(&r, &v, sizeof(r));
+        return r & 0x7fffffff;
     }
 
     template <class T, int S>
@@ -4,6 +4,7 @@
  */
 
 #include "hammer.h"
+#include "coefficients.h"
 #include <math.h>
 
 namespace physical_modeling_piano
@@ -15,12 +16,18 @@ Hammer::initialize(float m,
                    float p,
                    float Z,
                    float alpha,
-                   const SystemParameters& sysParams)
+                   const SystemParameters& sysParams,
+                   int decimation)
 {
+    // 1/decimation のレートで回すときは時間の刻みをその分長くする
+    const float dt = sysParams.deltaT * decimation;
+    dt_            = dt;
+    dt_2_          = dt * 0.5f;
+
     p_  = p;
     c1_ = log2(K / (2 * Z));
-    c2_ = alpha / sysParams.deltaT;
-    c3_ = sysParams.deltaT * (2 * Z) / m;
+    c2_ = alpha / dt;
+    c3_ = dt * (2 * Z) / m;
 
     c2h_ = c2_ * 2.0f;
     c3h_ = c3_ * 0.5f;
@@ -28,6 +35,23 @@ Hammer::initialize(float m,
     // c3h_.set(c3_.get() >> 1);
 }
 
+template <class IO>
+void
+Hammer::transferCoefficients(IO& io)
+{
+    io.value(dt_);
+    io.value(dt_2_);
+    io.value(p_);
+    io.value(c1_);
+    io.value(c2_);
+    io.value(c3_);
+    io.value(c2h_);
+    io.value(c3h_);
+}
+
+template void Hammer::transferCoefficients(CoefficientWriter& io);
+template void Hammer::transferCoefficients(CoefficientReader& io);
+
 void
 Hammer::update(State& s,
                const VelocityT& vin,
@@ -40,7 +64,7 @@ Hammer::update(State& s,
     sub(tv, s.v, vin);
     sub(tv, tv, s.F_2Z);
     FeltCompT du;
-    mul(du, tv, sysParams.deltaTF);
+    mul(du, tv, dt_);
     // mul(du, tv, sysParams.deltaT);
     add(s.u, s.u, du);
 
@@ -153,7 +177,7 @@ Hammer::update2(State& s,
                     s.u,
                     s.F_2Z,
                     vin,
-                    sysParams.deltaT_2F,
+                    dt_2_,
                     s.prev_upK_2Z,
                     c2h_,
                     c3h_);
@@ -166,7 +190,7 @@ Hammer::update2(State& s,
                     s.u,
                     F_2Zc,
                     vin,
-                    sysParams.deltaTF,
+                    dt_,
                     s.prev_upK_2Z,
                     c2_,
                     c3_);
@@ -180,7 +204,7 @@ Hammer::update2(State& s,
     sub(tv, s.v, vin);
     sub(tv, tv, s.F_2Z);
     FeltCompT du;
-    mul(du, tv, sysParams.deltaT_2F);
+    mul(du, tv, dt_2_);
     add(uc, s.u, du);
 
     // upK_2Z = uc > 0 ? pow(uc, p) * (K/2Z) : 0
@@ -215,7 +239,7 @@ Hammer::update2(State& s,
     // u += (vc - vin - F_2Z) * dt;
     sub(tv, vc, vin);
     sub(tv, tv, F_2Zh);
-    mul(du, tv, sysParams.deltaTF);
+    mul(du, tv, dt_);
     add(s.u, s.u, du);
 
     // upK_2Z = u > 0 ? pow(u, p) * (K/2Z) : 0
@@ -264,7 +288,7 @@ Hammer::update4(State& s,
                     s.u,
                     s.F_2Z,
                     vin,
-                    sysParams.deltaT_2F,
+                    dt_2_,
                     s.prev_upK_2Z,
                     c2h_,
                     c3h_);
@@ -280,7 +304,7 @@ Hammer::update4(State& s,
                     u2,
                     s.F_2Z,
                     vin,
-                    sysParams.deltaT_2F,
+                    dt_2_,
                     s.prev_upK_2Z,
                     c2h_,
                     c3h_);
@@ -296,7 +320,7 @@ Hammer::update4(State& s,
                     s.u,
                     s.F_2Z,
                     vin,
-                    sysParams.deltaTF,
+                    dt_,
                     s.prev_upK_2Z,
                     c2_,
                     c3_);
@@ -319,7 +343,7 @@ Hammer::update4(State& s,
                     s.u,
                     F_2Zc,
                     vin,
-                    sysParams.deltaTF,
+                    dt_,
                     s.prev_upK_2Z,
                     c2_,
                     c3_);
@@ -8,7 +8,7 @@
 #include "fixed.h"
 #include "sys_params.h"
 
-#include <pico/platform.h>
+#include "platform.h"
 
 namespace physical_modeling_piano
 {
@@ -69,7 +69,12 @@ namespace physical_modeling_piano
                         float p,
                         float Z,
                         float alpha,
-                        const SystemParameters &sysParams);
+                        const SystemParameters &sysParams,
+                        int decimation = 1);
+
+        // initialize() で決めたものの書き出し / 読み込み (coefficients.h)
+        template <class IO>
+        void transferCoefficients(IO &io);
 
         void __time_critical_func(update)(State &s,
                                           const VelocityT &vin,
@@ -101,6 +106,8 @@ namespace physical_modeling_piano
                                                           const C3T &c3) const;
 
     private:
+        DeltaTimeT dt_;   // SystemParameters::deltaTF (間引くときはその倍数)
+        DeltaTimeT dt_2_; // dt_ / 2
         StiffExpT p_;
         C1T c1_;
         C2T c2_;
@@ -0,0 +1,103 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 10:20:03
+ */
+
+#include "load_governor.h"
+#include <algorithm>
+
+namespace physical_modeling_piano
+{
+    void
+    LoadGovernor::initialize(size_t maxPoly, size_t minPoly, int maxDetailBias)
+    {
+        maxPoly_ = maxPoly;
+        minPoly_ = std::min(minPoly, maxPoly);
+        maxDetailBias_ = std::max(maxDetailBias, MILD_DETAIL_BIAS);
+
+        step_ = 0;
+        maxStep_ = MILD_DETAIL_BIAS + int(maxPoly_ - minPoly_) + (maxDetailBias_ - MILD_DETAIL_BIAS);
+        load_ = 0;
+        peakLoad_ = 0;
+        overruns_ = 0;
+        holdBlocks_ = 0;
+        calmBlocks_ = 0;
+        applyStep();
+    }
+
+    bool
+    LoadGovernor::update(uint32_t elapsed, uint32_t deadline)
+    {
+        if (!deadline)
+        {
+            return false;
+        }
+
+        const uint32_t x = std::min<uint64_t>(uint64_t(elapsed) * LOAD_ONE / deadline, UINT32_MAX);
+        peakLoad_ = std::max(peakLoad_, x);
+        if (x >= LOAD_ONE)
+        {
+            ++overruns_;
+        }
+
+        // 上がるときは速く、下がるときはゆっくり追う
+        if (x > load_)
+        {
+            load_ += (x - load_) >> 1;
+        }
+        else
+        {
+            load_ -= (load_ - x) >> 4;
+        }
+
+        if (holdBlocks_)
+        {
+            --holdBlocks_;
+        }
+
+        const int prevStep = step_;
+        if ((load_ > HIGH_LOAD && !holdBlocks_) || x >= LOAD_ONE)
+        {
+            // 締め切りに間に合わなかったときは待たずに落とす
+            step_ = std::min(step_ + 1, maxStep_);
+            holdBlocks_ = HOLD_BLOCKS;
+            calmBlocks_ = 0;
+        }
+        else if (load_ < LOW_LOAD)
+        {
+            if (++calmBlocks_ >= RECOVER_BLOCKS)
+            {
+                step_ = std::max(step_ - 1, 0);
+                calmBlocks_ = 0;
+            }
+        }
+        else
+        {
+            calmBlocks_ = 0;
+        }
+
+        if (step_ == prevStep)
+        {
+            return false;
+        }
+        applyStep();
+        return true;
+    }
+
+    void
+    LoadGovernor::applyStep()
+    {
+        const int polySteps = int(maxPoly_ - minPoly_);
+        int s = step_;
+
+        detailBias_ = std::min(s, MILD_DETAIL_BIAS);
+        s -= detailBias_;
+
+        const int dp = std::min(s, polySteps);
+        poly_ = maxPoly_ - dp;
+        s -= dp;
+
+        detailBias_ += s;
+    }
+
+} // namespace physical_modeling_piano
@@ -0,0 +1,72 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 10:12:46
+ */
+#ifndef _6725C60E_B316_1880_8752_A6BB0EA17E10
+#define _6725C60E_B316_1880_8752_A6BB0EA17E10
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+namespace physical_modeling_piano
+{
+    // ブロックの処理時間を締め切りと比べて、同時発音数と詳細度の上限を決める
+    // 負荷が上がったら 1 段ずつ落とし、十分下がった状態が続いたら 1 段ずつ戻す
+    // 落とす順番は
+    //   詳細度のバイアスを MILD_DETAIL_BIAS まで (離鍵済みで小さいボイスだけが粗くなる)
+    //   → 同時発音数を maxPoly から minPoly まで
+    //   → 詳細度のバイアスを maxDetailBias まで
+    class LoadGovernor
+    {
+    public:
+        // 負荷は締め切りに対する割合を 1/1024 単位で持つ
+        static constexpr uint32_t LOAD_ONE = 1024;
+        static constexpr uint32_t HIGH_LOAD = LOAD_ONE * 85 / 100;
+        static constexpr uint32_t LOW_LOAD = LOAD_ONE * 60 / 100;
+
+        // 落とした効果が出るまで (奪ったボイスのフェードアウト分) 次は落とさない
+        static constexpr uint32_t HOLD_BLOCKS = 4;
+        // LOW_LOAD 未満がこれだけ続いたら 1 段戻す
+        static constexpr uint32_t RECOVER_BLOCKS = 64;
+
+        static constexpr int MILD_DETAIL_BIAS = 2;
+
+    public:
+        void initialize(size_t maxPoly, size_t minPoly, int maxDetailBias);
+
+        // 1 ブロックごとに呼ぶ
+        // 同時発音数か詳細度を変えたら true
+        bool __time_critical_func(update)(uint32_t elapsed, uint32_t deadline);
+
+        uint32_t getLoad() const { return load_; } // 平滑化したもの
+        uint32_t getPeakLoad() const { return peakLoad_; }
+        uint32_t getOverrunCount() const { return overruns_; }
+
+        size_t getPolyphony() const { return poly_; }
+        int getDetailBias() const { return detailBias_; }
+
+    protected:
+        void __time_critical_func(applyStep)();
+
+    private:
+        size_t maxPoly_{};
+        size_t minPoly_{};
+        int maxDetailBias_{};
+
+        int step_ = 0;
+        int maxStep_ = 0;
+        size_t poly_{};
+        int detailBias_ = 0;
+
+        uint32_t load_ = 0;
+        uint32_t peakLoad_ = 0;
+        uint32_t overruns_ = 0;
+        uint32_t holdBlocks_ = 0;
+        uint32_t calmBlocks_ = 0;
+    };
+
+} // namespace physical_modeling_piano
+
+#endif /* _6725C60E_B316_1880_8752_A6BB0EA17E10 */
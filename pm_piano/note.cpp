@@ -5,10 +5,13 @@
 
 #include "note.h"
 #include "allocator.h"
+#include "coefficients.h"
 #include "sys_params.h"
 #include <algorithm>
+#include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 
 namespace physical_modeling_piano
 {
@@ -58,23 +61,33 @@ namespace physical_modeling_piano
 
         _nStrings_ = 1.0f / nStrings_;
 
+        // 低音は上の方の倍音が少ないので、半分のレートで回して出力を補間する
+        decimation_ = USE_HALF_RATE && freq < sysParams.halfRateFrequency ? 2 : 1;
+        if (decimation_ > 1)
+        {
+            upsampler_.initialize();
+        }
+
         for (int i = 0; i < nStrings_; ++i)
         {
             strings_[i].initialize(freq * sysParams.tune[i],
                                    B,
                                    Z,
                                    Zb + (nStrings_ - 1) * Z,
-                                   sysParams);
+                                   sysParams,
+                                   decimation_);
         }
 
         const float alpha = 0.1e-4f * keyRate;
         const float p = 2.0f + keyRate;
         const float m = 0.06f - 0.058f * powf(keyRate, 0.1f);
         const float K = 40.0f * powf(0.7e-3, -p);
-        hammer_.initialize(m, K, p, Z, alpha, sysParams);
+        hammer_.initialize(m, K, p, Z, alpha, sysParams, decimation_);
 
         float bridgeLoadRatio = 2 * Z / (Z * nStrings_ + Zb);
         bridgeLoadRatio_ = bridgeLoadRatio;
+        collapsedInvNStrings_ = 1.0f;
+        collapsedLoadRatio_ = bridgeLoadRatio * nStrings_;
 
         //    printf("bridgeLoadRatio:%g %g\n", bridgeLoadRatio,
         //    (float)bridgeLoadRatio_);
@@ -82,17 +95,70 @@ namespace physical_modeling_piano
         if (keyRate < 0.4f)
         {
             hammerUpdateFunc_ = &Hammer::update;
+            hammerSteps_ = 1;
         }
         else if (keyRate < 0.85f)
         {
             hammerUpdateFunc_ = &Hammer::update2;
+            hammerSteps_ = 2;
         }
         else
         {
             hammerUpdateFunc_ = &Hammer::update4;
+            hammerSteps_ = 4;
+        }
+        if (decimation_ > 1 && hammerSteps_ < 4)
+        {
+            // 刻みが倍になる分、1 つ上の次数で解く
+            hammerUpdateFunc_ = hammerSteps_ == 1 ? &Hammer::update2 : &Hammer::update4;
+            hammerSteps_ *= 2;
         }
+
+        size_t minDelay = strings_[0].getMinBlockDelay();
+        for (int i = 1; i < nStrings_; ++i)
+        {
+            minDelay = std::min(minDelay, strings_[i].getMinBlockDelay());
+        }
+        blockSize_ = minDelay >= MIN_BLOCK_DELAY ? std::min(minDelay, String::MAX_BLOCK_SIZE) : 0;
+
+        silenceLevel_ = getAbsMask(SampleT(sysParams.voiceSilenceLevel));
+        silenceSamples_ = uint32_t(sysParams.voiceSilenceTime * sysParams.sampleRate / decimation_);
+        quietLevel_ = getAbsMask(SampleT(sysParams.voiceQuietLevel));
     }
 
+    template <class IO>
+    void
+    Note::transferCoefficients(IO &io)
+    {
+        io.value(nStrings_);
+        // 壊れた表を読んでも strings_ の外には出ない
+        nStrings_ = std::max(1, std::min(nStrings_, 3));
+        io.value(_nStrings_);
+        io.value(bridgeLoadRatio_);
+        io.value(collapsedInvNStrings_);
+        io.value(collapsedLoadRatio_);
+        for (int i = 0; i < nStrings_; ++i)
+        {
+            strings_[i].transferCoefficients(io);
+        }
+        hammer_.transferCoefficients(io);
+
+        // メンバ関数へのポインタは書き出せないので、分割数から選び直す
+        io.value(hammerSteps_);
+        hammerUpdateFunc_ = hammerSteps_ >= 4   ? &Hammer::update4
+                            : hammerSteps_ >= 2 ? &Hammer::update2
+                                                : &Hammer::update;
+        io.value(blockSize_);
+        io.value(decimation_);
+        upsampler_.transferCoefficients(io);
+        io.value(silenceLevel_);
+        io.value(silenceSamples_);
+        io.value(quietLevel_);
+    }
+
+    template void Note::transferCoefficients(CoefficientWriter &io);
+    template void Note::transferCoefficients(CoefficientReader &io);
+
     size_t
     Note::computeAllocatorSize() const
     {
@@ -106,28 +172,99 @@ namespace physical_modeling_piano
     }
 
     void
-    Note::State::initialize(size_t allocatorSize)
+    Note::moveDelayMemory(State &state, uint32_t *dst) const
     {
-        allocatorBuffer_.resize((allocatorSize + sizeof(uint32_t) - 1) /
-                                sizeof(uint32_t));
+        memcpy(dst, state.delayMemory, computeAllocatorSize());
+        for (int i = 0; i < nStrings_; ++i)
+        {
+            strings_[i].moveDelayMemory(state.strings[i], state.delayMemory, dst);
+        }
+        state.delayMemory = dst;
     }
 
     void
     Note::keyOn(State &state, Hammer::VelocityT v) const
     {
         //    printf("keyon %f\n", v);
-        SimpleLinearAllocator allocator(state.allocatorBuffer_.data(),
-                                        state.allocatorBuffer_.size() *
-                                            sizeof(uint32_t));
+        assert(state.delayMemory);
+        SimpleLinearAllocator allocator(state.delayMemory, computeAllocatorSize());
 
         for (int i = 0; i < nStrings_; ++i)
         {
             strings_[i].reset(state.strings[i], allocator);
+            strings_[i].setInitialDelayScale(state.strings[i], float(v));
         }
         state.hammer.reset(v);
         state.keyOn = true;
         state.sostenuto = false;
         state.idle = false;
+        state.level = 0;
+        state.lastOutput = 0;
+        state.silentSamples = 0;
+        state.detailLevel = 0;
+        state.nStrings = nStrings_;
+        state.upsampler.clear();
+    }
+
+    bool
+    Note::setDetailLevel(State &state, int level, bool allowMerge) const
+    {
+        level = std::max(0, std::min(level, N_DETAIL_LEVELS - 1));
+        if (!allowMerge && state.nStrings > 1)
+        {
+            level = std::min(level, DETAIL_COLLAPSE_UNISON - 1);
+        }
+        if (level == state.detailLevel)
+        {
+            return false;
+        }
+        // 前の切り替えで d1a の読み出し位置を移っている間は次の切り替えを待つ
+        for (int i = 0; i < state.nStrings; ++i)
+        {
+            if (state.strings[i].fadeRemaining)
+            {
+                return false;
+            }
+        }
+        state.detailLevel = level;
+
+        for (int i = 0; i < nStrings_; ++i)
+        {
+            strings_[i].setDetailLevel(state.strings[i], std::min(level, String::N_DETAIL_LEVELS - 1));
+        }
+        if (level >= DETAIL_COLLAPSE_UNISON && state.nStrings > 1)
+        {
+            // 弦の状態を平均して 1 本目にまとめる
+            // ブリッジに効く同相の成分は残り、打ち消し合っている成分は捨てる
+            String::mergeStates(strings_, state.strings, state.nStrings);
+            state.nStrings = 1;
+            return true;
+        }
+        return false;
+    }
+
+    uint32_t
+    Note::estimateCost(const State &state) const
+    {
+        // ハンマーの 1 ステップは弦 1 本の 2/3 くらい (ホストで測った比)
+        constexpr uint32_t HAMMER_STEP_COST = 12;
+        // 補間は出力 1 サンプルあたり積和 3 回
+        constexpr uint32_t UPSAMPLER_COST = 4;
+
+        uint32_t c = 0;
+        for (int i = 0; i < state.nStrings; ++i)
+        {
+            c += strings_[i].estimateCost(state.strings[i]);
+        }
+        if (!state.hammer.idle)
+        {
+            c += HAMMER_STEP_COST * hammerSteps_;
+        }
+        if (decimation_ > 1)
+        {
+            c = c / decimation_ + UPSAMPLER_COST;
+        }
+        return c;
     }
 
     void
@@ -142,6 +279,96 @@ namespace physical_modeling_piano
                  State &state,
                  const SystemParameters &sysParams,
                  const PedalState &pedal) const
+    {
+        if (!updateSustain(state, pedal))
+        {
+            return;
+        }
+
+        if (decimation_ > 1)
+        {
+            updateHalfRate(sample, nSamples, state, sysParams);
+        }
+        else if (blockSize_)
+        {
+            updateBlocks(sample, nSamples, state, sysParams);
+        }
+        else
+        {
+            updateSamples(sample, nSamples, state, sysParams);
+        }
+        updateDelayScale(state, nSamples);
+    }
+
+    void
+    Note::updateDelayScale(State &state, uint32_t nSamples) const
+    {
+        // 弦は decimation_ 分の 1 のレートで回している
+        for (int i = 0; i < state.nStrings; ++i)
+        {
+            strings_[i].updateDelayScale(state.strings[i], nSamples / decimation_, !state.hammer.idle);
+        }
+    }
+
+    void
+    Note::updateHalfRate(SampleT *sample,
+                         uint32_t nSamples,
+                         State &state,
+                         const SystemParameters &sysParams) const
+    {
+        // 弦は半分のレートで計算して、補間しながら足す
+        // 無音の判定などは半分のレートのサンプル数で数える
+        constexpr uint32_t CHUNK = 32;
+        while (nSamples)
+        {
+            const uint32_t n = std::min(nSamples, CHUNK * 2);
+            const uint32_t m = HalfbandUpsampler::getInputCount(state.upsampler, n);
+
+            SampleT low[CHUNK];
+            for (uint32_t i = 0; i < m; ++i)
+            {
+                low[i] = 0;
+            }
+            if (m)
+            {
+                if (blockSize_)
+                {
+                    updateBlocks(low, m, state, sysParams);
+                }
+                else
+                {
+                    updateSamples(low, m, state, sysParams);
+                }
+            }
+            upsampler_.process(sample, n, low, state.upsampler);
+
+            sample += n;
+            nSamples -= n;
+        }
+    }
+
+    void
+    Note::updateSilence(State &state, uint32_t level, uint32_t nSamples) const
+    {
+        state.level = level;
+
+        // ハンマーが当たっている間は数えない
+        if (!state.hammer.idle || level >= silenceLevel_)
+        {
+            state.silentSamples = 0;
+            return;
+        }
+
+        state.silentSamples += nSamples;
+        if (state.silentSamples >= silenceSamples_)
+        {
+            // ダンパーペダルで残っている減衰しきった音を止めてノードを空ける
+            state.idle = true;
+        }
+    }
+
+    bool
+    Note::updateSustain(State &state, const PedalState &pedal) const
     {
         if (pedal.sostenutoTrigger)
         {
@@ -155,31 +382,44 @@ namespace physical_modeling_piano
         {
             // todo: もっとマシにミュートする
             state.idle = true;
-            return;
         }
+        return sustain;
+    }
 
+    void
+    Note::updateSamples(SampleT *sample,
+                        uint32_t nSamples,
+                        State &state,
+                        const SystemParameters &sysParams) const
+    {
+        const auto total = nSamples;
+        const auto ref = state.lastOutput;
+        const int nStrings = state.nStrings;
+        const auto &invNStrings = getInvNStrings(state);
+        const auto &bridgeLoadRatio = getBridgeLoadRatio(state);
         uint32_t hammerMask = 0;
+        uint32_t level = 0;
+        SampleT out = 0;
 
         while (nSamples)
         {
             String::StringSampleT vString = 0;
             String::StringSampleT load = 0;
-            for (int i = 0; i < nStrings_; ++i)
+            for (int i = 0; i < nStrings; ++i)
             {
                 const auto &s = strings_[i];
                 auto &ss = state.strings[i];
 
                 add(vString, vString, s.getHammerInputVelocity(ss));
-                s.updateDelay(ss);
                 add(load, load, s.getBridgeInputVelocity(ss));
             }
 
             String::BridgeSampleT bload;
-            mul(bload, load, bridgeLoadRatio_);
+            mul(bload, load, bridgeLoadRatio);
 
             Hammer::VelocityT vStringAve;
             FixedPoint<int32_t, 18> vStringTmp = vString;
-            mul(vStringAve, vStringTmp, _nStrings_);
+            mul(vStringAve, vStringTmp, invNStrings);
             if (!state.hammer.idle)
             {
                 //            hammer_.update4(state.hammer, vStringAve, sysParams);
@@ -189,12 +429,26 @@ namespace physical_modeling_piano
             const auto &hload = state.hammer.F_2Z;
             hammerMask |= getAbsMask(hload);
 
-            for (int i = 0; i < nStrings_; ++i)
+            out = 0;
+            for (int i = 0; i < nStrings; ++i)
             {
                 auto s = strings_[i].update(state.strings[i], bload, hload);
 
-                add(*sample, *sample, s);
+                add(out, out, s);
+                if (i == 0)
+                {
+                    // まとめた弦は残りの本数分も足す
+                    for (int j = nStrings; j < nStrings_; ++j)
+                    {
+                        add(out, out, s);
+                    }
+                }
             }
+            add(*sample, *sample, out);
+
+            SampleT d;
+            sub(d, out, ref);
+            level |= getAbsMask(d);
             ++sample;
             --nSamples;
         }
@@ -203,6 +457,121 @@ namespace physical_modeling_piano
         {
             state.hammer.idle = true;
         }
+        state.lastOutput = out;
+        updateSilence(state, level, total);
+    }
+
+    void
+    Note::updateBlocks(SampleT *sample,
+                       uint32_t nSamples,
+                       State &state,
+                       const SystemParameters &sysParams) const
+    {
+        const auto total = nSamples;
+        const auto ref = state.lastOutput;
+        const int nStrings = state.nStrings;
+        const auto &invNStrings = getInvNStrings(state);
+        const auto &bridgeLoadRatio = getBridgeLoadRatio(state);
+        uint32_t hammerMask = 0;
+        uint32_t level = 0;
+        SampleT last = ref;
+
+        while (nSamples)
+        {
+            size_t n = std::min<size_t>(nSamples, blockSize_);
+
+            // hammer の入力速度は hammer の出力に置き換えていく
+            // hammer が止まっていれば弦の速度は見なくてよい
+            const bool hammerActive = !state.hammer.idle;
+            String::StringSampleT vString[String::MAX_BLOCK_SIZE];
+            String::StringSampleT load[String::MAX_BLOCK_SIZE];
+            for (size_t j = 0; j < n; ++j)
+            {
+                vString[j] = 0;
+                load[j] = 0;
+            }
+            for (int i = 0; i < nStrings; ++i)
+            {
+                strings_[i].prepareBlock(state.strings[i], n, hammerActive ? vString : nullptr, load);
+            }
+
+            String::BridgeSampleT bload[String::MAX_BLOCK_SIZE];
+            auto *hload = vString;
+            for (size_t j = 0; j < n; ++j)
+            {
+                mul(bload[j], load[j], bridgeLoadRatio);
+            }
+            if (hammerActive)
+            {
+                for (size_t j = 0; j < n; ++j)
+                {
+                    Hammer::VelocityT vStringAve;
+                    FixedPoint<int32_t, 18> vStringTmp = vString[j];
+                    mul(vStringAve, vStringTmp, invNStrings);
+                    (hammer_.*hammerUpdateFunc_)(state.hammer, vStringAve, sysParams);
+
+                    hammerMask |= getAbsMask(state.hammer.F_2Z);
+                    hload[j] = state.hammer.F_2Z;
+                }
+            }
+            else
+            {
+                hammerMask |= getAbsMask(state.hammer.F_2Z);
+                for (size_t j = 0; j < n; ++j)
+                {
+                    hload[j] = state.hammer.F_2Z;
+                }
+            }
+
+            SampleT out[String::MAX_BLOCK_SIZE];
+            for (size_t j = 0; j < n; ++j)
+            {
+                out[j] = 0;
+            }
+            if (nStrings < nStrings_)
+            {
+                // まとめた弦を nStrings_ 本分足す
+                SampleT out0[String::MAX_BLOCK_SIZE];
+                for (size_t j = 0; j < n; ++j)
+                {
+                    out0[j] = 0;
+                }
+                strings_[0].updateBlock(out0, state.strings[0], bload, hload, n);
+                for (int i = 0; i < nStrings_; ++i)
+                {
+                    for (size_t j = 0; j < n; ++j)
+                    {
+                        add(out[j], out[j], out0[j]);
+                    }
+                }
+            }
+            else
+            {
+                for (int i = 0; i < nStrings_; ++i)
+                {
+                    strings_[i].updateBlock(out, state.strings[i], bload, hload, n);
+                }
+            }
+            for (size_t j = 0; j < n; ++j)
+            {
+                add(sample[j], sample[j], out[j]);
+
+                SampleT d;
+                sub(d, out[j], ref);
+                level |= getAbsMask(d);
+            }
+            last = out[n - 1];
+
+            sample += n;
+            nSamples -= n;
+        }
+
+        if (hammerMask == 0)
+        {
+            state.hammer.idle = true;
+        }
+        state.lastOutput = last;
+        updateSilence(state, level, total);
     }
 
 } // namespace physical_modeling_piano
@@ -8,10 +8,11 @@
 #include "hammer.h"
 #include "pedal.h"
 #include "string.h"
+#include "upsampler.h"
 #include <vector>
 #include <array>
 
-#include <pico/platform.h>
+#include "platform.h"
 
 namespace physical_modeling_piano
 {
@@ -20,6 +21,8 @@ namespace physical_modeling_piano
 
     class Note
     {
+        friend class VoiceBank;
+
     public:
         using SampleT = String::SampleT;
 
@@ -28,19 +31,43 @@ namespace physical_modeling_piano
             String::State strings[3];
             Hammer::State hammer;
 
-            std::vector<uint32_t> allocatorBuffer_;
+            // 遅延線のメモリ (Note::computeAllocatorSize() バイト)
+            // 持ち主は呼び出し側で、keyOn() の前に入れておく
+            uint32_t *delayMemory{};
 
         public:
-            void initialize(size_t allocatorSize);
-
             bool keyOn{};
             bool sostenuto{};
             bool idle{};
+
+            // 直前の update() の出力の振幅
+            // 固定小数点では減衰しきっても直流分が残るので、前回の最後の出力からの差で測る
+            uint32_t level{};
+            SampleT lastOutput{};
+            uint32_t silentSamples{}; // level が voiceSilenceLevel 未満のまま続いている長さ
+
+            uint8_t detailLevel{};
+            uint8_t nStrings{}; // 処理している弦の数 (ユニゾンをまとめると 1)
+
+            HalfbandUpsampler::State upsampler; // 半分のレートで回す音の出力の補間
         };
 
+        // 詳細度 (0 が最高)
+        // 1: 分数遅延フィルタを 1 次にする
+        // 2: さらに分散フィルタを 1 段にする
+        // 3: さらにユニゾンの弦を 1 本にまとめる (次の keyOn まで戻さない)
+        static constexpr int N_DETAIL_LEVELS = 4;
+        static constexpr int DETAIL_COLLAPSE_UNISON = 3;
+
     public:
         void initialize(float freq, const SystemParameters &sysParams);
+        // initialize() で決めたものの書き出し / 読み込み (coefficients.h)
+        // 読み込めば initialize() の代わりになる
+        template <class IO>
+        void transferCoefficients(IO &io);
         size_t computeAllocatorSize() const;
+        // 発音中の state の遅延線を dst (computeAllocatorSize() バイト) に写して付け替える
+        void moveDelayMemory(State &state, uint32_t *dst) const;
 
         void __time_critical_func(keyOn)(State &state, Hammer::VelocityT v) const;
         void __time_critical_func(keyOff)(State &state) const;
@@ -51,14 +78,90 @@ namespace physical_modeling_piano
                                           const SystemParameters &sysParams,
                                           const PedalState &pedal) const;
 
+        // ペダルとキーの状態を反映して、発音を続けるなら true
+        // 続けないときは idle にする
+        bool __time_critical_func(updateSustain)(State &state,
+                                                 const PedalState &pedal) const;
+
+        // 詳細度を切り替える (範囲外は丸める)
+        // allowMerge が false ならユニゾンの弦はまとめず、その手前で止める
+        // 弦をまとめたら true
+        bool __time_critical_func(setDetailLevel)(State &state, int level, bool allowMerge = true) const;
+
+        // 1 ブロックの処理量の目安 (相対値)
+        // 処理している弦の数と詳細度、ハンマーが弦に触れているかで決まる
+        uint32_t __time_critical_func(estimateCost)(const State &state) const;
+
+        // 弦を回すレートの間引き率 (1 か 2)
+        int getDecimation() const { return decimation_; }
+        // 弦をまとめて処理する長さ (0 ならサンプル単位)
+        size_t getBlockSize() const { return blockSize_; }
+
+        int getStringCount() const { return nStrings_; }
+        const String &getString(int i) const { return strings_[i]; }
+
+        // 直前の update() の振幅が voiceQuietLevel 未満か
+        bool isQuiet(const State &state) const { return state.level < quietLevel_; }
+
+        // 出力の振幅を記録して、十分長く無音なら idle にする
+        void __time_critical_func(updateSilence)(State &state,
+                                                 uint32_t level,
+                                                 uint32_t nSamples) const;
+
+        // 弦の遅延線の指数を合わせる (USE_COMPACT_DELAY のときだけ仕事がある)
+        void __time_critical_func(updateDelayScale)(State &state, uint32_t nSamples) const;
+
+    protected:
+        const FixedPoint<int32_t, 8> &getInvNStrings(const State &state) const
+        {
+            return state.nStrings < nStrings_ ? collapsedInvNStrings_ : _nStrings_;
+        }
+        const FixedPoint<int32_t, 25> &getBridgeLoadRatio(const State &state) const
+        {
+            return state.nStrings < nStrings_ ? collapsedLoadRatio_ : bridgeLoadRatio_;
+        }
+
+        void __time_critical_func(updateSamples)(SampleT *sample,
+                                                 uint32_t nSamples,
+                                                 State &state,
+                                                 const SystemParameters &sysParams) const;
+        void __time_critical_func(updateBlocks)(SampleT *sample,
+                                                uint32_t nSamples,
+                                                State &state,
+                                                const SystemParameters &sysParams) const;
+        void __time_critical_func(updateHalfRate)(SampleT *sample,
+                                                  uint32_t nSamples,
+                                                  State &state,
+                                                  const SystemParameters &sysParams) const;
+
+    public:
+        // 遅延がこれより短い弦がある音はサンプル単位で処理する
+        // ブロックが短いと速くならない (pm_piano_bench_kernels の Note::updateBlocks)
+        // 27 以上 (A0-B1) は 1.1-1.3 倍速く、20-26 は同じくらい、16-19 は 5-10% 遅かった
+        static constexpr size_t MIN_BLOCK_DELAY = 27;
+
     private:
         int nStrings_{};
         FixedPoint<int32_t, 8> _nStrings_;
         FixedPoint<int32_t, 25> bridgeLoadRatio_;
+        // ユニゾンをまとめたときは 1 本の弦を nStrings_ 本分として使う
+        FixedPoint<int32_t, 8> collapsedInvNStrings_;
+        FixedPoint<int32_t, 25> collapsedLoadRatio_;
 
         String strings_[3];
         Hammer hammer_;
         Hammer::UpdateFunc hammerUpdateFunc_;
+        int hammerSteps_ = 1; // hammerUpdateFunc_ の 1 サンプルあたりの分割数
+
+        size_t blockSize_{}; // 0 ならサンプル単位で処理する
+
+        // sysParams.halfRateFrequency より低い音は弦とハンマーを半分のレートで回す
+        int decimation_ = 1;
+        HalfbandUpsampler upsampler_;
+
+        uint32_t silenceLevel_{};   // getAbsMask(voiceSilenceLevel)
+        uint32_t silenceSamples_{}; // voiceSilenceTime
+        uint32_t quietLevel_{};     // getAbsMask(voiceQuietLevel)
     };
 
 } // namespace physical_modeling_piano
@@ -0,0 +1,158 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 16:33:20
+ */
+
+#include "note_cache.h"
+#include <stdio.h>
+#include <string.h>
+
+#if PICO_PIANO_HOST
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <hardware/flash.h>
+#include <hardware/regs/addressmap.h>
+#include <hardware/sync.h>
+
+// BTstack がボンディングの情報を置く末尾 2 セクタ (PICO_FLASH_BANK_TOTAL_SIZE) の手前
+#ifndef NOTE_CACHE_FLASH_OFFSET
+#define NOTE_CACHE_FLASH_OFFSET \
+    (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE * 2 - physical_modeling_piano::NoteCache::FLASH_BYTES)
+#endif
+
+extern char __flash_binary_end;
+#endif
+
+namespace physical_modeling_piano
+{
+#if PICO_PIANO_HOST
+
+    NoteCache::NoteCache(const char *path) : path_(path)
+    {
+        map();
+    }
+
+    NoteCache::~NoteCache()
+    {
+        unmap();
+    }
+
+    void
+    NoteCache::map()
+    {
+        const int fd = open(path_.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size >= off_t(sizeof(uint32_t)))
+        {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                map_ = p;
+                mapBytes_ = st.st_size;
+                words_ = static_cast<const uint32_t *>(p);
+                nWords_ = mapBytes_ / sizeof(uint32_t);
+            }
+        }
+        close(fd);
+    }
+
+    void
+    NoteCache::unmap()
+    {
+        if (map_)
+        {
+            munmap(map_, mapBytes_);
+        }
+        map_ = nullptr;
+        mapBytes_ = 0;
+        words_ = nullptr;
+        nWords_ = 0;
+    }
+
+    bool
+    NoteCache::store(const uint32_t *words, size_t nWords)
+    {
+        // 書きかけのものを読まないように、別名で書いてから置き換える
+        const std::string tmp = path_ + ".tmp";
+        FILE *fp = fopen(tmp.c_str(), "wb");
+        if (!fp)
+        {
+            printf("%s: cannot open.\n", tmp.c_str());
+            return false;
+        }
+        const bool written = fwrite(words, sizeof(uint32_t), nWords, fp) == nWords;
+        if (fclose(fp) != 0 || !written || rename(tmp.c_str(), path_.c_str()) != 0)
+        {
+            printf("%s: write failed.\n", path_.c_str());
+            remove(tmp.c_str());
+            return false;
+        }
+
+        unmap();
+        map();
+        return words_ != nullptr;
+    }
+
+#else
+
+    NoteCache::NoteCache()
+    {
+        // プログラムと重なるなら使わない
+        if (XIP_BASE + NOTE_CACHE_FLASH_OFFSET < reinterpret_cast<uintptr_t>(&__flash_binary_end))
+        {
+            printf("note cache: no room in flash\n");
+            return;
+        }
+        words_ = reinterpret_cast<const uint32_t *>(XIP_BASE + NOTE_CACHE_FLASH_OFFSET);
+        nWords_ = FLASH_BYTES / sizeof(uint32_t);
+    }
+
+    NoteCache::~NoteCache() {}
+
+    bool
+    NoteCache::store(const uint32_t *words, size_t nWords)
+    {
+        const size_t bytes = nWords * sizeof(uint32_t);
+        if (!words_ || bytes > FLASH_BYTES)
+        {
+            printf("note cache: %zd bytes do not fit\n", bytes);
+            return false;
+        }
+
+        // まだ実機で動かしたことがない (ホストのファイル版と note_table::read() だけ確かめた)
+        // 消すのはセクタ、書くのはページ単位
+        // 消している間は割り込みを止めるので、1 セクタずつにして音の DMA を長く止めない
+        const size_t eraseBytes = (bytes + FLASH_SECTOR_SIZE - 1) & ~size_t(FLASH_SECTOR_SIZE - 1);
+        for (size_t ofs = 0; ofs < eraseBytes; ofs += FLASH_SECTOR_SIZE)
+        {
+            const uint32_t irq = save_and_disable_interrupts();
+            flash_range_erase(NOTE_CACHE_FLASH_OFFSET + ofs, FLASH_SECTOR_SIZE);
+            restore_interrupts(irq);
+        }
+
+        const auto *src = reinterpret_cast<const uint8_t *>(words);
+        for (size_t ofs = 0; ofs < bytes; ofs += FLASH_PAGE_SIZE)
+        {
+            // 最後の半端なページは消した状態の 0xff で埋める
+            uint8_t page[FLASH_PAGE_SIZE];
+            const size_t n = bytes - ofs < FLASH_PAGE_SIZE ? bytes - ofs : FLASH_PAGE_SIZE;
+            memset(page, 0xff, sizeof(page));
+            memcpy(page, src + ofs, n);
+
+            const uint32_t irq = save_and_disable_interrupts();
+            flash_range_program(NOTE_CACHE_FLASH_OFFSET + ofs, page, FLASH_PAGE_SIZE);
+            restore_interrupts(irq);
+        }
+        return memcmp(words_, words, bytes) == 0;
+    }
+
+#endif
+
+} // namespace physical_modeling_piano
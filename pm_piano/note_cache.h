@@ -0,0 +1,64 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 16:31:47
+ */
+#ifndef _C5F0E3A7_92D4_4B61_8E2F_6A1D07B4C938
+#define _C5F0E3A7_92D4_4B61_8E2F_6A1D07B4C938
+
+#include <stddef.h>
+#include <stdint.h>
+#if PICO_PIANO_HOST
+#include <string>
+#endif
+
+#include "platform.h"
+
+namespace physical_modeling_piano
+{
+    // 鍵ごとの係数の表 (note_table) を残しておく場所
+    // 起動時に Piano::setNoteTable() に渡し、読めなかったら計算したものを store() しておく
+    // 2 回目からは Note::initialize() を呼ばないので、起動の時間がパラメータによらなくなる
+    //
+    // ホスト: ファイルを mmap して読む (store() は別名で書いてから置き換える)
+    // ファーム: flash の末尾 (BTstack の領域の手前) に取った領域を XIP のまま読む
+    class NoteCache
+    {
+    public:
+#if PICO_PIANO_HOST
+        explicit NoteCache(const char *path);
+#else
+        // 74KB の表 (pm_piano_coefgen) が入る大きさ
+        static constexpr size_t FLASH_BYTES = 80 * 1024;
+
+        // store() は flash を消して書くので、もう一方のコアを動かす前に使う
+        NoteCache();
+#endif
+        ~NoteCache();
+
+        NoteCache(const NoteCache &) = delete;
+        NoteCache &operator=(const NoteCache &) = delete;
+
+        // 残っている表 (なければ nullptr、中身は note_table::read() で確かめる)
+        const uint32_t *getWords() const { return words_; }
+        size_t getWordCount() const { return nWords_; }
+
+        // 表を書き換える (getWords() は書いたものを指すようになる)
+        bool store(const uint32_t *words, size_t nWords);
+
+    private:
+        const uint32_t *words_{};
+        size_t nWords_{};
+
+#if PICO_PIANO_HOST
+        std::string path_;
+        void *map_{};
+        size_t mapBytes_{};
+
+        void map();
+        void unmap();
+#endif
+    };
+
+} // namespace physical_modeling_piano
+
+#endif /* _C5F0E3A7_92D4_4B61_8E2F_6A1D07B4C938 */
@@ -7,8 +7,6 @@
 #include <algorithm>
 #include <assert.h>
 
-#include "hardware/gpio.h"
-
 namespace physical_modeling_piano
 {
 
@@ -24,15 +22,53 @@ namespace physical_modeling_piano
     void
     NoteManager::initialize(const SystemParameters &sysParams, size_t nPoly)
     {
-        size_t allocatorSize = 0;
+        const VoiceRegister all{NOTE_END, nPoly};
+        initialize(sysParams, &all, 1);
+    }
 
-        for (int i = 0; i < N_NOTES; ++i)
+    void
+    NoteManager::initialize(const SystemParameters &sysParams, const VoiceRegister *registers, size_t nRegisters)
+    {
+        assert(nRegisters > 0 && registers[nRegisters - 1].noteEnd >= NOTE_END);
+
+        noteTableLoaded_ = noteTable_ &&
+                           note_table::read(notes_.data(), N_NOTES, noteTable_, noteTableWords_, &sysParams);
+#if USE_PREBUILT_NOTE_TABLE
+        if (!noteTableLoaded_)
+        {
+            // 係数の計算はリンクしていないので、パラメータが違ってもビルドのときの表を使う
+            printf("note table: using the prebuilt parameters\n");
+            // 読めなければ音を作れないので、リリースビルドでも止める
+            if (!note_table::read(notes_.data(), N_NOTES, prebuiltNoteTable, prebuiltNoteTableSize, nullptr))
+            {
+                panic("note table: the prebuilt table does not match this build");
+            }
+        }
+#else
+        if (!noteTableLoaded_)
         {
-            float f = 440 * powf(2.0f, (i + NOTE_BEGIN - 69) / 12.0f);
-            notes_[i].initialize(f, sysParams);
+            for (int i = 0; i < N_NOTES; ++i)
+            {
+                float f = 440 * powf(2.0f, (i + NOTE_BEGIN - 69) / 12.0f);
+                notes_[i].initialize(f, sysParams);
+            }
+        }
+#endif
 
-            allocatorSize =
-                std::max(allocatorSize, notes_[i].computeAllocatorSize());
+        // 音域ごとに一番大きい音の分
+        std::vector<size_t> unitSize(nRegisters);
+        size_t allocatorSize = 0;
+        size_t reg = 0;
+        for (int i = 0; i < N_NOTES; ++i)
+        {
+            while (i + NOTE_BEGIN >= registers[reg].noteEnd)
+            {
+                ++reg;
+            }
+            const size_t size = notes_[i].computeAllocatorSize();
+            delayMemorySize_[i] = size;
+            unitSize[reg] = std::max(unitSize[reg], size);
+            allocatorSize = std::max(allocatorSize, size);
         }
 
         printf("note %zd bytes, notes %zd, st %zd, allocator %zd\n",
@@ -41,25 +77,59 @@ namespace physical_modeling_piano
                sizeof(Note::State),
                allocatorSize);
 
+        size_t nPoly = 0;
+        delayPools_.resize(nRegisters);
+        delayPoolOrder_.resize(nRegisters);
+        for (size_t i = 0; i < nRegisters; ++i)
+        {
+            delayPools_[i].initialize(unitSize[i], registers[i].nVoices);
+            delayPoolOrder_[i] = i;
+            nPoly += registers[i].nVoices;
+            printf("voices below %d: %zd x %zd bytes\n",
+                   registers[i].noteEnd, registers[i].nVoices, delayPools_[i].getUnitSize());
+        }
+        std::stable_sort(delayPoolOrder_.begin(), delayPoolOrder_.end(),
+                         [&](int a, int b) { return delayPools_[a].getUnitSize() < delayPools_[b].getUnitSize(); });
+        assert(nPoly > 0);
+        // 入る組がない音は鳴らさない
+        for (int i = 0; i < N_NOTES; ++i)
+        {
+            if (std::none_of(delayPools_.begin(), delayPools_.end(), [&](const PoolAllocator &p)
+                             { return p.getUnitCount() && p.getUnitSize() >= delayMemorySize_[i]; }))
+            {
+                printf("note %d: no voice register fits %d bytes\n", i + NOTE_BEGIN, delayMemorySize_[i]);
+            }
+        }
+
         std::fill(noteNode_.begin(), noteNode_.end(), -1);
 
         nodes_.resize(nPoly);
         for (auto &&n : nodes_)
         {
-            n.state_.initialize(allocatorSize);
             freeNode(&n);
         }
 
-        workNodes_.resize(nPoly);
+        activeNodes_.reserve(nPoly);
+        polyphonyLimit_ = nPoly;
+
+        fadeMemoryWords_ = (allocatorSize + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+        fadeMemory_.resize(fadeMemoryWords_ * N_FADE_NODES);
+        fadeNodes_.resize(N_FADE_NODES);
+        fadeTail_.assign(FADE_TAIL_SAMPLES, 0);
+        fadeTailSide_.assign(FADE_TAIL_SAMPLES, 0);
+        fadeTailLength_ = 0;
 
-        critical_section_init(&cs_);
+        workCounter_.initialize();
     }
 
     void
     NoteManager::update(Note::SampleT *samples,
                         size_t nSamples,
                         const SystemParameters &sysParams,
-                        const PedalState &pedal)
+                        const PedalState &pedal,
+                        const SideTask *sideTasks,
+                        int nSideTasks,
+                        Note::SampleT *sideSamples)
     {
 #if 0
         auto *node = active_;
@@ -87,47 +157,67 @@ namespace physical_modeling_piano
         }
 #else
         // 前回スキップしたのがまだ終わってないことがある
-        while (workerActive_)
+        while (workerActive_.get())
         {
             __wfe();
         }
 
-        workNodes_.clear();
-        auto *node = active_;
-        while (node)
+        currentSysParams_ = &sysParams;
+        currentPedalState_ = &pedal;
+
+        // 上限を下げられたら、奪うときと同じ基準で選んで減らしていく
+        if (activeNodes_.size() > polyphonyLimit_)
         {
-            workNodes_.push_back(node);
-            node = node->next_;
+            stealNode(selectStealNode());
+        }
+
+        // 弦をまとめるのは重いので 1 ブロックに 1 ボイスまで (残りは次のブロック以降)
+        bool allowMerge = true;
+        for (auto *node : activeNodes_)
+        {
+            if (updateDetailLevel(node, allowMerge))
+            {
+                allowMerge = false;
+            }
+            node->cost_ = notes_[node->noteIndex_].estimateCost(node->state_);
         }
+        sideTasks_ = sideTasks;
+        nSideTasks_ = nSideTasks;
+        planWork();
+        workCount_ = activeNodes_.size();
 
         workerSamples_.resize(nSamples);
         std::fill(workerSamples_.begin(), workerSamples_.end(), 0);
 
-        currentSysParams_ = &sysParams;
-        currentPedalState_ = &pedal;
-
-        workIdx_ = 0;
-        if (!workNodes_.empty())
+        sideSamples_ = keyPanning_ > 0 ? sideSamples : nullptr;
+        if (sideSamples_)
         {
-            workerActive_ = true;
-            __sev();
+            workerSide_.resize(nSamples);
+            std::fill(workerSide_.begin(), workerSide_.end(), 0);
+            for (auto &b : voiceBuffers_)
+            {
+                b.resize(nSamples);
+            }
         }
 
-        int nn = process(samples, nSamples);
-        //    printf("mn = %d\n", nn);
-        (void)nn;
-
-        if (nn < workNodes_.size())
+#if PICO_PIANO_HOST
+        if (useVoiceBank_)
         {
-            while (workerActive_)
+            for (int i = 0; i < nSideTasks; ++i)
             {
-                __wfe();
-                //            tight_loop_contents();
+                sideTasks[i].func(sideTasks[i].context);
+                workBalance_.done[0] += sideTasks[i].cost;
             }
+            processVoiceBank(samples, nSamples);
+        }
+        else
+#endif
+        {
+            dispatch(samples, nSamples, workCount_ + nSideTasks);
         }
 
         int n = 0;
-        node = active_;
+        auto *node = active_;
         while (node)
         {
             if (node->state_.idle)
@@ -148,6 +238,16 @@ namespace physical_modeling_piano
         }
         currentNoteCount_ = n;
 
+        processFades(samples, sideSamples_, nSamples);
+
+        if (sideSamples_)
+        {
+            for (size_t i = 0; i < nSamples; ++i)
+            {
+                add(sideSamples_[i], sideSamples_[i], workerSide_[i]);
+            }
+        }
+
         const auto *ws = workerSamples_.data();
         do
         {
@@ -160,40 +260,172 @@ namespace physical_modeling_piano
     }
 
 #if 1
+    void
+    NoteManager::planWork()
+    {
+        // 重い順に並べておけば、空いたコアが先頭から取っていくだけで
+        // LPT (longest processing time first) の割り当てになる
+        // ノードの数は同時発音数までなので挿入ソートで十分
+        auto &nodes = activeNodes_;
+        for (size_t i = 1; i < nodes.size(); ++i)
+        {
+            auto *node = nodes[i];
+            size_t j = i;
+            for (; j > 0 && nodes[j - 1]->cost_ < node->cost_; --j)
+            {
+                nodes[j] = nodes[j - 1];
+                nodes[j]->activeIndex_ = j;
+            }
+            nodes[j] = node;
+            node->activeIndex_ = j;
+        }
+
+        // 見込みどおりに処理できたときの振り分け
+        auto &wb = workBalance_;
+        wb.planned[0] = wb.planned[1] = 0;
+        wb.done[0] = wb.done[1] = 0;
+        for (auto *node : nodes)
+        {
+            wb.planned[wb.planned[1] < wb.planned[0]] += node->cost_;
+        }
+        // 軽いので最後に取らせる
+        planTasks();
+    }
+
+    void
+    NoteManager::planTasks()
+    {
+        auto &wb = workBalance_;
+        for (int i = 0; i < nSideTasks_; ++i)
+        {
+            wb.planned[wb.planned[1] < wb.planned[0]] += sideTasks_[i].cost;
+        }
+    }
+
+    void
+    NoteManager::runTasks(const SideTask *tasks, int nTasks)
+    {
+        // update() で何も取らなかった worker がまだ抜けていないことがある
+        while (workerActive_.get())
+        {
+            __wfe();
+        }
+
+        workCount_ = 0;
+        sideTasks_ = tasks;
+        nSideTasks_ = nTasks;
+        planTasks();
+        dispatch(nullptr, 0, nTasks);
+    }
+
+    void
+    NoteManager::dispatch(Note::SampleT *samples, size_t nSamples, int nItems)
+    {
+        // 数え直してからフラグを立てる (worker が前のブロックの番号で取らないように)
+        workCounter_.reset();
+        if (workerAttached_.get() && nItems)
+        {
+            workerActive_.set(true);
+            __sev();
+        }
+
+        int nn = process(samples, nSamples, 0);
+        //    printf("mn = %d\n", nn);
+
+        if (nn < nItems)
+        {
+            while (workerActive_.get())
+            {
+                __wfe();
+                //            tight_loop_contents();
+            }
+        }
+    }
+
     int
-    NoteManager::process(Note::SampleT *samples, size_t nSamples)
+    NoteManager::process(Note::SampleT *samples, size_t nSamples, int core)
     {
         int ct = 0;
-        auto n = workNodes_.size();
+        uint32_t cost = 0;
+        const int n = workCount_;
         while (1)
         {
-            critical_section_enter_blocking(&cs_);
-            auto idx = workIdx_;
-            ++workIdx_;
-            critical_section_exit(&cs_);
-
+            auto idx = workCounter_.claim();
             if (idx >= n)
             {
+                if (idx - n < nSideTasks_)
+                {
+                    const auto &task = sideTasks_[idx - n];
+                    task.func(task.context);
+                    cost += task.cost;
+                    ++ct;
+                    continue;
+                }
+                // 何も取らなかった worker は待ってもらえないので、ここにも書かない
+                if (ct)
+                {
+                    workBalance_.done[core] += cost;
+                }
                 return ct;
             }
 
-            auto *node = workNodes_[idx];
+            auto *node = activeNodes_[idx];
             auto noteIdx = node->noteIndex_;
-            notes_[noteIdx].update(samples,
-                                   nSamples,
-                                   node->state_,
-                                   *currentSysParams_,
-                                   *currentPedalState_);
+            auto *side = core ? workerSide_.data() : sideSamples_;
+            if (sideSamples_)
+            {
+                // 1 つずつ受けてから左右差と一緒に足す
+                auto *voice = voiceBuffers_[core].data();
+                std::fill(voice, voice + nSamples, 0);
+                notes_[noteIdx].update(voice,
+                                       nSamples,
+                                       node->state_,
+                                       *currentSysParams_,
+                                       *currentPedalState_);
+                mixPanned(samples, side, voice, nSamples, noteIdx);
+            }
+            else
+            {
+                notes_[noteIdx].update(samples,
+                                       nSamples,
+                                       node->state_,
+                                       *currentSysParams_,
+                                       *currentPedalState_);
+            }
+            cost += node->cost_;
             ++ct;
         }
     }
 
+#if PICO_PIANO_HOST
+    void
+    NoteManager::processVoiceBank(Note::SampleT *samples, size_t nSamples)
+    {
+        voices_.clear();
+        for (auto *node : activeNodes_)
+        {
+            const auto &note = notes_[node->noteIndex_];
+            if (note.getDecimation() > 1)
+            {
+                // 半分のレートの音はレーンにそろわないので 1 つずつ処理する
+                note.update(samples, nSamples, node->state_, *currentSysParams_, *currentPedalState_);
+            }
+            else if (note.updateSustain(node->state_, *currentPedalState_))
+            {
+                voices_.push_back({&note, &node->state_});
+            }
+        }
+        voiceBank_.update(samples, nSamples, voices_.data(), voices_.size(), *currentSysParams_);
+    }
+#endif
+
     void
     NoteManager::worker()
     {
+        workerAttached_.set(true);
         while (1)
         {
-            while (!workerActive_)
+            while (!workerActive_.get())
             {
                 __wfe();
                 //                tight_loop_contents();
@@ -201,11 +433,11 @@ namespace physical_modeling_piano
             //            gpio_put(6, 1);
             auto irq = save_and_disable_interrupts();
 
-            int nn = process(workerSamples_.data(), workerSamples_.size());
+            int nn = process(workerSamples_.data(), workerSamples_.size(), 1);
             //        printf("wn %d\n", nn);
             (void)nn;
 
-            workerActive_ = false;
+            workerActive_.set(false);
             __sev();
             //            gpio_put(6, 0);
             restore_interrupts(irq);
@@ -231,15 +463,26 @@ namespace physical_modeling_piano
         }
         else
         {
-            node = allocateNode();
+            node = activeNodes_.size() < polyphonyLimit_ ? allocateNode() : nullptr;
             if (!node)
             {
-                node = popFrontActive();
-
-                noteNode_[node->noteIndex_] = -1;
-                keyOnStateForDisp_[node->noteIndex_] = false;
+                // この音の遅延線が入るボイスを奪えば、メモリも一緒に空く
+                auto *steal = selectStealNode(delayMemorySize_[note]);
+                stealNode(steal ? steal : selectStealNode());
+                node = allocateNode();
             }
             assert(node);
+            while (!allocateDelayMemory(node, note))
+            {
+                // 音域の組もそれより大きい組も使い切っている
+                auto *steal = selectStealNode(delayMemorySize_[note]);
+                if (!steal)
+                {
+                    freeNode(node);
+                    return;
+                }
+                stealNode(steal);
+            }
 
             node->noteIndex_ = note;
             noteNode_[note] = getNodeIndex(node);
@@ -283,6 +526,248 @@ namespace physical_modeling_piano
         keyOnStateForDisp_[note] = false;
     }
 
+    void
+    NoteManager::setPolyphonyLimit(size_t n)
+    {
+        polyphonyLimit_ = std::max<size_t>(1, std::min(n, nodes_.size()));
+    }
+
+    void
+    NoteManager::stealNode(Node *node)
+    {
+        removeActive(node);
+
+        noteNode_[node->noteIndex_] = -1;
+        keyOnStateForDisp_[node->noteIndex_] = false;
+
+        startFade(node);
+        freeNode(node);
+    }
+
+    bool
+    NoteManager::updateDetailLevel(Node *node, bool allowMerge) const
+    {
+        const auto &note = notes_[node->noteIndex_];
+        auto &state = node->state_;
+
+        // 鍵を押さえていて打鍵直後か振幅の大きいボイスは最後まで落とさない
+        int demote = 0;
+        if (!state.keyOn)
+        {
+            ++demote;
+        }
+        if (state.hammer.idle && note.isQuiet(state))
+        {
+            ++demote;
+        }
+        return note.setDetailLevel(state, detailBias_ - 2 + demote, allowMerge);
+    }
+
+    NoteManager::Node *
+    NoteManager::selectStealNode(size_t minMemory) const
+    {
+        // 小さいほど奪ってもわかりにくい
+        // 次の update() で止まる音を最優先にする
+        // 低音ほど和声の支えで目立つので重くし、鍵を押さえている音はさらに重くする
+        // 打鍵直後はまだ振幅が出ていないので奪わない
+        const bool damper = currentPedalState_ && currentPedalState_->damper;
+        auto score = [damper](const Node &n) -> uint64_t
+        {
+            const auto &st = n.state_;
+            if (!st.keyOn && !st.sostenuto && !damper)
+            {
+                return 0;
+            }
+            if (!st.hammer.idle)
+            {
+                return UINT64_MAX;
+            }
+            uint64_t s = uint64_t(st.level) * (2 * N_NOTES - n.noteIndex_);
+            if (st.keyOn || st.sostenuto)
+            {
+                s <<= 2;
+            }
+            return s;
+        };
+
+        // 同点なら前にあるもの (最近離した鍵か古いもの) を選ぶ
+        Node *r = nullptr;
+        uint64_t best = 0;
+        for (auto *node = active_; node; node = node->next_)
+        {
+            if (getDelayMemoryUnitSize(*node) < minMemory)
+            {
+                continue;
+            }
+            auto s = score(*node);
+            if (!r || s < best)
+            {
+                best = s;
+                r = node;
+            }
+        }
+        return r;
+    }
+
+    void
+    NoteManager::startFade(Node *node)
+    {
+        // 空いている枠か、フェードの終わりに一番近いものを使う
+        Node *dst = &fadeNodes_[0];
+        for (auto &n : fadeNodes_)
+        {
+            if (n.fadeSamples_ < dst->fadeSamples_)
+            {
+                dst = &n;
+            }
+        }
+        if (dst->fadeSamples_ && currentSysParams_)
+        {
+            // 空いている枠がないので、残りを縮めて先に鳴らし切る (途中で切ると音が飛ぶ)
+            const uint32_t length = std::min(dst->fadeSamples_, FADE_TAIL_SAMPLES);
+            const uint32_t startGain = dst->fadeSamples_ * 256 / FADE_SAMPLES;
+            renderFade(*dst, length);
+            uint32_t remaining = length;
+            mixFadeRamp(fadeTail_.data(), fadeTailSide_.data(), fadeBuffer_.data(), length,
+                        dst->noteIndex_, remaining, length, startGain);
+            fadeTailLength_ = std::max(fadeTailLength_, length);
+        }
+
+        // 状態を入れ替え、遅延線はフェード用のメモリに写して付け替える
+        // node には空いた状態と組のメモリが残り、メモリは freeNode() で組に返る
+        const auto i = dst - fadeNodes_.data();
+        auto *delayMemory = node->state_.delayMemory;
+        std::swap(dst->state_, node->state_);
+        node->state_.delayMemory = delayMemory;
+        dst->noteIndex_ = node->noteIndex_;
+        notes_[dst->noteIndex_].moveDelayMemory(dst->state_, &fadeMemory_[i * fadeMemoryWords_]);
+        dst->fadeSamples_ = dst->state_.idle ? 0 : FADE_SAMPLES;
+    }
+
+    void
+    NoteManager::renderFade(Node &n, size_t nSamples)
+    {
+        fadeBuffer_.resize(nSamples);
+        std::fill(fadeBuffer_.begin(), fadeBuffer_.end(), 0);
+
+        const auto &note = notes_[n.noteIndex_];
+#if PICO_PIANO_HOST
+        if (useVoiceBank_)
+        {
+            // 遅延線の状態の持ち方が Note::update のブロック処理と違うので、
+            // 発音中と同じ経路で続ける
+            if (note.updateSustain(n.state_, *currentPedalState_))
+            {
+                VoiceBank::Voice v{&note, &n.state_};
+                voiceBank_.update(fadeBuffer_.data(), nSamples, &v, 1, *currentSysParams_);
+            }
+        }
+        else
+#endif
+        {
+            note.update(fadeBuffer_.data(),
+                        nSamples,
+                        n.state_,
+                        *currentSysParams_,
+                        *currentPedalState_);
+        }
+    }
+
+    void
+    NoteManager::mixFadeRamp(Note::SampleT *samples, Note::SampleT *side,
+                             const Note::SampleT *voice, size_t nSamples, int noteIndex,
+                             uint32_t &remaining, uint32_t length, uint32_t startGain) const
+    {
+        // 1/256 刻みの直線で下げる (S8 との積が溢れないように先に 17bit に落とす)
+        for (size_t i = 0; i < nSamples && remaining; ++i)
+        {
+            --remaining;
+            FixedPoint<int32_t, 8> gain;
+            gain.set(remaining * startGain / length);
+            FixedPoint<int32_t, 17> v = voice[i];
+            Note::SampleT o;
+            mul(o, v, gain);
+            add(samples[i], samples[i], o);
+
+            if (side)
+            {
+                FixedPoint<int32_t, 17> ov = o;
+                mul(o, ov, pan_[noteIndex]);
+                add(side[i], side[i], o);
+            }
+        }
+    }
+
+    void
+    NoteManager::processFades(Note::SampleT *samples, Note::SampleT *side, size_t nSamples)
+    {
+        if (fadeTailLength_)
+        {
+            const uint32_t n = std::min<uint32_t>(fadeTailLength_, nSamples);
+            for (uint32_t i = 0; i < n; ++i)
+            {
+                add(samples[i], samples[i], fadeTail_[i]);
+                if (side)
+                {
+                    add(side[i], side[i], fadeTailSide_[i]);
+                }
+            }
+            // 残りを先頭に詰める
+            std::copy(fadeTail_.begin() + n, fadeTail_.begin() + fadeTailLength_, fadeTail_.begin());
+            std::copy(fadeTailSide_.begin() + n, fadeTailSide_.begin() + fadeTailLength_, fadeTailSide_.begin());
+            std::fill(fadeTail_.begin() + (fadeTailLength_ - n), fadeTail_.begin() + fadeTailLength_, 0);
+            std::fill(fadeTailSide_.begin() + (fadeTailLength_ - n), fadeTailSide_.begin() + fadeTailLength_, 0);
+            fadeTailLength_ -= n;
+        }
+
+        for (auto &n : fadeNodes_)
+        {
+            if (!n.fadeSamples_)
+            {
+                continue;
+            }
+
+            renderFade(n, nSamples);
+            mixFadeRamp(samples, side, fadeBuffer_.data(), nSamples, n.noteIndex_,
+                        n.fadeSamples_, FADE_SAMPLES, 256);
+
+            if (n.state_.idle)
+            {
+                n.fadeSamples_ = 0;
+            }
+        }
+    }
+
+    void
+    NoteManager::setKeyPanning(float amount)
+    {
+        keyPanning_ = std::max(0.0f, std::min(amount, 1.0f));
+
+        // 低音を左に、真ん中の鍵 (E4 と F4 の間) を中央にする
+        constexpr float center = (N_NOTES - 1) * 0.5f;
+        for (size_t i = 0; i < N_NOTES; ++i)
+        {
+            pan_[i] = keyPanning_ * (center - i) / center;
+        }
+    }
+
+    void
+    NoteManager::mixPanned(Note::SampleT *samples, Note::SampleT *side,
+                           const Note::SampleT *voice, size_t nSamples, int noteIndex) const
+    {
+        // フェードと同じく S8 との積が溢れないように先に 17bit に落とす
+        const auto &pan = pan_[noteIndex];
+        for (size_t i = 0; i < nSamples; ++i)
+        {
+            add(samples[i], samples[i], voice[i]);
+
+            FixedPoint<int32_t, 17> v = voice[i];
+            Note::SampleT o;
+            mul(o, v, pan);
+            add(side[i], side[i], o);
+        }
+    }
+
     int
     NoteManager::getNodeIndex(Node *node) const
     {
@@ -304,13 +789,48 @@ namespace physical_modeling_piano
     void
     NoteManager::freeNode(Node *node)
     {
+        if (node->delayPool_ >= 0)
+        {
+            delayPools_[node->delayPool_].free(node->state_.delayMemory);
+            node->delayPool_ = -1;
+            node->state_.delayMemory = nullptr;
+        }
         node->next_ = free_;
         free_ = node;
     }
 
+    bool
+    NoteManager::allocateDelayMemory(Node *node, int note)
+    {
+        // 入る組のうち一番小さいものから
+        const size_t size = delayMemorySize_[note];
+        for (auto i : delayPoolOrder_)
+        {
+            auto &pool = delayPools_[i];
+            if (pool.getUnitSize() < size)
+            {
+                continue;
+            }
+            if (auto *p = pool.allocate())
+            {
+                node->state_.delayMemory = static_cast<uint32_t *>(p);
+                node->delayPool_ = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t
+    NoteManager::getDelayMemoryUnitSize(const Node &node) const
+    {
+        return node.delayPool_ >= 0 ? delayPools_[node.delayPool_].getUnitSize() : 0;
+    }
+
     void
     NoteManager::pushActive(Node *node)
     {
+        addActiveNode(node);
         if (activeTail_)
         {
             assert(active_);
@@ -331,6 +851,7 @@ namespace physical_modeling_piano
     void
     NoteManager::pushFrontActive(Node *node)
     {
+        addActiveNode(node);
         if (active_)
         {
             assert(activeTail_);
@@ -356,6 +877,7 @@ namespace physical_modeling_piano
             return nullptr;
         }
         auto r = active_;
+        removeActiveNode(r);
         active_ = r->next_;
         if (active_)
         {
@@ -372,6 +894,7 @@ namespace physical_modeling_piano
     void
     NoteManager::removeActive(Node *node)
     {
+        removeActiveNode(node);
         if (node->prev_)
         {
             node->prev_->next_ = node->next_;
@@ -393,4 +916,26 @@ namespace physical_modeling_piano
         }
     }
 
+    void
+    NoteManager::addActiveNode(Node *node)
+    {
+        assert(node->activeIndex_ < 0);
+        assert(activeNodes_.size() < activeNodes_.capacity());
+        node->activeIndex_ = activeNodes_.size();
+        activeNodes_.push_back(node);
+    }
+
+    void
+    NoteManager::removeActiveNode(Node *node)
+    {
+        // 末尾のノードを空いた位置に移す
+        const int idx = node->activeIndex_;
+        assert(idx >= 0 && activeNodes_[idx] == node);
+        auto *last = activeNodes_.back();
+        activeNodes_[idx] = last;
+        last->activeIndex_ = idx;
+        activeNodes_.pop_back();
+        node->activeIndex_ = -1;
+    }
+
 } // namespace physical_modeling_piano
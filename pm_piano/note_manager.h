@@ -5,62 +5,190 @@
 #ifndef _103DE5E1_1134_152A_154E_889BBA4369C5
 #define _103DE5E1_1134_152A_154E_889BBA4369C5
 
+#include "allocator.h"
+#include "coefficients.h"
 #include "note.h"
 #include "pedal.h"
 #include "sys_params.h"
+#if PICO_PIANO_HOST
+#include "voice_bank.h"
+#endif
+#include <algorithm>
 #include <array>
 #include <vector>
 
-#include "pico/sync.h"
+#include "platform.h"
 
 namespace physical_modeling_piano
 {
     class NoteManager
     {
+    public:
+        // 扱う鍵の範囲 (MIDI ノート番号)
         static constexpr int NOTE_BEGIN = 21;
         static constexpr int NOTE_END = 109;
+
+    private:
         static constexpr size_t N_NOTES = NOTE_END - NOTE_BEGIN;
 
         std::array<Note, N_NOTES> notes_;
-        std::array<int8_t, N_NOTES> noteNode_;
+        // initialize() で notes_ を読む表 (note_table、なければ計算する)
+#if USE_PREBUILT_NOTE_TABLE
+        const uint32_t *noteTable_ = prebuiltNoteTable;
+        size_t noteTableWords_ = prebuiltNoteTableSize;
+#else
+        const uint32_t *noteTable_{};
+        size_t noteTableWords_{};
+#endif
+        bool noteTableLoaded_ = false; // initialize() で表から読めたか
+        std::array<int16_t, N_NOTES> noteNode_;
         std::array<bool, N_NOTES> keyOnStateForDisp_;
 
         struct Node
         {
             Note::State state_;
             int noteIndex_{};
+            int delayPool_ = -1; // state_.delayMemory を取った delayPools_ の番号
 
             Node *prev_{};
             Node *next_{};
+            int activeIndex_ = -1; // activeNodes_ での位置
+            uint32_t cost_{};      // このブロックの処理量の目安 (Note::estimateCost)
+
+            uint32_t fadeSamples_{}; // フェードアウト中の残りサンプル数
         };
 
+        // 奪ったボイスはこの長さでフェードアウトさせる
+        static constexpr uint32_t FADE_SAMPLES = 256;
+        // 同時にフェードアウトできるボイスの数
+        static constexpr size_t N_FADE_NODES = 2;
+        // 枠が埋まっていたら、終わりに一番近いフェードの残りをこの長さに縮めて先に計算し、枠を空ける
+        // (枠を増やすと 1 つにつき一番大きい音の遅延線の分の SRAM が要る)
+        static constexpr uint32_t FADE_TAIL_SAMPLES = 64;
+
         std::vector<Node> nodes_;
+        std::vector<Node> fadeNodes_;
+        std::vector<Note::SampleT> fadeBuffer_;
+        // 縮めたフェードの出力 (次の update() の先頭から足す)
+        std::vector<Note::SampleT> fadeTail_;
+        std::vector<Note::SampleT> fadeTailSide_; // その左右差
+        uint32_t fadeTailLength_{};
+
+        // 遅延線のメモリは音域ごとの大きさの組から keyOn で取る
+        std::vector<PoolAllocator> delayPools_; // 音域の順
+        std::vector<uint8_t> delayPoolOrder_;   // 1 つ分の大きさの小さい順
+        std::array<uint16_t, N_NOTES> delayMemorySize_{}; // Note::computeAllocatorSize()
+        // フェードアウトするボイスは遅延線をここに写して、奪った組はすぐに返す
+        std::vector<uint32_t> fadeMemory_;
+        size_t fadeMemoryWords_{};
         Node *free_{};   // 片方向
         Node *active_{}; // 双方向
         Node *activeTail_{};
 
         const SystemParameters *currentSysParams_{};
         const PedalState *currentPedalState_{};
-        std::vector<Node *> workNodes_;
+        // active_ につながっているノードを詰めて並べたもの
+        // 順番は active_ と関係なく、外すときは末尾と入れ替える
+        // update() のたびに処理量の多い順に並べ直す
+        // 容量は nPoly で確保済みなので発音中に確保は起きない
+        std::vector<Node *> activeNodes_;
 
-        mutable int workIdx_;
-        mutable bool workerActive_ = false;
+        // process() で取り合う activeNodes_ の番号
+        WorkCounter workCounter_;
+        int workCount_ = 0; // このブロックで処理するノードの数
+        // 立てる前に書いた仕事の中身と、下ろす前に worker が書いた出力が相手から見える
+        HandoffFlag workerActive_;
+        HandoffFlag workerAttached_; // worker() を回しているコアがあるか
 
         std::vector<Note::SampleT> workerSamples_{};
 
+        // 鍵盤の位置による左右の振り分け (左が +、S8)
+        std::array<FixedPoint<int32_t, 8>, N_NOTES> pan_{};
+        float keyPanning_ = 0;
+        Note::SampleT *sideSamples_{};         // このブロックの左右差の出力先 (なければ振り分けない)
+        std::vector<Note::SampleT> workerSide_{}; // worker 側の左右差
+        std::vector<Note::SampleT> voiceBuffers_[2]; // 振り分けるときにボイスを 1 つずつ受ける (コアごと)
+
         size_t currentNoteCount_{};
+        size_t polyphonyLimit_{};
+        int detailBias_ = 0;
+
+#if PICO_PIANO_HOST
+        VoiceBank voiceBank_;
+        std::vector<VoiceBank::Voice> voices_;
+        bool useVoiceBank_ = false;
+#endif
+
+    public:
+        // 2 つのコアへの仕事の振り分け (処理量は Note::estimateCost の単位)
+        // [0] が update() を呼んだコア、[1] が worker() を回しているコア
+        struct WorkBalance
+        {
+            uint32_t planned[2]; // 処理量の多い順に空いている方へ詰めたときの見込み
+            uint32_t done[2];    // 実際にそれぞれのコアが取った分
+
+            // 2 つの差を合計の 1/1024 単位で (0 なら均等)
+            static uint32_t imbalance(const uint32_t c[2])
+            {
+                const uint32_t total = c[0] + c[1];
+                return total ? (std::max(c[0], c[1]) - std::min(c[0], c[1])) * 1024 / total : 0;
+            }
+        };
+
+        // update() の間にどちらかのコアで 1 回だけ実行させる仕事
+        // ボイスと同じように取り合うので、ボイスの処理と並行して動く
+        struct SideTask
+        {
+            void (*func)(void *context);
+            void *context;
+            uint32_t cost; // Note::estimateCost と同じ単位
+        };
 
-        critical_section_t cs_;
+    private:
+        WorkBalance workBalance_{};
+        const SideTask *sideTasks_{}; // workCount_ 番目から後の仕事として取り合う
+        int nSideTasks_ = 0;
 
     public:
+        // 音域ごとの同時発音数
+        // 音域ごとにその中で一番大きい音の遅延線のメモリを nVoices 個用意する
+        // 足りなくなったらもっと大きい組から借り、それもなければ取れる大きさのボイスを奪う
+        // 高音は遅延線が短いので、同じメモリで低音よりずっと多く鳴らせる
+        struct VoiceRegister
+        {
+            int noteEnd;    // この音域の上端 + 1 (MIDI ノート番号、最後の音域は NOTE_END 以上にする)
+            size_t nVoices;
+        };
+
+        void initialize(const SystemParameters &sysParams, const VoiceRegister *registers, size_t nRegisters);
+        // 全部の鍵で 1 つの組 (nPoly 個) を使う
         void initialize(const SystemParameters &sysParams, size_t nPoly);
+        // 鍵ごとの係数を計算する代わりに読む表 (note_table::write() で作ったもの)
+        // initialize() の前に呼ぶ、パラメータが合わなければ計算する
+        void setNoteTable(const uint32_t *words, size_t nWords)
+        {
+            noteTable_ = words;
+            noteTableWords_ = nWords;
+        }
+        bool isNoteTableLoaded() const { return noteTableLoaded_; }
+        // initialize() で用意した係数を表にする (NoteCache に残して次の起動で読む)
+        void writeNoteTable(CoefficientWriter &w, const SystemParameters &sysParams)
+        {
+            note_table::write(w, notes_.data(), N_NOTES, sysParams);
+        }
         void __time_critical_func(keyOn)(int note, Hammer::VelocityT v);
         void __time_critical_func(keyOff)(int note);
 
         void __time_critical_func(update)(Note::SampleT *samples,
                                           size_t nSamples,
                                           const SystemParameters &sysParams,
-                                          const PedalState &pedal);
+                                          const PedalState &pedal,
+                                          const SideTask *sideTasks = nullptr,
+                                          int nSideTasks = 0,
+                                          Note::SampleT *sideSamples = nullptr);
+
+        // ボイスなしで sideTasks だけを 2 つのコアで分けて実行する (update() の後に呼ぶ)
+        void __time_critical_func(runTasks)(const SideTask *tasks, int nTasks);
 
         size_t getCurrentNoteCount() const { return currentNoteCount_; }
         const std::array<bool, N_NOTES> &getKeyOnStateForDisp() const
@@ -70,17 +198,71 @@ namespace physical_modeling_piano
 
         void __time_critical_func(worker)();
 
+        // 直前の update() の振り分け
+        const WorkBalance &getWorkBalance() const { return workBalance_; }
+
+        // 同時発音数の上限 (initialize の nPoly 以下)
+        // 発音中のボイスが上限を超えていたら 1 ブロックに 1 つずつフェードアウトさせる
+        void setPolyphonyLimit(size_t n);
+        size_t getPolyphonyLimit() const { return polyphonyLimit_; }
+        // 音域の nVoices の合計
+        size_t getVoiceCount() const { return nodes_.size(); }
+
+        // 負荷が高いときにボイスの詳細度 (Note::setDetailLevel) を落とす度合い
+        // 0 なら全ボイス最高で、1 増やすごとに離鍵済みのボイスと小さいボイスから 1 段ずつ落ちる
+        static constexpr int MAX_DETAIL_BIAS = Note::N_DETAIL_LEVELS + 1;
+        void setDetailBias(int bias) { detailBias_ = std::max(0, std::min(bias, MAX_DETAIL_BIAS)); }
+        int getDetailBias() const { return detailBias_; }
+
+        // 鍵盤の位置で左右に振る量 (0 なら振らない、1 なら両端の鍵が片側だけに寄る)
+        // update() に sideSamples を渡したときだけ、そこに左右差 (左 - 右の半分) を足す
+        // VoiceBank で処理したボイスは振らない
+        void setKeyPanning(float amount);
+        float getKeyPanning() const { return keyPanning_; }
+
+#if PICO_PIANO_HOST
+        // 発音中のボイスをまとめて VoiceBank で処理する (worker は使わない)
+        void setUseVoiceBank(bool f) { useVoiceBank_ = f; }
+#endif
+
     protected:
         int __time_critical_func(getNodeIndex)(Node *node) const;
 
         Node *__time_critical_func(allocateNode)();
         void __time_critical_func(freeNode)(Node *node);
+        bool __time_critical_func(allocateDelayMemory)(Node *node, int note);
+        size_t __time_critical_func(getDelayMemoryUnitSize)(const Node &node) const;
         void __time_critical_func(pushActive)(Node *node);
         void __time_critical_func(pushFrontActive)(Node *node);
         Node *__time_critical_func(popFrontActive)();
         void __time_critical_func(removeActive)(Node *node);
+        void __time_critical_func(addActiveNode)(Node *node);
+        void __time_critical_func(removeActiveNode)(Node *node);
+
+        // 弦をまとめたら true (allowMerge が false ならまとめない)
+        bool __time_critical_func(updateDetailLevel)(Node *node, bool allowMerge) const;
+        void __time_critical_func(stealNode)(Node *node);
+
+        // 遅延線のメモリが minMemory バイト以上あるものから選ぶ
+        Node *__time_critical_func(selectStealNode)(size_t minMemory = 0) const;
+        void __time_critical_func(startFade)(Node *node);
+        void __time_critical_func(processFades)(Note::SampleT *samples, Note::SampleT *side, size_t nSamples);
+        // フェード中のボイスの nSamples 分の出力を fadeBuffer_ に作る
+        void __time_critical_func(renderFade)(Node &node, size_t nSamples);
+        // remaining サンプル後に 0 になる直線 (length サンプルで startGain/256 から下がる) をかけて足す
+        void __time_critical_func(mixFadeRamp)(Note::SampleT *samples, Note::SampleT *side,
+                                               const Note::SampleT *voice, size_t nSamples, int noteIndex,
+                                               uint32_t &remaining, uint32_t length, uint32_t startGain) const;
+        void __time_critical_func(mixPanned)(Note::SampleT *samples, Note::SampleT *side,
+                                             const Note::SampleT *voice, size_t nSamples, int noteIndex) const;
 
-        int __time_critical_func(process)(Note::SampleT *samples, size_t nSamples);
+        void __time_critical_func(planWork)();
+        void __time_critical_func(planTasks)();
+        void __time_critical_func(dispatch)(Note::SampleT *samples, size_t nSamples, int nItems);
+        int __time_critical_func(process)(Note::SampleT *samples, size_t nSamples, int core);
+#if PICO_PIANO_HOST
+        void processVoiceBank(Note::SampleT *samples, size_t nSamples);
+#endif
     };
 
 } // namespace physical_modeling_piano
@@ -0,0 +1,47 @@
+# Build ID recorded in the per-key coefficient tables (NOTE_TABLE_BUILD_ID).
+# It is a hash of the pm_piano sources, not of the compiler or the build: the host
+# pm_piano_coefgen and the firmware get the same value from the same tree, so a
+# prebuilt table still loads, while a flash cache left by a firmware built from
+# other sources is rejected.
+#
+# include() this file and call pm_piano_note_table_id(target...) to generate
+# note_table_id.h in the build directory and put it on the targets' include path.
+# The same file runs as the generator script (cmake -P).
+
+if (CMAKE_SCRIPT_MODE_FILE)
+  file(GLOB sources ${SOURCE_DIR}/*.cpp ${SOURCE_DIR}/*.h)
+  list(SORT sources)
+  set(digests "")
+  foreach(f IN LISTS sources)
+    file(SHA256 ${f} digest)
+    string(APPEND digests ${digest})
+  endforeach()
+  string(SHA256 id "${digests}")
+  string(SUBSTRING ${id} 0 8 id)
+  file(WRITE ${OUTPUT}
+    "// generated by note_table_id.cmake: do not edit\n"
+    "#define NOTE_TABLE_BUILD_ID 0x${id}u\n")
+  return()
+endif()
+
+set(PM_PIANO_NOTE_TABLE_ID_SCRIPT ${CMAKE_CURRENT_LIST_FILE})
+
+function(pm_piano_note_table_id)
+  get_filename_component(source_dir ${PM_PIANO_NOTE_TABLE_ID_SCRIPT} DIRECTORY)
+  set(dir ${CMAKE_CURRENT_BINARY_DIR}/note_table_id)
+  file(GLOB sources CONFIGURE_DEPENDS ${source_dir}/*.cpp ${source_dir}/*.h)
+
+  add_custom_command(
+    OUTPUT ${dir}/note_table_id.h
+    COMMAND ${CMAKE_COMMAND} -DSOURCE_DIR=${source_dir} -DOUTPUT=${dir}/note_table_id.h
+            -P ${PM_PIANO_NOTE_TABLE_ID_SCRIPT}
+    DEPENDS ${sources} ${PM_PIANO_NOTE_TABLE_ID_SCRIPT}
+    COMMENT "Hashing the pm_piano sources for the note table build ID"
+  )
+  add_custom_target(pm_piano_note_table_id DEPENDS ${dir}/note_table_id.h)
+
+  foreach(target IN LISTS ARGN)
+    add_dependencies(${target} pm_piano_note_table_id)
+    target_include_directories(${target} PRIVATE ${dir})
+  endforeach()
+endfunction()
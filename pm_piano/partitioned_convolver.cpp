@@ -0,0 +1,133 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 14:34:02
+ */
+
+#include "partitioned_convolver.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace physical_modeling_piano
+{
+    void
+    PartitionedConvolver::initialize(const float *ir, size_t irLength, size_t partitionSize)
+    {
+        assert(partitionSize >= 4 && (partitionSize & (partitionSize - 1)) == 0);
+        const size_t P = partitionSize;
+        partitionSize_ = P;
+
+        // 先頭はそのまま FIR の係数にする
+        head_.assign(P, 0.0f);
+        for (size_t i = 0; i < std::min(P, irLength); ++i)
+        {
+            head_[P - 1 - i] = ir[i];
+        }
+
+        nPartitions_ = irLength > P ? (irLength - P + P - 1) / P : 0;
+        fft_.initialize(P * 2);
+        nBins_ = fft_.getBinCount();
+
+        // 残りは P ずつ後ろに 0 を詰めて変換しておく
+        tail_.resize(nPartitions_ * nBins_);
+        work_.resize(P * 2);
+        for (size_t k = 0; k < nPartitions_; ++k)
+        {
+            std::fill(work_.begin(), work_.end(), 0.0f);
+            const size_t ofs = P + k * P;
+            const size_t n = std::min(P, irLength - ofs);
+            std::copy(ir + ofs, ir + ofs + n, work_.begin());
+            fft_.forward(&tail_[k * nBins_], work_.data());
+        }
+
+        input_.resize(nPartitions_ * nBins_);
+        inputBuffer_.resize(P * 2);
+        tailOut_.resize(P);
+        acc_.resize(nBins_);
+        clear();
+    }
+
+    void
+    PartitionedConvolver::clear()
+    {
+        std::fill(input_.begin(), input_.end(), Complex());
+        std::fill(inputBuffer_.begin(), inputBuffer_.end(), 0.0f);
+        std::fill(tailOut_.begin(), tailOut_.end(), 0.0f);
+        inputPos_ = 0;
+        fill_ = 0;
+    }
+
+    void
+    PartitionedConvolver::process(float *dst, const float *src, size_t nSamples)
+    {
+        const size_t P = partitionSize_;
+        const float *h = head_.data();
+
+        while (nSamples)
+        {
+            const size_t n = std::min(nSamples, P - fill_);
+            for (size_t j = 0; j < n; ++j)
+            {
+                const size_t pos = fill_ + j;
+                inputBuffer_[P + pos] = src[j];
+
+                // 直近 P サンプルとの FIR (x[t - i] * ir[i])
+                // 4 本に分けて足すと依存が切れてベクタ化もされる
+                const float *x = &inputBuffer_[pos + 1];
+                float v[4] = {tailOut_[pos], 0, 0, 0};
+                for (size_t i = 0; i < P; i += 4)
+                {
+                    v[0] += x[i] * h[i];
+                    v[1] += x[i + 1] * h[i + 1];
+                    v[2] += x[i + 2] * h[i + 2];
+                    v[3] += x[i + 3] * h[i + 3];
+                }
+                dst[j] = (v[0] + v[1]) + (v[2] + v[3]);
+            }
+
+            fill_ += n;
+            dst += n;
+            src += n;
+            nSamples -= n;
+
+            if (fill_ == P)
+            {
+                processPartition();
+                fill_ = 0;
+            }
+        }
+    }
+
+    void
+    PartitionedConvolver::processPartition()
+    {
+        const size_t P = partitionSize_;
+
+        if (nPartitions_)
+        {
+            // 直近 2P サンプルを変換して履歴に入れる
+            inputPos_ = inputPos_ ? inputPos_ - 1 : nPartitions_ - 1;
+            fft_.forward(&input_[inputPos_ * nBins_], inputBuffer_.data());
+
+            // k 個前の入力のスペクトル * k 番目のパーティション
+            std::fill(acc_.begin(), acc_.end(), Complex());
+            size_t pos = inputPos_;
+            for (size_t k = 0; k < nPartitions_; ++k)
+            {
+                const auto *x = &input_[pos * nBins_];
+                const auto *y = &tail_[k * nBins_];
+                for (size_t b = 0; b < nBins_; ++b)
+                {
+                    acc_[b] += RealFFT::multiply(x[b], y[b]);
+                }
+                pos = pos + 1 < nPartitions_ ? pos + 1 : 0;
+            }
+
+            // 後ろ半分が循環しない部分 (overlap-save)
+            fft_.inverse(work_.data(), acc_.data());
+            std::copy(work_.begin() + P, work_.end(), tailOut_.begin());
+        }
+
+        std::copy(inputBuffer_.begin() + P, inputBuffer_.end(), inputBuffer_.begin());
+    }
+
+} // namespace physical_modeling_piano
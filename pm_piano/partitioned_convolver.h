@@ -0,0 +1,62 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 14:26:37
+ */
+#ifndef _7B8227FC_E8AF_19ED_8EF1_ACCF08BC90BB
+#define _7B8227FC_E8AF_19ED_8EF1_ACCF08BC90BB
+
+#include "fft.h"
+#include <stddef.h>
+#include <vector>
+
+#include "platform.h"
+
+namespace physical_modeling_piano
+{
+    // インパルス応答を等しい長さ P のパーティションに分けて畳み込む (uniformly partitioned overlap-save)
+    // 先頭の 1 パーティションはサンプルごとの FIR で計算し、残りを FFT で
+    // 1 パーティション前の入力までを使って先に求めておくので、遅延なしで出力する
+    // FFT は P サンプルの入力がたまるごとに、長さ 2P の順変換 1 回と逆変換 1 回
+    // 周波数領域の積和はインパルス応答の長さ / P に比例する
+    class PartitionedConvolver
+    {
+    public:
+        using Complex = RealFFT::Complex;
+
+    public:
+        // partitionSize は 4 以上の 2 のべき
+        void initialize(const float *ir, size_t irLength, size_t partitionSize);
+        void clear();
+
+        void __time_critical_func(process)(float *dst, const float *src, size_t nSamples);
+
+        size_t getPartitionSize() const { return partitionSize_; }
+        size_t getPartitionCount() const { return nPartitions_; } // FFT で処理する分
+        bool isEmpty() const { return head_.empty(); }
+
+    protected:
+        void __time_critical_func(processPartition)();
+
+    private:
+        size_t partitionSize_ = 0;
+        size_t nPartitions_ = 0;
+        size_t nBins_ = 0;
+
+        RealFFT fft_;
+
+        std::vector<float> head_;    // 先頭 P タップ (逆順)
+        std::vector<Complex> tail_;  // 残りの各パーティションのスペクトル
+        std::vector<Complex> input_; // 入力のスペクトルの履歴 (リングバッファ)
+        size_t inputPos_ = 0;        // 一番新しいスペクトルの位置
+
+        std::vector<float> inputBuffer_; // [0, P) が前のパーティション、[P, 2P) がいまためているもの
+        size_t fill_ = 0;
+        std::vector<float> tailOut_; // いまのパーティションに足す FFT 側の出力
+
+        std::vector<Complex> acc_;
+        std::vector<float> work_;
+    };
+
+} // namespace physical_modeling_piano
+
+#endif /* _7B8227FC_E8AF_19ED_8EF1_ACCF08BC90BB */
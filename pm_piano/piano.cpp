@@ -4,20 +4,85 @@
  */
 
 #include "piano.h"
-#include "hardware/gpio.h"
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
 
 namespace physical_modeling_piano
 {
     void
     Piano::initialize(size_t nPoly)
     {
-        noteManager_.initialize(sysParams_, nPoly);
+        const NoteManager::VoiceRegister r{NoteManager::NOTE_END, nPoly};
+        initialize(&r, 1);
+    }
+
+    void
+    Piano::initialize(const NoteManager::VoiceRegister *registers, size_t nRegisters)
+    {
+        noteManager_.initialize(sysParams_, registers, nRegisters);
         soundboard_.initialize(sysParams_);
+        const size_t nPoly = noteManager_.getVoiceCount();
+        loadGovernor_.initialize(nPoly, std::max<size_t>(1, nPoly / 3), NoteManager::MAX_DETAIL_BIAS);
+
+        // 響板は弦 1 本分くらいの重さ
+        constexpr uint32_t soundboardCost = 16;
+        soundboardTask_.func = [](void *context)
+        {
+            auto *self = static_cast<Piano *>(context);
+            self->updateSoundboard(self->soundboardDst_, self->soundboardRight_,
+                                   self->soundboardSrc_, self->soundboardSide_, self->soundboardSamples_);
+        };
+        soundboardTask_.context = this;
+        soundboardTask_.cost = soundboardCost;
+
+        static_assert(Soundboard::N_PARTS == 2, "");
+        soundboardPartTasks_[0] = {&updateSoundboardPart<0>, this, soundboardCost / 2};
+        soundboardPartTasks_[1] = {&updateSoundboardPart<1>, this, soundboardCost / 2};
+    }
+
+    bool
+    Piano::setHalfRateBelow(int note)
+    {
+        if (!USE_HALF_RATE && note > 0)
+        {
+            printf("half rate: not available in this build (USE_HALF_RATE=0)\n");
+            sysParams_.halfRateFrequency = 0;
+            return false;
+        }
+        // note とその半音下の間で切り替える
+        sysParams_.halfRateFrequency = note > 0 ? 440 * powf(2.0f, (note - 69.5f) / 12.0f) : 0;
+        return true;
+    }
+
+    template <int PART>
+    void
+    Piano::updateSoundboardPart(void *context)
+    {
+        auto *self = static_cast<Piano *>(context);
+        self->soundboard_.updatePart(PART, self->soundboardSrc_, self->soundboardSamples_, self->soundboardSide_);
+    }
+
+    void
+    Piano::reportLoad(uint32_t elapsed, uint32_t deadline)
+    {
+        if (loadGovernor_.update(elapsed, deadline))
+        {
+            noteManager_.setPolyphonyLimit(loadGovernor_.getPolyphony());
+            noteManager_.setDetailBias(loadGovernor_.getDetailBias());
+        }
     }
 
     void
     Piano::update(int16_t *dst, size_t nSamples,
                   io::MidiMessageQueue &midiIn)
+    {
+        update(dst, nullptr, nSamples, midiIn);
+    }
+
+    void
+    Piano::update(int16_t *dst, int16_t *right, size_t nSamples,
+                  io::MidiMessageQueue &midiIn)
     {
         io::MidiMessage m;
         while (midiIn.get(&m))
@@ -55,14 +120,183 @@ namespace physical_modeling_piano
         Note::SampleT samples[nSamples];
         memset(samples, 0, sizeof(Note::SampleT) * nSamples);
 
-        noteManager_.update(samples,
-                            nSamples,
-                            sysParams_,
-                            pedal_);
+        // 鍵盤の位置で振るときは弦の出力の左右差も集める
+        Note::SampleT sideBuffer[nSamples];
+        Note::SampleT *side = nullptr;
+        if (right && noteManager_.getKeyPanning() > 0)
+        {
+            memset(sideBuffer, 0, sizeof(Note::SampleT) * nSamples);
+            side = sideBuffer;
+        }
+
+        const bool parts = parallelSoundboard_ && !soundboard_.isConvolution();
+        if (soundboardParts_ && !parts)
+        {
+            soundboard_.endParts();
+        }
+        else if (!soundboardParts_ && parts)
+        {
+            soundboard_.beginParts(nSamples);
+        }
+        soundboardParts_ = parts;
+        soundboardSamples_ = nSamples;
+
+        if (!pipelined_)
+        {
+            // 止めた直後は前のブロックの残りをこのブロックに重ねる
+            if (pipelineFilled_)
+            {
+                for (size_t i = 0; i < nSamples; ++i)
+                {
+                    samples[i] = pending_[i];
+                }
+                if (side)
+                {
+                    std::copy(pendingSide_.begin(), pendingSide_.end(), side);
+                }
+                pipelineFilled_ = false;
+            }
+
+            noteManager_.update(samples,
+                                nSamples,
+                                sysParams_,
+                                pedal_,
+                                nullptr,
+                                0,
+                                side);
+
+            // gpio_put(6, 1);
+            if (parts)
+            {
+                soundboardSrc_ = samples;
+                soundboardSide_ = side;
+                noteManager_.runTasks(soundboardPartTasks_, Soundboard::N_PARTS);
+                mixSoundboard(dst, right, nSamples);
+            }
+            else
+            {
+                updateSoundboard(dst, right, samples, side, nSamples);
+            }
+            // gpio_put(6, 0);
+            return;
+        }
+
+        // 始めた直後は前のブロックがないので無音を響板にかける
+        if (!pipelineFilled_)
+        {
+            pending_.resize(nSamples);
+            std::fill(pending_.begin(), pending_.end(), 0);
+            pendingSide_.resize(nSamples);
+            std::fill(pendingSide_.begin(), pendingSide_.end(), 0);
+            pipelineFilled_ = true;
+        }
+        assert(pending_.size() == nSamples);
+
+        soundboardDst_ = dst;
+        soundboardRight_ = right;
+        soundboardSrc_ = pending_.data();
+        soundboardSide_ = right ? pendingSide_.data() : nullptr;
+        if (parts)
+        {
+            noteManager_.update(samples,
+                                nSamples,
+                                sysParams_,
+                                pedal_,
+                                soundboardPartTasks_,
+                                Soundboard::N_PARTS,
+                                side);
+            mixSoundboard(dst, right, nSamples);
+        }
+        else
+        {
+            noteManager_.update(samples,
+                                nSamples,
+                                sysParams_,
+                                pedal_,
+                                &soundboardTask_,
+                                1,
+                                side);
+        }
+
+        std::copy(samples, samples + nSamples, pending_.begin());
+        if (side)
+        {
+            std::copy(side, side + nSamples, pendingSide_.begin());
+        }
+        else
+        {
+            std::fill(pendingSide_.begin(), pendingSide_.end(), 0);
+        }
+    }
+
+#if !USE_FIXED_POINT
+    namespace
+    {
+        // 浮動小数点版は一旦受けてから 16bit にする
+        void toInt16(int16_t *dst, const Soundboard::ResultT *src, size_t nSamples)
+        {
+            for (size_t i = 0; i < nSamples; ++i)
+            {
+                float v = floorf(src[i] * 32768.0f);
+                dst[i] = int16_t(std::max(-32768.0f, std::min(32767.0f, v)));
+            }
+        }
+    }
+#endif
+
+    void
+    Piano::updateSoundboard(int16_t *dst, int16_t *right,
+                            const Note::SampleT *src, const Note::SampleT *side, size_t nSamples)
+    {
+#if USE_FIXED_POINT
+        auto *out = reinterpret_cast<Soundboard::ResultT *>(dst);
+        auto *outRight = reinterpret_cast<Soundboard::ResultT *>(right);
+#else
+        Soundboard::ResultT out[nSamples];
+        Soundboard::ResultT outRight[nSamples];
+#endif
+        if (right)
+        {
+            soundboard_.updateStereo(out, outRight, src, side, nSamples);
+        }
+        else
+        {
+            soundboard_.update(out, src, nSamples);
+        }
+#if !USE_FIXED_POINT
+        toInt16(dst, out, nSamples);
+        if (right)
+        {
+            toInt16(right, outRight, nSamples);
+        }
+#endif
+    }
 
-        // gpio_put(6, 1);
-        soundboard_.update(reinterpret_cast<Soundboard::ResultT *>(dst), samples, nSamples);
-        // gpio_put(6, 0);
+    void
+    Piano::mixSoundboard(int16_t *dst, int16_t *right, size_t nSamples)
+    {
+#if USE_FIXED_POINT
+        auto *out = reinterpret_cast<Soundboard::ResultT *>(dst);
+        auto *outRight = reinterpret_cast<Soundboard::ResultT *>(right);
+#else
+        Soundboard::ResultT out[nSamples];
+        Soundboard::ResultT outRight[nSamples];
+#endif
+        if (right)
+        {
+            soundboard_.mixParts(out, outRight, nSamples);
+        }
+        else
+        {
+            soundboard_.mixParts(out, nSamples);
+        }
+#if !USE_FIXED_POINT
+        toInt16(dst, out, nSamples);
+        if (right)
+        {
+            toInt16(right, outRight, nSamples);
+        }
+#endif
     }
 
     SystemParameters::DeltaTimeT SystemParameters::deltaTF =
@@ -5,11 +5,13 @@
 #ifndef DC39274B_A134_1524_1625_4EACE18FA496
 #define DC39274B_A134_1524_1625_4EACE18FA496
 
+#include "load_governor.h"
 #include "note_manager.h"
 #include "soundboard.h"
 #include <midi.h>
+#include <vector>
 
-#include <pico/platform.h>
+#include "platform.h"
 
 namespace physical_modeling_piano
 {
@@ -17,17 +19,60 @@ namespace physical_modeling_piano
     {
         NoteManager noteManager_;
         Soundboard soundboard_;
+        LoadGovernor loadGovernor_;
 
         SystemParameters sysParams_;
         PedalState pedal_;
 
+        // パイプライン処理
+        // 前のブロックの弦の出力に響板をかけるのを、このブロックの弦の計算と並行して行う
+        bool pipelined_ = false;
+        bool pipelineFilled_ = false;        // pending_ に前のブロックの出力が入っているか
+        std::vector<Note::SampleT> pending_; // 響板にかける前のブロックの弦の出力
+        std::vector<Note::SampleT> pendingSide_; // その左右差
+
+        // 響板の枝を 2 つのコアで分けて処理する (Soundboard::updatePart)
+        bool parallelSoundboard_ = false;
+        bool soundboardParts_ = false; // 前のブロックを updatePart で処理したか
+
+        // SideTask から響板を呼ぶときの引数
+        int16_t *soundboardDst_{};
+        int16_t *soundboardRight_{}; // モノラルなら nullptr
+        const Note::SampleT *soundboardSrc_{};
+        const Note::SampleT *soundboardSide_{};
+        size_t soundboardSamples_{};
+        NoteManager::SideTask soundboardTask_{};
+        NoteManager::SideTask soundboardPartTasks_[Soundboard::N_PARTS]{};
+
     public:
         Piano() {}
 
         void initialize(size_t nPoly);
+        // 音域ごとにボイス数を分けて遅延線のメモリを割り当てる (NoteManager::VoiceRegister)
+        void initialize(const NoteManager::VoiceRegister *registers, size_t nRegisters);
+
+        // MIDI ノート番号 note より低い鍵は弦を半分のサンプリング周波数で計算する (0 ならしない)
+        // initialize() の前に呼ぶ
+        // USE_HALF_RATE でないビルド (固定小数点の既定) では使わずに false
+        bool setHalfRateBelow(int note);
+
+        // 鍵ごとの係数を計算せずに表から読む (NoteManager::setNoteTable)
+        // initialize() の前に呼ぶ
+        void setNoteTable(const uint32_t *words, size_t nWords) { noteManager_.setNoteTable(words, nWords); }
+        // initialize() で表を読めたか (読めなければ計算したので、writeNoteTable() で残しておける)
+        bool isNoteTableLoaded() const { return noteManager_.isNoteTableLoaded(); }
+        void writeNoteTable(CoefficientWriter &w) { noteManager_.writeNoteTable(w, sysParams_); }
+
+        // 弦や響板のパラメータを差し替える (setHalfRateBelow() より前、initialize() の前に呼ぶ)
+        void setSystemParameters(const SystemParameters &p) { sysParams_ = p; }
+        const SystemParameters &getSystemParameters() const { return sysParams_; }
 
         void __time_critical_func(update)(int16_t *dst, size_t nSamples,
                                           io::MidiMessageQueue &midiIn);
+        // ステレオで出す (right が nullptr なら上と同じ)
+        // 左右は 1 つの響板の枝の出力の組み合わせ方を変えて作る (Soundboard::updateStereo)
+        void __time_critical_func(update)(int16_t *left, int16_t *right, size_t nSamples,
+                                          io::MidiMessageQueue &midiIn);
 
         size_t getCurrentNoteCount() const
         {
@@ -39,6 +84,52 @@ namespace physical_modeling_piano
         }
 
         void worker() { noteManager_.worker(); }
+        const NoteManager::WorkBalance &getWorkBalance() const { return noteManager_.getWorkBalance(); }
+
+        void setDetailBias(int bias) { noteManager_.setDetailBias(bias); }
+        int getDetailBias() const { return noteManager_.getDetailBias(); }
+
+        // 直前の update() にかかった時間を締め切り (同じ単位) と一緒に渡すと、
+        // 負荷に合わせて同時発音数の上限と詳細度を調整する
+        void __time_critical_func(reportLoad)(uint32_t elapsed, uint32_t deadline);
+        const LoadGovernor &getLoadGovernor() const { return loadGovernor_; }
+        size_t getPolyphonyLimit() const { return noteManager_.getPolyphonyLimit(); }
+
+        // 響板の処理を次のブロックの弦の計算と並行させる
+        // 出力が 1 ブロック遅れる代わりに、響板を処理している間もう一方のコアが空かなくなる
+        // 切り替えた直後のブロックは弦の出力が 1 ブロック分抜けるか重なる
+        void setPipelined(bool f) { pipelined_ = f; }
+        bool isPipelined() const { return pipelined_; }
+
+        // 響板の 8 本の枝を半分ずつ 2 つのコアで処理する
+        // 後ろ半分の枝の遅延は 2 ブロックより長いので、前もって計算しておける
+        // 前半分からのフィードバックは、まだ読んでいない遅延線の位置に足すので、足す順番が変わるだけで出力は同じ
+        void setParallelSoundboard(bool f) { parallelSoundboard_ = f; }
+        bool isParallelSoundboard() const { return parallelSoundboard_; }
+
+        // ステレオの広がり (0 でモノラル、1 が最大)
+        void setStereoWidth(float w) { soundboard_.setStereoWidth(w); }
+        // ステレオのとき鍵盤の位置で左右に振る (低音が左、0 なら振らない)
+        void setKeyPanning(float amount) { noteManager_.setKeyPanning(amount); }
+
+#if PICO_PIANO_HOST
+        void setUseVoiceBank(bool f) { noteManager_.setUseVoiceBank(f); }
+
+        // 響板を 8 本の遅延線の代わりにインパルス応答の畳み込みにする (Soundboard::setImpulseResponse)
+        // 畳み込みの間は setParallelSoundboard() は効かない
+        void setBodyImpulseResponse(const float *ir, size_t n, size_t partitionSize)
+        {
+            soundboard_.setImpulseResponse(ir, n, partitionSize);
+        }
+#endif
+
+    protected:
+        void __time_critical_func(updateSoundboard)(int16_t *dst, int16_t *right,
+                                                    const Note::SampleT *src, const Note::SampleT *side, size_t nSamples);
+        void __time_critical_func(mixSoundboard)(int16_t *dst, int16_t *right, size_t nSamples);
+
+        template <int PART>
+        static void __time_critical_func(updateSoundboardPart)(void *context);
     };
 
 } // namespace physical_modeling_piano
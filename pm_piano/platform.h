@@ -0,0 +1,122 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Fri Oct 16 2026 23:40:12
+ */
+#ifndef _3E0A91C4_6134_1F2B_2D4E_7C18A05B93F1
+#define _3E0A91C4_6134_1F2B_2D4E_7C18A05B93F1
+
+// pico-sdk 依存部分の吸収
+// PICO_PIANO_HOST=1 のときはワークステーション上でビルドするための最小限の代替を用意する
+
+#if PICO_PIANO_HOST
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+
+#ifndef __time_critical_func
+#define __time_critical_func(x) x
+#endif
+
+#ifndef __not_in_flash_func
+#define __not_in_flash_func(x) x
+#endif
+
+inline void __wfe() { std::this_thread::yield(); }
+inline void __sev() {}
+
+inline uint32_t save_and_disable_interrupts() { return 0; }
+inline void restore_interrupts(uint32_t) {}
+
+// 続けられないときに止める (pico-sdk の panic の代わり)
+[[noreturn]] inline void panic(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "*** PANIC ***\n");
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+    abort();
+}
+
+// コアの間で仕事を渡した / 終わったことを知らせるフラグ
+// set() より前に書いたものは、get() でその値を読んだコアから見える (release / acquire)
+class HandoffFlag
+{
+    std::atomic<bool> v_{false};
+
+public:
+    void set(bool v) { v_.store(v, std::memory_order_release); }
+    bool get() const { return v_.load(std::memory_order_acquire); }
+};
+
+// 2 つのコアで仕事の番号を取り合うカウンタ
+// reset() は相手のコアに HandoffFlag で仕事を渡す前に呼ぶ
+// reset() を release、claim() を acquire にして、フラグがなくても前のブロックの値で取らないようにする
+class WorkCounter
+{
+    std::atomic<int> next_{0};
+
+public:
+    void initialize() {}
+    void reset(int v = 0) { next_.store(v, std::memory_order_release); }
+    int claim() { return next_.fetch_add(1, std::memory_order_acq_rel); }
+};
+
+#else
+
+#include <pico/platform.h>
+#include <pico/sync.h>
+
+// コアの間で仕事を渡した / 終わったことを知らせるフラグ
+// set() より前に書いたものは、get() でその値を読んだコアから見える
+// M0+ は順番どおりに実行するが、コンパイラが入れ替えないように __dmb() で挟む
+class HandoffFlag
+{
+    volatile bool v_ = false;
+
+public:
+    void __time_critical_func(set)(bool v)
+    {
+        __dmb();
+        v_ = v;
+    }
+    bool __time_critical_func(get)() const
+    {
+        bool v = v_;
+        __dmb();
+        return v;
+    }
+};
+
+// 2 つのコアで仕事の番号を取り合うカウンタ
+// ロックなしではない: Cortex-M0+ には LDREX/STREX がなく不可分な読み書きができないので、
+// インクリメントだけを SIO のハードウェアスピンロックで囲む
+// 相手のコアが同じインクリメントをしている数サイクルのあいだだけ待つことがある
+// (コア間の FIFO で番号を配ると、片方のコアが配る役になって先に割り振ることになる)
+// 取り合うのは 2 つのコアだけで同じコアの割り込みからは使わないので、割り込みは止めない
+class WorkCounter
+{
+    spin_lock_t *lock_{};
+    volatile int next_ = 0;
+
+public:
+    void initialize() { lock_ = spin_lock_instance(spin_lock_claim_unused(true)); }
+    // 相手のコアに HandoffFlag で仕事を渡す前に呼ぶ (set() の __dmb() でこの書き込みが先に見える)
+    void reset(int v = 0) { next_ = v; }
+    int __time_critical_func(claim)()
+    {
+        spin_lock_unsafe_blocking(lock_);
+        int r = next_++;
+        spin_unlock_unsafe(lock_);
+        return r;
+    }
+};
+
+#endif
+
+#endif /* _3E0A91C4_6134_1F2B_2D4E_7C18A05B93F1 */
@@ -4,7 +4,12 @@
  */
 
 #include "soundboard.h"
+#include <algorithm>
 #include <assert.h>
+#include <string.h>
+#if PICO_PIANO_HOST
+#include "voice_bank.h"
+#endif
 
 namespace physical_modeling_piano
 {
@@ -56,77 +61,651 @@ namespace physical_modeling_piano
     Soundboard::setScale(float s)
     {
         scale_ = s / 8.0f;
+        // 幅 1 で mid の半分 (L/R の相関がおよそ 0.6 になる)
+        sideScale_ = s / 16.0f * stereoWidth_;
+        scaleValue_ = s;
+    }
+
+    void
+    Soundboard::setStereoWidth(float w)
+    {
+        stereoWidth_ = std::max(0.0f, std::min(w, 1.0f));
+        setScale(scaleValue_);
     }
 
     namespace
     {
+        // 遅延線のバッファはどれも遅延ちょうどの長さ
         inline Soundboard::ValueT __time_critical_func(compute)(Soundboard::ValueT t, Soundboard::ValueT o,
-                                                                Soundboard::Filters &filters, size_t delayLength)
+                                                                Soundboard::Filters &filters)
         {
             Soundboard::ValueT i;
             add(i, t, o);
-            return filters.decay.filter(filters.delay.update(i, delayLength));
+            return filters.decay.filter(filters.delay.updateFull(i));
+        }
+
+        // 一番短い枝の遅延
+        // これ以下の長さの区間なら、どの枝も区間中に読み出すのは区間の前に書いた位置だけになる
+        constexpr size_t
+        getMinDelayLength()
+        {
+            size_t m = getDelayLength(0);
+            for (int i = 1; i < 8; ++i)
+            {
+                m = std::min(m, getDelayLength(i));
+            }
+            return m;
+        }
+
+        constexpr size_t MAX_SPAN = getMinDelayLength();
+
+        using BranchValues = Soundboard::ValueT[8];
+        using DelayBlock = Soundboard::DelayStateT::Block;
+
+        // 各枝の遅延線から n サンプル読み出して損失フィルタに通し、o[1..n] に入れる
+#if PICO_PIANO_HOST
+        // 8 本の枝をレーンに並べて 1 サンプルずつまとめて計算する
+        // レーンの型は VoiceBank と共通 (中身はスカラーを 8 個並べたものと同じ並び)
+        static_assert(detail::VOICE_LANES == 8, "");
+
+        template <class T>
+        using BranchLaneT = typename detail::VoiceLane<T>::type;
+
+        // 浮動小数点のレーン用 (固定小数点は fixed.h のものがそのまま使える)
+        // ここで宣言すると外側の mul/madd が隠れるので一緒に持ってくる
+        using physical_modeling_piano::madd;
+        using physical_modeling_piano::mul;
+        inline void mul(detail::VoiceLaneF &dst, const detail::VoiceLaneF &a, const detail::VoiceLaneF &b) { dst = a * b; }
+        inline void madd(detail::VoiceLaneF &dst, const detail::VoiceLaneF &c,
+                         const detail::VoiceLaneF &a, const detail::VoiceLaneF &b) { dst = c + a * b; }
+
+        template <class T, int S>
+        inline T rawValue(const FixedPoint<T, S> &v) { return v.get(); }
+        inline float rawValue(float v) { return v; }
+        inline detail::VoiceLaneF rawValue(const detail::VoiceLaneF &v) { return v; }
+
+        template <class T, int S>
+        inline void setRawValue(FixedPoint<T, S> &v, const T &x) { v.set(x); }
+        inline void setRawValue(detail::VoiceLaneF &v, const detail::VoiceLaneF &x) { v = x; }
+
+        template <class TL, class T>
+        inline TL
+        loadLanes(const T (&v)[8])
+        {
+            TL r;
+            memcpy(&r, v, sizeof(r));
+            return r;
+        }
+
+        template <class TL, class T>
+        inline void
+        storeLanes(T (&v)[8], const TL &r)
+        {
+            memcpy(v, &r, sizeof(r));
+        }
+
+        // 遅延線から直接レーンに詰める (一度メモリに並べるより速い)
+        template <class TL>
+        inline TL
+        readLanes(const DelayBlock *blk, size_t j)
+        {
+            using RawT = decltype(rawValue(std::declval<TL>()));
+            TL r;
+            setRawValue(r, RawT{rawValue(blk[0].read(j)), rawValue(blk[1].read(j)),
+                                rawValue(blk[2].read(j)), rawValue(blk[3].read(j)),
+                                rawValue(blk[4].read(j)), rawValue(blk[5].read(j)),
+                                rawValue(blk[6].read(j)), rawValue(blk[7].read(j))});
+            return r;
+        }
+
+        inline void __time_critical_func(readBranches)(BranchValues *o, const DelayBlock *blk, size_t n,
+                                                       Soundboard::Filters *filters)
+        {
+            using ValueLaneT = BranchLaneT<Soundboard::ValueT>;
+            using HistoryLaneT = BranchLaneT<Soundboard::FilterHistoryT>;
+            using CoefLaneT = BranchLaneT<Soundboard::CoefT>;
+
+            Soundboard::CoefT b0[8];
+            Soundboard::CoefT ma1[8];
+            Soundboard::FilterHistoryT h0[8];
+            for (int i = 0; i < 8; ++i)
+            {
+                b0[i] = filters[i].decay.constant.getB0();
+                ma1[i] = filters[i].decay.constant.getMA1();
+                h0[i] = filters[i].decay.state.h0;
+            }
+            const auto b0l = loadLanes<CoefLaneT>(b0);
+            const auto ma1l = loadLanes<CoefLaneT>(ma1);
+            auto h = loadLanes<HistoryLaneT>(h0);
+
+            for (size_t j = 0; j < n; ++j)
+            {
+                // LossFilter::filter と同じ計算
+                const auto in = readLanes<ValueLaneT>(blk, j);
+                ValueLaneT out;
+                madd(out, h, b0l, in);
+                mul(h, ma1l, out);
+                storeLanes(o[j + 1], out);
+            }
+
+            storeLanes(h0, h);
+            for (int i = 0; i < 8; ++i)
+            {
+                filters[i].decay.state.h0 = h0[i];
+            }
+        }
+#else
+        inline void __time_critical_func(readBranches)(BranchValues *o, const DelayBlock *blk, size_t n,
+                                                       Soundboard::Filters *filters)
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                // 枝ごとに回すので、遅延線が折り返すところで分ける
+                auto &decay = filters[i].decay;
+                for (size_t j0 = 0; j0 < n;)
+                {
+                    const size_t m = std::min(n - j0, blk[i].getContiguous(j0));
+                    const auto *in = blk[i].readPtr(j0);
+                    for (size_t j = 0; j < m; ++j)
+                    {
+                        o[j0 + j + 1][i] = decay.filter(in[j]);
+                    }
+                    j0 += m;
+                }
+            }
+        }
+#endif
+    }
+
+    namespace
+    {
+        // 左右の出力は中央と左右差を ScaleT を掛けたところで足し引きしてから ResultT にする
+#if USE_FIXED_POINT
+        using MixT = FixedPoint<int32_t, 25 + 3>; // ValueT * ScaleT
+
+        inline void
+        toResult(Soundboard::ResultT &dst, const MixT &v)
+        {
+            const int32_t x = v.get() >> (28 - 15);
+            dst.set(int16_t(std::max(-32768, std::min(32767, x))));
+        }
+#else
+        using MixT = float;
+
+        inline void
+        toResult(float &dst, float v)
+        {
+            dst = std::max(-1.0f, std::min(32767.0f / 32768.0f, v));
+        }
+#endif
+
+        inline void
+        mixStereo(Soundboard::ResultT &left, Soundboard::ResultT &right,
+                  const Soundboard::ValueT &mid, const Soundboard::ValueT &side,
+                  const Soundboard::ScaleT &scale, const Soundboard::ScaleT &sideScale)
+        {
+            MixT m, d, v;
+            mul(m, mid, scale);
+            mul(d, side, sideScale);
+            add(v, m, d);
+            toResult(left, v);
+            sub(v, m, d);
+            toResult(right, v);
         }
     }
 
     void
     Soundboard::update(ResultT *dst, const ValueT *src, size_t nSamples)
     {
+#if PICO_PIANO_HOST
+        if (isConvolution())
+        {
+            updateConvolution(dst, src, nSamples);
+            return;
+        }
+#endif
+        updateSpans<false>(dst, nullptr, src, nullptr, nSamples);
+    }
+
+    void
+    Soundboard::updateStereo(ResultT *left, ResultT *right, const ValueT *src, const ValueT *side, size_t nSamples)
+    {
+#if PICO_PIANO_HOST
+        if (isConvolution())
+        {
+            updateConvolution(left, src, nSamples);
+            std::copy(left, left + nSamples, right);
+            return;
+        }
+#endif
+        updateSpans<true>(left, right, src, side, nSamples);
+    }
+
+    template <bool STEREO>
+    void
+    Soundboard::updateSpans(ResultT *dst, ResultT *right, const ValueT *src, const ValueT *side, size_t nSamples)
+    {
+        // MAX_SPAN サンプルずつ、枝ごとに
+        //   遅延線から区間分を読み出す → 損失フィルタ → 区間分の入力を書き込む
+        // の順に処理する
+        // 区間の長さが一番短い遅延以下なので、読み出しは全部区間の前に書いた位置になり、
+        // 1 サンプルずつ update して回すのと同じ結果になる
+        // o[0] は区間の 1 サンプル前の出力
+        BranchValues o[MAX_SPAN + 1];
+        std::copy(o_, o_ + 8, o[0]);
+
         while (nSamples)
         {
-            ValueT t;
-            mul(t, ot_, a_);
-            add(t, t, *src);
-
-#if 0
-            ValueT i[8];
-            add(i[0], t, o_[1]);
-            add(i[1], t, o_[2]);
-            add(i[2], t, o_[3]);
-            add(i[3], t, o_[4]);
-            add(i[4], t, o_[5]);
-            add(i[5], t, o_[6]);
-            add(i[6], t, o_[7]);
-            add(i[7], t, o_[0]);
-
-            o_[0] = filters_[0].decay.filter(filters_[0].delay.update(i[0], getDelayLength(0)));
-            o_[1] = filters_[1].decay.filter(filters_[1].delay.update(i[1], getDelayLength(1)));
-            o_[2] = filters_[2].decay.filter(filters_[2].delay.update(i[2], getDelayLength(2)));
-            o_[3] = filters_[3].decay.filter(filters_[3].delay.update(i[3], getDelayLength(3)));
-            o_[4] = filters_[4].decay.filter(filters_[4].delay.update(i[4], getDelayLength(4)));
-            o_[5] = filters_[5].decay.filter(filters_[5].delay.update(i[5], getDelayLength(5)));
-            o_[6] = filters_[6].decay.filter(filters_[6].delay.update(i[6], getDelayLength(6)));
-            o_[7] = filters_[7].decay.filter(filters_[7].delay.update(i[7], getDelayLength(7)));
-#else
-            auto po0 = o_[0];
-
-            o_[0] = compute(t, o_[1], filters_[0], getDelayLength(0));
-            o_[1] = compute(t, o_[2], filters_[1], getDelayLength(1));
-            o_[2] = compute(t, o_[3], filters_[2], getDelayLength(2));
-            o_[3] = compute(t, o_[4], filters_[3], getDelayLength(3));
-            o_[4] = compute(t, o_[5], filters_[4], getDelayLength(4));
-            o_[5] = compute(t, o_[6], filters_[5], getDelayLength(5));
-            o_[6] = compute(t, o_[7], filters_[6], getDelayLength(6));
-            o_[7] = compute(t, po0, filters_[7], getDelayLength(7));
+            const size_t n = std::min(nSamples, MAX_SPAN);
+
+            DelayBlock blk[8];
+            for (int i = 0; i < 8; ++i)
+            {
+                blk[i] = filters_[i].delay.getBlock(getDelayLength(i));
+            }
+            readBranches(o, blk, n, filters_);
+
+            for (size_t j = 0; j < n; ++j)
+            {
+                ValueT t;
+                mul(t, ot_, a_);
+                add(t, t, src[j]);
+
+                // 枝 i には 1 サンプル前の隣の枝の出力を足して入れる
+                const auto &po = o[j];
+                if (STEREO && side)
+                {
+                    // 左右差は出力の左右差と同じ符号の組で入れる
+                    ValueT tp, tm;
+                    add(tp, t, side[j]);
+                    sub(tm, t, side[j]);
+                    for (int i = 0; i < 8; ++i)
+                    {
+                        add(blk[i].write(j), (i & 2) ? tm : tp, po[(i + 1) & 7]);
+                    }
+                }
+                else
+                {
+                    for (int i = 0; i < 8; ++i)
+                    {
+                        add(blk[i].write(j), t, po[(i + 1) & 7]);
+                    }
+                }
+
+                const auto &co = o[j + 1];
+                ValueT oo, oe;
+                add(oe, co[0], co[2]);
+                add(oe, oe, co[4]);
+                add(oe, oe, co[6]);
+                add(oo, co[1], co[3]);
+                add(oo, oo, co[5]);
+                add(oo, oo, co[7]);
+
+                ValueT r;
+                sub(r, oe, oo);
+                add(ot_, oe, oo);
+
+                if (STEREO)
+                {
+                    ValueT sp, sm, d;
+                    add(sp, co[0], co[1]);
+                    add(sp, sp, co[4]);
+                    add(sp, sp, co[5]);
+                    add(sm, co[2], co[3]);
+                    add(sm, sm, co[6]);
+                    add(sm, sm, co[7]);
+                    sub(d, sp, sm);
+                    mixStereo(dst[j], right[j], r, d, scale_, sideScale_);
+                }
+                else
+                {
+                    mul(dst[j], r, scale_);
+                }
+            }
+
+            for (int i = 0; i < 8; ++i)
+            {
+                filters_[i].delay.advance(n);
+            }
+            std::copy(o[n], o[n] + 8, o[0]);
+
+            dst += n;
+            src += n;
+            nSamples -= n;
+            if (STEREO)
+            {
+                right += n;
+                side = side ? side + n : nullptr;
+            }
+        }
+
+        std::copy(o[0], o[0] + 8, o_);
+    }
+
+#if PICO_PIANO_HOST
+    void
+    Soundboard::setImpulseResponse(const float *ir, size_t irLength, size_t partitionSize)
+    {
+        if (!ir || !irLength)
+        {
+            convolver_ = PartitionedConvolver();
+            return;
+        }
+        convolver_.initialize(ir, irLength, partitionSize);
+    }
+
+    void
+    Soundboard::updateConvolution(ResultT *dst, const ValueT *src, size_t nSamples)
+    {
+        constexpr size_t CHUNK = 64;
+        float in[CHUNK];
+        float out[CHUNK];
+        while (nSamples)
+        {
+            const size_t n = std::min(nSamples, CHUNK);
+            for (size_t j = 0; j < n; ++j)
+            {
+                in[j] = float(src[j]);
+            }
+            convolver_.process(out, in, n);
+            for (size_t j = 0; j < n; ++j)
+            {
+                // ResultT の範囲 [-1, 1) に収める
+                dst[j] = ResultT(std::max(-1.0f, std::min(32767.0f / 32768.0f, out[j])));
+            }
+            dst += n;
+            src += n;
+            nSamples -= n;
+        }
+    }
+
+    void
+    Soundboard::computeImpulseResponse(float *ir, size_t n) const
+    {
+        // 固定小数点のままだと大きな入力で積があふれるので、同じ係数で update() と同じ式を float で回す
+        std::vector<float> lines[8];
+        float b0[8];
+        float ma1[8];
+        for (int i = 0; i < 8; ++i)
+        {
+            lines[i].assign(getDelayLength(i), 0.0f);
+            b0[i] = float(filters_[i].decay.constant.getB0());
+            ma1[i] = float(filters_[i].decay.constant.getMA1());
+        }
+        const float a = float(a_);
+        const float scale = float(scale_);
+
+        float o[8]{};
+        float h[8]{};
+        float ot = 0;
+        for (size_t j = 0; j < n; ++j)
+        {
+            const float t = a * ot + (j ? 0.0f : 1.0f);
+            const float po0 = o[0];
+            for (int i = 0; i < 8; ++i)
+            {
+                auto &line = lines[i];
+                auto &v = line[j % line.size()];
+                const float x = v;
+                v = t + (i < 7 ? o[i + 1] : po0);
+                o[i] = h[i] + b0[i] * x;
+                h[i] = ma1[i] * o[i];
+            }
+
+            const float oe = o[0] + o[2] + o[4] + o[6];
+            const float oo = o[1] + o[3] + o[5] + o[7];
+            ir[j] = (oe - oo) * scale;
+            ot = oe + oo;
+        }
+    }
 #endif
-            ValueT oo, oe;
+
+    void
+    Soundboard::beginParts(size_t nSamples)
+    {
+        // 後半の出力を 1 ブロック先に作るには、遅延が 2 ブロック以上いる
+        assert(getDelayLength(8 - N_BACK) >= nSamples * 2);
+
+        partPending_ = false;
+        computeBackAhead(partBank_, nSamples);
+    }
+
+    void
+    Soundboard::updatePart(int part, const ValueT *src, size_t nSamples, const ValueT *side)
+    {
+        static_assert(N_PARTS == 2, "");
+        assert(partBlockSize_ == nSamples || !partPending_);
+        if (part == 0)
+        {
+            updateFront(src, side, nSamples);
+        }
+        else
+        {
+            updateBack(src, side, nSamples);
+        }
+    }
+
+    void
+    Soundboard::updateFront(const ValueT *src, const ValueT *side, size_t nSamples)
+    {
+        auto &b = partBanks_[partBank_];
+        b.frontFeedback.resize(nSamples);
+        b.frontHead.resize(nSamples);
+        auto &out = partOut_[0];
+        out.resize(nSamples);
+        auto &outSide = partSide_[0];
+        outSide.resize(nSamples);
+
+        for (size_t j = 0; j < nSamples; ++j)
+        {
+            // 後半の o は前のブロックで作ってある
+            ValueT ot;
+            add(ot, o_[0], o_[1]);
+            add(ot, ot, o_[2]);
+            add(ot, ot, o_[3]);
+            for (int k = 0; k < N_BACK; ++k)
+            {
+                add(ot, ot, b.backOut[k][j]);
+            }
+
+            ValueT t;
+            mul(t, ot, a_);
+            b.frontFeedback[j] = t;
+            b.frontHead[j] = o_[0];
+            add(t, t, src[j]);
+
+            // 左右差は update() と同じ符号の組 (枝 0, 1 が +、2, 3 が -)
+            ValueT tp = t;
+            ValueT tm = t;
+            if (side)
+            {
+                add(tp, t, side[j]);
+                sub(tm, t, side[j]);
+            }
+
+            o_[0] = compute(tp, o_[1], filters_[0]);
+            o_[1] = compute(tp, o_[2], filters_[1]);
+            o_[2] = compute(tm, o_[3], filters_[2]);
+            o_[3] = compute(tm, b.backOut[0][j], filters_[3]);
+
+            ValueT oe, oo;
             add(oe, o_[0], o_[2]);
-            add(oe, oe, o_[4]);
-            add(oe, oe, o_[6]);
             add(oo, o_[1], o_[3]);
-            add(oo, oo, o_[5]);
-            add(oo, oo, o_[7]);
+            sub(out[j], oe, oo);
+
+            ValueT sp, sm;
+            add(sp, o_[0], o_[1]);
+            add(sm, o_[2], o_[3]);
+            sub(outSide[j], sp, sm);
+        }
+    }
+
+    void
+    Soundboard::updateBack(const ValueT *src, const ValueT *side, size_t nSamples)
+    {
+        if (partPending_)
+        {
+            addFrontFeedback();
+        }
+
+        // このブロックの入力のうち後半だけでわかる分を書いておく
+        // 前半からの分 (全体のフィードバックと o_[0]) は次のブロックの頭で足す
+        const auto &b = partBanks_[partBank_];
+        for (int k = 0; k < N_BACK; ++k)
+        {
+            const int i = 8 - N_BACK + k;
+            auto &delay = filters_[i].delay;
+            const auto blk = delay.getBlock(getDelayLength(i));
+            for (size_t j = 0; j < nSamples; ++j)
+            {
+                ValueT in = src[j];
+                if (side)
+                {
+                    // 枝 4, 5 が +、6, 7 が -
+                    if (i & 2)
+                    {
+                        sub(in, in, side[j]);
+                    }
+                    else
+                    {
+                        add(in, in, side[j]);
+                    }
+                }
+
+                if (k + 1 < N_BACK)
+                {
+                    add(blk.write(j), in, b.backOut[k + 1][j]);
+                }
+                else
+                {
+                    blk.write(j) = in;
+                }
+            }
+            delay.advance(nSamples);
+        }
+
+        auto &out = partOut_[1];
+        out.resize(nSamples);
+        auto &outSide = partSide_[1];
+        outSide.resize(nSamples);
+        for (size_t j = 0; j < nSamples; ++j)
+        {
+            ValueT oe, oo;
+            add(oe, b.backOut[0][j + 1], b.backOut[2][j + 1]);
+            add(oo, b.backOut[1][j + 1], b.backOut[3][j + 1]);
+            sub(out[j], oe, oo);
+
+            ValueT sp, sm;
+            add(sp, b.backOut[0][j + 1], b.backOut[1][j + 1]);
+            add(sm, b.backOut[2][j + 1], b.backOut[3][j + 1]);
+            sub(outSide[j], sp, sm);
+        }
+
+        computeBackAhead(partBank_ ^ 1, nSamples);
+    }
+
+    void
+    Soundboard::computeBackAhead(int bank, size_t nSamples)
+    {
+        auto &b = partBanks_[bank];
+        for (int k = 0; k < N_BACK; ++k)
+        {
+            const int i = 8 - N_BACK + k;
+            auto &f = filters_[i];
+            backO_[k] = o_[i];
+            backDecay_[k] = f.decay.state;
 
+            // 遅延が 2 ブロック以上あるので、読み出すのは前のブロックまでに書いた位置だけ
+            auto &out = b.backOut[k];
+            out.resize(nSamples + 1);
+            out[0] = o_[i];
+            const auto blk = f.delay.getBlock(getDelayLength(i));
+            for (size_t j = 0; j < nSamples; ++j)
+            {
+                out[j + 1] = f.decay.filter(blk.read(j));
+            }
+            o_[i] = out[nSamples];
+        }
+    }
+
+    void
+    Soundboard::addFrontFeedback()
+    {
+        // 前のブロックで書いた位置はまだ読み出していないので、足せば update() と同じになる
+        const auto &b = partBanks_[partBank_ ^ 1];
+        const size_t n = partBlockSize_;
+        for (int k = 0; k < N_BACK; ++k)
+        {
+            const int i = 8 - N_BACK + k;
+            const auto blk = filters_[i].delay.getBlock(n);
+            for (size_t j = 0; j < n; ++j)
+            {
+                auto &v = blk.buffer[wrapDelayIndex(blk.readPos + j, blk.size)];
+                add(v, v, b.frontFeedback[j]);
+                if (k + 1 == N_BACK)
+                {
+                    add(v, v, b.frontHead[j]);
+                }
+            }
+        }
+        partPending_ = false;
+    }
+
+    void
+    Soundboard::mixParts(ResultT *dst, size_t nSamples)
+    {
+        for (size_t j = 0; j < nSamples; ++j)
+        {
             ValueT r;
-            sub(r, oe, oo);
-            add(ot_, oe, oo);
+            add(r, partOut_[0][j], partOut_[1][j]);
+            mul(dst[j], r, scale_);
+        }
+
+        finishParts(nSamples);
+    }
+
+    void
+    Soundboard::mixParts(ResultT *left, ResultT *right, size_t nSamples)
+    {
+        for (size_t j = 0; j < nSamples; ++j)
+        {
+            ValueT r, d;
+            add(r, partOut_[0][j], partOut_[1][j]);
+            add(d, partSide_[0][j], partSide_[1][j]);
+            mixStereo(left[j], right[j], r, d, scale_, sideScale_);
+        }
+
+        finishParts(nSamples);
+    }
+
+    void
+    Soundboard::finishParts(size_t nSamples)
+    {
+        partBank_ ^= 1;
+        partPending_ = true;
+        partBlockSize_ = nSamples;
+    }
 
-            ResultT rs;
-            mul(*dst, r, scale_);
+    void
+    Soundboard::endParts()
+    {
+        if (partPending_)
+        {
+            addFrontFeedback();
+        }
 
-            ++dst;
-            ++src;
-            --nSamples;
+        // 1 ブロック先に進めた後半を戻す
+        for (int k = 0; k < N_BACK; ++k)
+        {
+            const int i = 8 - N_BACK + k;
+            o_[i] = backO_[k];
+            filters_[i].decay.state = backDecay_[k];
+        }
+
+        ot_ = o_[0];
+        for (int i = 1; i < 8; ++i)
+        {
+            add(ot_, ot_, o_[i]);
         }
     }
 
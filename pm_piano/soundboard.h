@@ -9,9 +9,12 @@
 #include "filter.h"
 #include "fixed.h"
 #include "sys_params.h"
+#if PICO_PIANO_HOST
+#include "partitioned_convolver.h"
+#endif
 #include <vector>
 
-#include <pico/platform.h>
+#include "platform.h"
 
 namespace physical_modeling_piano
 {
@@ -52,8 +55,71 @@ namespace physical_modeling_piano
         void initialize(const SystemParameters &sysParams);
         void setScale(float s);
 
+        // 枝 i の遅延線のバッファの長さ [サンプル]
+        size_t getDelayBufferLength(int i) const { return filters_[i].delay.getSize(); }
+
         void __time_critical_func(update)(ResultT *dst, const ValueT *src, size_t nSamples);
 
+        // ステレオ出力 (響板は 1 つのまま)
+        // update() の出力 (偶数番の枝 - 奇数番の枝) を中央に置き、それと直交する符号の組
+        // (枝 0, 1, 4, 5 - 枝 2, 3, 6, 7) を左右差として左に足して右から引く
+        // side は弦の出力の左右差で、同じ符号の組で各枝に入れる (nullptr なら入れない)
+        void __time_critical_func(updateStereo)(ResultT *left, ResultT *right,
+                                                const ValueT *src, const ValueT *side, size_t nSamples);
+        // 左右差の大きさ (0 でモノラル、1 で中央と同じ大きさ)
+        void setStereoWidth(float w);
+        float getStereoWidth() const { return stereoWidth_; }
+
+#if PICO_PIANO_HOST
+        // 8 本の遅延線 (FDN) の代わりに、インパルス応答との畳み込みを響板にする
+        // ir は src から dst までの応答 (setScale の分も含む) で、partitionSize は 4 以上の 2 のべき
+        // 出力は遅れないが、partitionSize サンプルごとに FFT の処理がまとまって来る
+        // ir が空なら FDN に戻す。update() と同じスレッドから呼ぶ
+        void setImpulseResponse(const float *ir, size_t irLength, size_t partitionSize);
+        const PartitionedConvolver &getConvolver() const { return convolver_; }
+
+        // この響板 (FDN) のインパルス応答を先頭から n サンプル作る (initialize() の後に呼ぶ)
+        void computeImpulseResponse(float *ir, size_t n) const;
+#endif
+        // 畳み込みのときは updatePart() は使えない
+        bool isConvolution() const
+        {
+#if PICO_PIANO_HOST
+            return !convolver_.isEmpty();
+#else
+            return false;
+#endif
+        }
+
+        // 8 本の枝を前半 [0, 4) と後半 [4, 8) に分けて、別々のコアで処理する
+        // 後半の枝は遅延が 2 ブロック以上あるので、次のブロックの出力を 1 ブロック前に作っておける
+        // 前半はそれを使って update() と同じ順にサンプル単位で処理する
+        // 後半の遅延線に入る前半からのフィードバックは、次のブロックの頭でまだ読み出していない位置に足し込む
+        // どちらも加算の順番が変わるだけなので、固定小数点では update() と同じ出力になる
+        // 最初のブロックの前に beginParts()、毎ブロック updatePart() を全部の part について呼んでから mixParts()
+        static constexpr int N_PARTS = 2;
+        void __time_critical_func(beginParts)(size_t nSamples);
+        void __time_critical_func(updatePart)(int part, const ValueT *src, size_t nSamples,
+                                              const ValueT *side = nullptr);
+        void __time_critical_func(mixParts)(ResultT *dst, size_t nSamples);
+        void __time_critical_func(mixParts)(ResultT *left, ResultT *right, size_t nSamples);
+        // update() に戻る前に呼ぶ
+        void __time_critical_func(endParts)();
+
+    protected:
+        template <bool STEREO>
+        void __time_critical_func(updateSpans)(ResultT *dst, ResultT *right,
+                                               const ValueT *src, const ValueT *side, size_t nSamples);
+
+        void __time_critical_func(updateFront)(const ValueT *src, const ValueT *side, size_t nSamples);
+        void __time_critical_func(updateBack)(const ValueT *src, const ValueT *side, size_t nSamples);
+        void __time_critical_func(finishParts)(size_t nSamples);
+        void __time_critical_func(computeBackAhead)(int bank, size_t nSamples);
+        void __time_critical_func(addFrontFeedback)();
+#if PICO_PIANO_HOST
+        void updateConvolution(ResultT *dst, const ValueT *src, size_t nSamples);
+#endif
+
     private:
         Filters filters_[8];
         // DelayStateT delays_[8];
@@ -63,8 +129,36 @@ namespace physical_modeling_piano
         ValueT ot_{};
         CoefT a_{};
         ScaleT scale_{}; // 1/8含む
+        ScaleT sideScale_{};
+        float scaleValue_ = 0;
+        float stereoWidth_ = 1.0f;
 
         // FilterT decay_[8];
+
+        static constexpr int N_BACK = 4;
+
+        // 前後の半分でやりとりするもの
+        // ブロック k で書いたものをブロック k + 1 で読むので、2 組を交互に使う
+        struct PartBank
+        {
+            std::vector<ValueT> backOut[N_BACK]; // [0] が 1 サンプル前、[1..n] がこのブロックの後半の o
+            std::vector<ValueT> frontFeedback;   // 全体のフィードバック (1 サンプル前の o の和 * a_)
+            std::vector<ValueT> frontHead;       // 1 サンプル前の o_[0] (o_[7] の隣)
+        };
+        PartBank partBanks_[2];
+        int partBank_ = 0;         // このブロックで読む backOut と書く front*
+        bool partPending_ = false; // 前のブロックの front* をまだ後半に足し込んでいない
+        size_t partBlockSize_ = 0;
+        std::vector<ValueT> partOut_[N_PARTS];  // 偶数番の枝 - 奇数番の枝
+        std::vector<ValueT> partSide_[N_PARTS]; // 左右差 (updateStereo と同じ符号の組)
+
+        // 後半を先に進める前の状態 (endParts() で戻す)
+        ValueT backO_[N_BACK]{};
+        decltype(FilterT::state) backDecay_[N_BACK]{};
+
+#if PICO_PIANO_HOST
+        PartitionedConvolver convolver_;
+#endif
     };
 
 } // namespace physical_modeling_piano
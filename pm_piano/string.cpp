@@ -4,17 +4,19 @@
  */
 
 #include "string.h"
+#include "coefficients.h"
 #include "sys_params.h"
 #include <algorithm>
+#include <math.h>
 
 namespace physical_modeling_piano
 {
 
 void
 String::initialize(
-    float f, float B, float Z, float Zb, const SystemParameters& sysParams)
+    float f, float B, float Z, float Zb, const SystemParameters& sysParams, int decimation)
 {
-    float Fs         = sysParams.sampleRate;
+    float Fs         = float(sysParams.sampleRate) / decimation;
     float delayTotal = Fs / f;
     auto delay1 =
         std::max(1, (int)(sysParams.hammerPosition * 0.5f * delayTotal));
@@ -22,7 +24,7 @@ String::initialize(
     M_ = (f > 400) ? 1 : 4;
     for (int i = 0; i < M_; ++i)
     {
-        dispersion_[i].initialize(B, f, M_);
+        dispersion_[i].initialize(B, f, M_, Fs * decimation, decimation);
     }
     for (int i = M_; i < 4; ++i)
     {
@@ -30,7 +32,7 @@ String::initialize(
     }
     float dispersionDelay = M_ * dispersion_[0].computeGroupDelay(f, Fs);
 
-    lowpass_.initialize(f, Fs, sysParams.stringLossC1, sysParams.stringLossC3);
+    lowpass_.initialize(f, Fs, sysParams.stringLossC1, sysParams.stringLossC3, decimation);
     float lowpassDelay = lowpass_.computeGroupDelay(f, Fs);
 
     int delay2 =
@@ -66,10 +68,54 @@ String::initialize(
            D);
 #endif
 
-    d0a_.initialize(delay1);
-    d0b_.initialize(delay1);
-    d1a_.initialize(delay2);
-    d1b_.initialize(delay3);
+    // 詳細度を落としたときの構成
+    // 分数遅延は 1 次の Thirian で端数 [1, 2) だけ扱い、残りの整数部は d1a に足す
+    // 分散フィルタを 1 段にしたときの群遅延の差も分数遅延側で吸収する
+    if (M_ > 1)
+    {
+        dispersionLow_.initialize(B, f, 1, Fs * decimation, decimation);
+    }
+    else
+    {
+        dispersionLow_ = dispersion_[0];
+    }
+    float dispersionDelayLow = dispersionLow_.computeGroupDelay(f, Fs);
+
+    delay1a_[0]   = delay2;
+    int maxDelay2 = delay2;
+    maxDetailLevel_ = 0;
+    for (int level = 1; level < N_DETAIL_LEVELS; ++level)
+    {
+        float Dl = D;
+        if (level >= 2)
+        {
+            Dl += dispersionDelay - dispersionDelayLow;
+        }
+        // d1a は 1 サンプルより短くできない
+        int k = std::max((int)floorf(Dl) - 1, 1 - delay2);
+        if (Dl - k < 0.5f)
+        {
+            // 1 次で扱えない
+            break;
+        }
+        fracDelayLow_[level - 1].initialize(Dl - k);
+        delay1a_[level] = delay2 + k;
+        maxDelay2 = std::max(maxDelay2, delay2 + k);
+        maxDetailLevel_ = level;
+    }
+
+    delay0_     = delay1;
+    delay1aMax_ = maxDelay2;
+    delay1b_    = delay3;
+    tap0b_      = delay0_ * 2;
+    tap1b_      = tap0b_ + delay1aMax_;
+    ringSize_   = tap1b_ + delay1b_;
+
+    minBlockDelay_ = std::min({delay0_, delay1a_[0], delay1b_});
+    for (int level = 1; level <= maxDetailLevel_; ++level)
+    {
+        minBlockDelay_ = std::min<size_t>(minBlockDelay_, delay1a_[level]);
+    }
 
     float alpha12 = 2 * Z / (Z + Zb);
     alpha12_      = alpha12;
@@ -81,13 +127,447 @@ String::initialize(
     //        alpha12_.get());
 }
 
+template <class IO>
+void
+String::transferCoefficients(IO& io)
+{
+    io.value(delay0_);
+    io.value(delay1aMax_);
+    io.value(delay1b_);
+    io.value(tap0b_);
+    io.value(tap1b_);
+    io.value(ringSize_);
+    io.value(alpha12_);
+    io.value(minBlockDelay_);
+    io.value(M_);
+    for (auto& f : dispersion_)
+    {
+        f.transferCoefficients(io);
+    }
+    lowpass_.transferCoefficients(io);
+    fracDelay_.transferCoefficients(io);
+    dispersionLow_.transferCoefficients(io);
+    for (auto& f : fracDelayLow_)
+    {
+        f.transferCoefficients(io);
+    }
+    for (auto& d : delay1a_)
+    {
+        io.value(d);
+    }
+    io.value(maxDetailLevel_);
+}
+
+template void String::transferCoefficients(CoefficientWriter& io);
+template void String::transferCoefficients(CoefficientReader& io);
+
 String::State::State() {}
 
-size_t
-String::getStateSize() const
+void
+String::setDetailLevel(State& s, int level) const
+{
+    level = std::min(level, (int)maxDetailLevel_);
+    if (level == s.detailLevel)
+    {
+        return;
+    }
+
+    // 1 段にした分散フィルタは dispersion[0] の状態を引き継ぐ
+    if ((level >= 2) != (s.detailLevel >= 2))
+    {
+        for (int i = 1; i < 4; ++i)
+        {
+            s.dispersion[i].clear();
+        }
+    }
+    // 1 次の分数遅延は先頭の状態だけ使う
+    if ((level >= 1) != (s.detailLevel >= 1))
+    {
+        for (size_t i = 1; i < s.fracDelay.state.size(); ++i)
+        {
+            s.fracDelay.state[i] = 0;
+        }
+    }
+    if (delay1a_[level] != delay1a_[s.detailLevel])
+    {
+        s.fadeDelay1a   = delay1a_[s.detailLevel];
+        s.fadeRemaining = DELAY1A_FADE_SAMPLES;
+    }
+    s.detailLevel = level;
+}
+
+void
+String::fadeDelay1aBlock(const State& s, DelaySampleT* buf, size_t n) const
+{
+    // どちらの位置もブロックの長さより遠いので、ブロックの前に書いたものだけを読む
+    const auto t1a  = s.ring.getTap(tap0b_ + getDelay1a(s));
+    const auto prev = s.ring.getTap(tap0b_ + s.fadeDelay1a);
+    auto ds         = s.delayScale; // 書いた値の記録は遅延線のものではないので捨てる
+    for (size_t i = 0; i < n; ++i)
+    {
+        const int remaining = std::max<int>(s.fadeRemaining - (int)i, 0);
+        buf[i] = ds.store(crossfadeDelay1a(ds.load(t1a.at(i)), ds.load(prev.at(i)), remaining));
+    }
+}
+
+uint32_t
+String::estimateCost(const State& s) const
+{
+    // 遅延線と損失フィルタで 4、分散フィルタ 1 段で 3、分数遅延フィルタ 1 次で 1 (ホストで測った比)
+    const int stages = s.detailLevel >= 2 ? 1 : M_;
+    const int frac   = s.detailLevel >= 1 ? 1 : (int)fracDelay_.getDim();
+    return 4 + 3 * stages + frac;
+}
+
+void
+String::prepareBlock(State& s,
+                     size_t n,
+                     StringSampleT* hammerVelocity,
+                     StringSampleT* bridgeVelocity) const
+{
+    const auto t1b = s.ring.getTap(0);
+    const auto t0b = s.ring.getTap(tap0b_);
+    const auto t1a = s.ring.getTap(tap0b_ + getDelay1a(s));
+    const auto& ds = s.delayScale;
+
+    DelaySampleT faded1a[MAX_BLOCK_SIZE];
+    if (s.fadeRemaining)
+    {
+        fadeDelay1aBlock(s, faded1a, n);
+    }
+    auto read1a = [&](size_t i) { return ds.load(s.fadeRemaining ? faded1a[i] : t1a.at(i)); };
+
+    // ハンマーは前のサンプルの出力を見る
+    if (hammerVelocity)
+    {
+        add(hammerVelocity[0], hammerVelocity[0], getHammerInputVelocity(s));
+        for (size_t i = 1; i < n; ++i)
+        {
+            StringSampleT v0b;
+            neg(v0b, ds.load(t0b.at(i - 1)));
+            StringSampleT v;
+            add(v, v0b, read1a(i - 1));
+            add(hammerVelocity[i], hammerVelocity[i], v);
+        }
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        add(bridgeVelocity[i], bridgeVelocity[i], ds.load(t1b.at(i)));
+    }
+
+    neg(s.prev0b, ds.load(t0b.at(n - 1)));
+    s.prev1a = read1a(n - 1);
+}
+
+void
+String::updateBlock(SampleT* out,
+                    State& s,
+                    const BridgeSampleT* bridgeLoad,
+                    const HammerLoadT* hammerLoad,
+                    size_t n) const
 {
-    return d0a_.getStateSize() + d0b_.getStateSize() + d1a_.getStateSize() +
-           d1b_.getStateSize();
+    if (s.detailLevel >= 2)
+    {
+        updateBlockImpl<1>(out, s, &dispersionLow_, bridgeLoad, hammerLoad, n);
+    }
+    else if (M_ == 4)
+    {
+        updateBlockImpl<4>(out, s, dispersion_, bridgeLoad, hammerLoad, n);
+    }
+    else
+    {
+        updateBlockImpl<1>(out, s, dispersion_, bridgeLoad, hammerLoad, n);
+    }
 }
 
+template <int M>
+void
+String::updateBlockImpl(SampleT* out,
+                        State& s,
+                        const ThirianDispersionFilterT* dispersionFilter,
+                        const BridgeSampleT* bridgeLoad,
+                        const HammerLoadT* hammerLoad,
+                        size_t n) const
+{
+    // リングの並びは string.h の private を参照
+    const auto t0  = s.ring.getTap(0);      // D0a に書く / D1b から読む
+    const auto t0b = s.ring.getTap(tap0b_); // D0b から読む / D1a に書く
+    const auto t1a = s.ring.getTap(tap0b_ + getDelay1a(s));
+    const auto t1b = s.ring.getTap(tap1b_);
+
+    // フィルタの状態はブロックの間ローカルに持つ
+    // M 段目以降の分散フィルタは素通しなので省略する
+    ThirianDispersionFilterT::State dispersion[M];
+    for (int i = 0; i < M; ++i)
+    {
+        dispersion[i] = s.dispersion[i];
+    }
+    auto lowpass = s.lowpass;
+    auto ds      = s.delayScale;
+
+    // 分数遅延フィルタは次数ごとに分岐するのでブロックの後でまとめてかける
+    StringSampleT tmp1a[MAX_BLOCK_SIZE];
+
+    // d1a の読み出し位置を移っている間は、混ぜたものを先に作ってそこから読む
+    DelaySampleT faded1a[MAX_BLOCK_SIZE];
+    const bool fading = s.fadeRemaining != 0;
+    if (fading)
+    {
+        fadeDelay1aBlock(s, faded1a, n);
+    }
+
+    // 書き込み先は同じ位置か読み終わった位置にしか重ならないので、
+    // 1 サンプルごとに先に全部読んでおけばよい
+    // どのタップも折り返さない区間ごとにポインタで回す
+    for (size_t i0 = 0; i0 < n;)
+    {
+        const size_t m = std::min({n - i0,
+                                   t0.getContiguous(i0),
+                                   t0b.getContiguous(i0),
+                                   fading ? n - i0 : t1a.getContiguous(i0),
+                                   t1b.getContiguous(i0)});
+        auto* p0        = t0.ptr(i0);
+        const auto* r0b = t0b.ptr(i0);
+        const auto* r1a = fading ? faded1a + i0 : t1a.ptr(i0);
+        auto* w1b       = t1b.ptr(i0);
+
+        for (size_t k = 0; k < m; ++k)
+        {
+            const size_t i = i0 + k;
+
+            StringSampleT v0b;
+            neg(v0b, ds.load(r0b[k]));
+            StringSampleT v1a = ds.load(r1a[k]);
+            StringSampleT v1b = ds.load(p0[k]);
+
+            StringSampleT loadH;
+            add(loadH, v0b, v1a);
+            add(loadH, loadH, hammerLoad[i]);
+
+            BridgeSampleT loadB;
+            mul(loadB, alpha12_, v1b);
+
+            BridgeSampleT loadB1d;
+            add(loadB1d, loadB, bridgeLoad[i]);
+            StringSampleT loadB1 = loadB1d;
+
+            StringSampleT in0a;
+            sub(in0a, loadH, v0b);
+            p0[k] = ds.store(in0a);
+
+            StringSampleT tmp1b;
+            sub(tmp1b, loadH, v1a);
+            FilterSampleT yh = tmp1b;
+            for (int j = 0; j < M; ++j)
+            {
+                yh = dispersionFilter[j].filter(yh, dispersion[j]);
+            }
+            w1b[k] = ds.store(yh);
+
+            StringSampleT vb;
+            sub(vb, loadB1, v1b);
+            FilterSampleT yb = vb;
+            tmp1a[i] = lowpass_.filter(yb, lowpass);
+
+            add(out[i], out[i], loadB);
+        }
+        i0 += m;
+    }
+
+    for (int i = 0; i < M; ++i)
+    {
+        s.dispersion[i] = dispersion[i];
+    }
+    s.lowpass = lowpass;
+
+    if (s.detailLevel)
+    {
+        const auto& c = fracDelayLow_[s.detailLevel - 1].getCoefficients();
+        c.filterBlock<1, FilterSampleT>(tmp1a, n, s.fracDelay.data());
+    }
+    else
+    {
+        fracDelay_.filterBlock(tmp1a, n, s.fracDelay);
+    }
+    for (size_t i0 = 0; i0 < n;)
+    {
+        const size_t m = std::min(n - i0, t0b.getContiguous(i0));
+        auto* w1a      = t0b.ptr(i0);
+        for (size_t k = 0; k < m; ++k)
+        {
+            w1a[k] = ds.store(tmp1a[i0 + k]);
+        }
+        i0 += m;
+    }
+
+    s.delayScale    = ds;
+    s.fadeRemaining = std::max<int>(s.fadeRemaining - (int)n, 0);
+    s.ring.advance(n);
+}
+
+namespace
+{
+// n 本の平均
+// 割り込みの中で呼ばれるので、固定小数点は生の値を整数で足して 1/n (Q30) を掛ける
+class Average
+{
+    int32_t recip_;
+    float scale_;
+
+public:
+    explicit Average(int n)
+        : recip_(int32_t(((1u << 30) + n / 2) / n))
+        , scale_(1.0f / n)
+    {
+    }
+
+    template <class T, int S>
+    static int64_t raw(const FixedPoint<T, S>& v)
+    {
+        return v.get();
+    }
+    static float raw(float v) { return v; }
+
+    template <class T, int S>
+    void set(FixedPoint<T, S>& dst, int64_t sum) const
+    {
+        dst.set(T((sum * recip_ + (int64_t(1) << 29)) >> 30));
+    }
+    void set(float& dst, float sum) const { dst = sum * scale_; }
+};
+} // namespace
+
+void
+String::mergeStates(const String* strings, State* states, int n)
+{
+    const Average avg(n);
+    auto average = [&](auto get) {
+        auto sum = Average::raw(get(states[0]));
+        for (int i = 1; i < n; ++i)
+        {
+            sum += Average::raw(get(states[i]));
+        }
+        decltype(get(states[0])) r;
+        avg.set(r, sum);
+        return r;
+    };
+
+    auto& dst  = states[0];
+    dst.prev0b = average([](const State& s) { return s.prev0b; });
+    dst.prev1a = average([](const State& s) { return s.prev1a; });
+
+    // 遅延線の指数は弦ごとに違うので、それぞれの指数で読んで、先頭の弦には一番粗い指数で書く
+    assert(n <= 3);
+    DelayScale scales[3];
+    for (int i = 0; i < n; ++i)
+    {
+        scales[i] = states[i].delayScale;
+    }
+#if USE_COMPACT_DELAY
+    dst.delayScale = {};
+    dst.delayScale.shift = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        dst.delayScale.shift = std::max(dst.delayScale.shift, scales[i].shift);
+    }
+#endif
+
+    // 遅延線ごとに、先頭の弦の分を書き換える前に同じ位置を読み終える
+    // 弦ごとに遅延の長さが違うので、短い遅延線はそこにある一番古いものを使う
+    // D0b は D0a に書いたものを符号を変えて読むが、平均は符号を変えても同じなので語のまま平均する
+    for (int rail = 0; rail < 4; ++rail)
+    {
+        auto tapOf = [rail](const String& str, size_t age) {
+            const size_t base[] = {0, str.delay0_, str.tap0b_, str.tap1b_};
+            return base[rail] + std::min(age, str.getRailLength(rail));
+        };
+        const size_t length = strings[0].getRailLength(rail);
+        for (size_t age = 1; age <= length; ++age)
+        {
+            auto sum = Average::raw(StringSampleT{});
+            for (int i = 0; i < n; ++i)
+            {
+                sum += Average::raw(scales[i].load(states[i].ring.tap(tapOf(strings[i], age))));
+            }
+            StringSampleT v;
+            avg.set(v, sum);
+            dst.ring.tap(tapOf(strings[0], age)) = dst.delayScale.store(v);
+        }
+    }
+
+    for (int j = 0; j < 4; ++j)
+    {
+        for (size_t k = 0; k < dst.dispersion[j].state.size(); ++k)
+        {
+            dst.dispersion[j].state[k] =
+                average([&](const State& s) { return s.dispersion[j].state[k]; });
+        }
+    }
+    dst.lowpass.h0 = average([](const State& s) { return s.lowpass.h0; });
+    for (size_t k = 0; k < dst.fracDelay.state.size(); ++k)
+    {
+        dst.fracDelay.state[k] =
+            average([&](const State& s) { return s.fracDelay.state[k]; });
+    }
+}
+
+
+#if USE_COMPACT_DELAY
+void
+String::setInitialDelayScale(State& s, float v) const
+{
+    // 弦の振幅はおおよそ打鍵の速さに比例する
+    const int d = v > 0 ? (int)ceilf(log2f(v / DelayScale::INITIAL_VELOCITY)) : -DelayScale::INITIAL_SHIFT;
+    s.delayScale.shift = std::max(0, std::min(DelayScale::INITIAL_SHIFT + d, DelayScale::INITIAL_SHIFT));
+}
+
+void
+String::updateDelayScale(State& s, size_t n, bool hold) const
+{
+    auto& ds = s.delayScale;
+    ds.peakSamples += n;
+
+    int d = 0; // shift の増分
+    if (ds.peak >= DelayScale::PEAK_HIGH)
+    {
+        const int bits = 32 - clz(ds.peak);
+        d = std::min(bits - DelayScale::PEAK_BITS, DelayScale::MAX_SHIFT - ds.shift);
+    }
+    else if (ds.peakSamples >= ringSize_)
+    {
+        // リングを 1 周したので、いま置いてある値は全部 peak に入っている
+        if (!hold && ds.peak < DelayScale::PEAK_LOW)
+        {
+            const int bits = 32 - clz(ds.peak);
+            d = -std::min(DelayScale::PEAK_BITS - bits, int(ds.shift));
+        }
+        ds.peak = 0;
+        ds.peakSamples = 0;
+    }
+    if (!d)
+    {
+        return;
+    }
+
+    auto* p = s.ring.getBuffer();
+    if (d > 0)
+    {
+        const int32_t round = (1 << d) >> 1;
+        for (size_t i = 0; i < ringSize_; ++i)
+        {
+            p[i] = DelaySampleT((p[i] + round) >> d);
+        }
+        ds.peak >>= d;
+    }
+    else
+    {
+        for (size_t i = 0; i < ringSize_; ++i)
+        {
+            p[i] = DelaySampleT(p[i] << -d);
+        }
+    }
+    ds.shift += d;
+}
+#endif
+
 } // namespace physical_modeling_piano
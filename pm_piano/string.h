@@ -13,13 +13,15 @@
 #include <algorithm>
 #include <array>
 
-#include <pico/platform.h>
+#include "platform.h"
 
 namespace physical_modeling_piano
 {
 
     class String
     {
+        friend class VoiceBank;
+
     public:
 #if USE_FIXED_POINT
         using BridgeSampleT = FixedPoint<int32_t, 25>;
@@ -53,151 +55,270 @@ namespace physical_modeling_piano
         using ThirianFilterT =
             ThirianFilter<7, FilterConstT, FilterHistoryT, FilterSampleT>;
 
-        class DelayNode
-        {
-        public:
-            struct State
-            {
-                StringSampleT in{}; // 更新タイミングでdelayに入れてしまえば不要
-                StringSampleT out{};
-                DelayState<StringSampleT> delay;
+        using FirstOrderThirianFilterT =
+            FirstOrderThirianFilter<FilterConstT, FilterHistoryT>;
 
-            public:
-                const StringSampleT &getOut() const { return out; }
-                void setIn(const StringSampleT &y) { in = y; }
-            };
+#if USE_COMPACT_DELAY
+        using DelaySampleT = int16_t;
+#else
+        using DelaySampleT = StringSampleT;
+#endif
 
-        public:
-            void initialize(int d)
+        // 遅延線に置く値と StringSampleT の変換
+        // USE_COMPACT_DELAY のときは shift ビット右にずらして 16bit に丸めて置く
+        // shift は書いた値の大きさを見て updateDelayScale() で弦ごとに合わせる
+        struct DelayScale
+        {
+#if USE_COMPACT_DELAY
+            static constexpr int MAX_SHIFT = 16;
+            static constexpr int INITIAL_SHIFT = 11; // いちばん強く打っても 2^24 未満なので 2^13 に収まる
+            static constexpr float INITIAL_VELOCITY = 10; // INITIAL_SHIFT にする打鍵の速さ [m/s]
+            static constexpr int PEAK_BITS = 13;     // shift を変えた後の大きさの上限
+            static constexpr uint32_t PEAK_HIGH = 1u << 14;
+            static constexpr uint32_t PEAK_LOW = 1u << 12;
+
+            uint8_t shift = INITIAL_SHIFT;
+            uint32_t peak{};        // 書いた値の絶対値の OR
+            uint32_t peakSamples{}; // peak を集め始めてからのサンプル数
+
+            StringSampleT load(DelaySampleT v) const
             {
-                delay_ = std::max(0, d - 1);
-                delayBufferSize_ = computeDelayBufferSize(delay_);
-                //            printf("d = %d/%d\n", delay_, delayBufferSize_);
-                assert(delay_ <= delayBufferSize_);
+                StringSampleT r;
+                r.set(int32_t(v) << shift);
+                return r;
             }
-            void __time_critical_func(update)(State &s) const { s.out = s.delay.update(s.in, delay_); }
 
-            void reset(State &s, SimpleLinearAllocator &allocator) const
+            DelaySampleT store(const StringSampleT &v)
             {
-                s.in = 0;
-                s.out = 0;
-                s.delay.attachBuffer(static_cast<StringSampleT *>(allocator.allocate(
-                                         delayBufferSize_ * sizeof(StringSampleT))),
-                                     delayBufferSize_);
-                s.delay.clear(delay_);
+                int32_t q = (v.get() + ((1 << shift) >> 1)) >> shift;
+                q = std::min(std::max(q, -32768), 32767);
+                peak |= q ^ (q >> 31);
+                return DelaySampleT(q);
             }
+#else
+            StringSampleT load(DelaySampleT v) const { return v; }
+            DelaySampleT store(const StringSampleT &v) { return v; }
+#endif
+        };
 
-            inline size_t getStateSize() const
-            {
-                return delayBufferSize_ * sizeof(StringSampleT);
-            }
+        // 詳細度 (0 が最高)
+        // 1: 分数遅延フィルタを 1 次にして、整数部は d1a の遅延に寄せる
+        // 2: さらに分散フィルタを 1 段にする (遅延の差は分数遅延側で埋める)
+        static constexpr int N_DETAIL_LEVELS = 3;
 
-        private:
-            uint16_t delay_{};
-            uint16_t delayBufferSize_{};
-        };
+        // 詳細度で d1a の遅延が変わるときに、前の位置から移るサンプル数
+        // 遅延線の中身は前の分数遅延で作ったものなので、そのまま読む位置を変えると波形が飛ぶ
+        static constexpr int DELAY1A_FADE_BITS = 5;
+        static constexpr int DELAY1A_FADE_SAMPLES = 1 << DELAY1A_FADE_BITS;
 
         struct State
         {
-            DelayNode::State d0a;
-            DelayNode::State d0b;
-            DelayNode::State d1a;
-            DelayNode::State d1b;
+            // 4 本の遅延線を続けて置いたリング (並びは String の private を参照)
+            DelayState<DelaySampleT> ring;
+            DelayScale delayScale;
+            // 直前のサンプルの d0b と d1a の出力 (ハンマーはこれを見る)
+            StringSampleT prev0b{};
+            StringSampleT prev1a{};
 
             ThirianDispersionFilterT::State dispersion[4];
             LossFilterT::State lowpass;
             ThirianFilterT::State fracDelay;
 
+            uint8_t detailLevel{};
+            // d1a の読み出し位置を変えた直後は、前の遅延 fadeDelay1a の位置と混ぜながら移る
+            // 残りのサンプル数 (0 なら移り終わっている)
+            uint16_t fadeDelay1a{};
+            uint8_t fadeRemaining{};
+
             State();
         };
 
     public:
+        // decimation: sampleRate / decimation のレートで回す (遅延とフィルタをそのレートで作る)
         void initialize(
-            float f, float B, float Z, float Zb, const SystemParameters &sysParams);
+            float f, float B, float Z, float Zb, const SystemParameters &sysParams, int decimation = 1);
+
+        // initialize() で決めたものの書き出し / 読み込み (coefficients.h)
+        template <class IO>
+        void transferCoefficients(IO &io);
+
+        // アロケータは 4 バイト単位で取る
+        size_t getStateSize() const { return (ringSize_ * sizeof(DelaySampleT) + 3) & ~size_t(3); }
 
-        size_t getStateSize() const;
+        // リングの中の各遅延線の長さ [サンプル] (0: d0a, 1: d0b, 2: d1a, 3: d1b)
+        size_t getRailLength(int i) const
+        {
+            const uint16_t lengths[] = {delay0_, delay0_, delay1aMax_, delay1b_};
+            return lengths[i];
+        }
 
         void reset(State &s, SimpleLinearAllocator &allocator) const
         {
-            d0a_.reset(s.d0a, allocator);
-            d0b_.reset(s.d0b, allocator);
-            d1a_.reset(s.d1a, allocator);
-            d1b_.reset(s.d1b, allocator);
+            s.ring.attachBuffer(static_cast<DelaySampleT *>(allocator.allocate(getStateSize())), ringSize_);
+            s.ring.clearAll();
+            s.delayScale = {};
+            s.prev0b = 0;
+            s.prev1a = 0;
 
             dispersion_[0].clear(s.dispersion[0]);
             lowpass_.clear(s.lowpass);
             fracDelay_.clear(s.fracDelay);
+            s.detailLevel = 0;
+            s.fadeRemaining = 0;
         }
 
-        inline StringSampleT getHammerInputVelocity(const State &s) const
+        // reset() で取った遅延線のバッファを from から to に移したので付け替える
+        void moveDelayMemory(State &s, const void *from, void *to) const
         {
+            const auto ofs = reinterpret_cast<const uint8_t *>(s.ring.getBuffer()) -
+                             static_cast<const uint8_t *>(from);
+            s.ring.setBuffer(reinterpret_cast<DelaySampleT *>(static_cast<uint8_t *>(to) + ofs));
+        }
+
+        // USE_COMPACT_DELAY のときの遅延線の指数 (それ以外では何もしない)
+#if USE_COMPACT_DELAY
+        // n サンプル回した後に呼ぶ
+        // 書いた値が大きくなったらすぐに粗くし、リング 1 周分の値が小さければ細かくする
+        // hold ならハンマーが当たっていてこれから大きくなるので細かくしない
+        void updateDelayScale(State &s, size_t n, bool hold) const;
+        // 打鍵の速さ v [m/s] から最初の指数を決める (reset() の後に呼ぶ)
+        void setInitialDelayScale(State &s, float v) const;
+#else
+        void updateDelayScale(State &, size_t, bool) const {}
+        void setInitialDelayScale(State &, float) const {}
+#endif
+
+        // 詳細度を切り替える
+        // 使わなくなるフィルタの状態は消しておく
+        void setDetailLevel(State &s, int level) const;
+        int getMaxDetailLevel() const { return maxDetailLevel_; }
+
+        // 1 サンプルあたりの処理量の目安 (相対値)
+        uint32_t estimateCost(const State &s) const;
+
+        // strings[i] の states[i] (i < n) を平均して states[0] にまとめる (ユニゾンの弦をまとめるとき)
+        // 遅延線は書き込み位置からの距離で揃える
+        static void mergeStates(const String *strings, State *states, int n);
+
+        // 詳細度に応じた d1a の遅延
+        size_t getDelay1a(const State &s) const { return delay1a_[s.detailLevel]; }
+
+        // d1a の出力 v に前の位置の出力 prev を remaining / DELAY1A_FADE_SAMPLES だけ混ぜる
+        static StringSampleT crossfadeDelay1a(const StringSampleT &v, const StringSampleT &prev, int remaining)
+        {
+#if USE_FIXED_POINT
             StringSampleT r;
-            add(r, s.d0b.getOut(), s.d1a.getOut());
+            r.set(v.get() + ((prev.get() - v.get()) >> DELAY1A_FADE_BITS) * remaining);
             return r;
+#else
+            return v + (prev - v) * (remaining * (1.0f / DELAY1A_FADE_SAMPLES));
+#endif
         }
 
-        inline StringSampleT getBridgeInputVelocity(const State &s) const
+        // 1 サンプル前の出力から (update() の前に呼ぶ)
+        inline StringSampleT getHammerInputVelocity(const State &s) const
         {
-            return s.d1b.getOut();
+            StringSampleT r;
+            add(r, s.prev0b, s.prev1a);
+            return r;
         }
 
-        inline void updateDelay(State &s) const
+        // このサンプルの出力 (update() の前に呼ぶ)
+        inline StringSampleT getBridgeInputVelocity(const State &s) const
         {
-            // update関数と統合したい
-            d0a_.update(s.d0a);
-            d0b_.update(s.d0b);
-            d1a_.update(s.d1a);
-            d1b_.update(s.d1b);
+            return s.delayScale.load(s.ring.tap(0));
         }
 
+        // 遅延線の読み書きもここでして、リングを 1 サンプル進める
         inline SampleT
         __time_critical_func(update)(State &s, BridgeSampleT bridgeLoad, HammerLoadT hammerLoad) const
         {
+            // 位置は先に決めておく (フィルタの状態への書き込みのたびに読み直さないように)
+            auto &r = s.ring;
+            auto &ds = s.delayScale;
+            DelaySampleT *p0 = &r.tap(0);
+            DelaySampleT *p0b = &r.tap(tap0b_);
+            const DelaySampleT *p1a = &r.tap(tap0b_ + getDelay1a(s));
+            DelaySampleT *p1b = &r.tap(tap1b_);
+
+            StringSampleT v0b;
+            neg(v0b, ds.load(*p0b));
+            StringSampleT v1a = ds.load(*p1a);
+            if (s.fadeRemaining)
+            {
+                v1a = crossfadeDelay1a(v1a, ds.load(r.tap(tap0b_ + s.fadeDelay1a)), s.fadeRemaining--);
+            }
+            const StringSampleT v1b = ds.load(*p0);
+
             StringSampleT loadH;
-            add(loadH, s.d0b.getOut(), s.d1a.getOut());
+            add(loadH, v0b, v1a);
             add(loadH, loadH, hammerLoad);
 
             BridgeSampleT loadB;
-            mul(loadB, alpha12_, s.d1b.getOut());
+            mul(loadB, alpha12_, v1b);
 
             BridgeSampleT loadB1d;
             add(loadB1d, loadB, bridgeLoad);
             StringSampleT loadB1 = loadB1d;
 
-            StringSampleT tmp0a;
-            sub(tmp0a, loadH, s.d0b.getOut());
-            s.d0a.setIn(tmp0a);
-
-            StringSampleT tmp0b;
-            neg(tmp0b, s.d0a.getOut());
-            s.d0b.setIn(tmp0b);
+            // 読み終えてから書く (詳細度によっては d1a の出力と d1b の入力が同じ位置)
+            StringSampleT in0a;
+            sub(in0a, loadH, v0b);
+            *p0 = ds.store(in0a);
 
             StringSampleT tmp1b;
-            sub(tmp1b, loadH, s.d1a.getOut());
-            s.d1b.setIn(filterH(tmp1b, s));
+            sub(tmp1b, loadH, v1a);
+            *p1b = ds.store(filterH(tmp1b, s));
 
             StringSampleT tmp1a;
-            sub(tmp1a, loadB1, s.d1b.getOut());
-            s.d1a.setIn(filterB(tmp1a, s));
-#if 0
-        printf("bl %f, hl %f, lh %f, lb %f, lb1 %f,  d0b %f, d0a %f, d1a %f, "
-               "d1b %f\n",
-               (float)bridgeLoad,
-               (float)hammerLoad,
-               (float)loadH,
-               (float)loadB,
-               (float)loadB1,
-               (float)s.d0b.getOut(),
-               (float)s.d0a.getOut(),
-               (float)s.d1a.getOut(),
-               (float)s.d1b.getOut());
-#endif
+            sub(tmp1a, loadB1, v1b);
+            *p0b = ds.store(filterB(tmp1a, s));
+
+            s.prev0b = v0b;
+            s.prev1a = v1a;
+            r.advance(1);
             return loadB;
         }
 
+        // ブロック処理
+        // 1 ブロックは getMinBlockDelay() 以下の長さで、
+        // prepareBlock() → (ハンマー) → updateBlock() の順に呼ぶ
+        size_t getMinBlockDelay() const { return minBlockDelay_; }
+
+        // 1 回の updateBlock() で扱える最大長 (作業領域はスタックに取る)
+        static constexpr size_t MAX_BLOCK_SIZE = 32;
+
+        // ハンマー入力速度 (1 サンプル遅れ) とブリッジ入力速度をブロック分足し込む
+        // hammerVelocity が nullptr ならハンマー側は省く
+        void __time_critical_func(prepareBlock)(State &s,
+                                                size_t n,
+                                                StringSampleT *hammerVelocity,
+                                                StringSampleT *bridgeVelocity) const;
+
+        void __time_critical_func(updateBlock)(SampleT *out,
+                                               State &s,
+                                               const BridgeSampleT *bridgeLoad,
+                                               const HammerLoadT *hammerLoad,
+                                               size_t n) const;
+
     protected:
+        template <int M>
+        void __time_critical_func(updateBlockImpl)(SampleT *out,
+                                                   State &s,
+                                                   const ThirianDispersionFilterT *dispersion,
+                                                   const BridgeSampleT *bridgeLoad,
+                                                   const HammerLoadT *hammerLoad,
+                                                   size_t n) const;
+
+        // d1a の読み出し位置を移っている間の n サンプル分の出力を、遅延線と同じ形で buf に作る
+        void __time_critical_func(fadeDelay1aBlock)(const State &s, DelaySampleT *buf, size_t n) const;
+
         FilterSampleT __time_critical_func(filterH)(FilterSampleT y, State &s) const
         {
+            if (s.detailLevel >= 2)
+            {
+                return dispersionLow_.filter(y, s.dispersion[0]);
+            }
             y = dispersion_[0].filter(y, s.dispersion[0]);
             y = dispersion_[1].filter(y, s.dispersion[1]);
             y = dispersion_[2].filter(y, s.dispersion[2]);
@@ -208,26 +329,49 @@ namespace physical_modeling_piano
         FilterSampleT __time_critical_func(filterB)(FilterSampleT y, State &s) const
         {
             y = lowpass_.filter(y, s.lowpass);
+            if (s.detailLevel)
+            {
+                const auto &c = fracDelayLow_[s.detailLevel - 1].getCoefficients();
+                return c.template filter<1>(y, s.fracDelay);
+            }
             y = fracDelay_.filter(y, s.fracDelay);
             return y;
         }
 
     private:
-        DelayNode d0a_;
-        DelayNode d0b_;
-        DelayNode d1a_;
-        DelayNode d1b_;
-
-        ImpedanceRatioT alpha12_;
-
         //     Z         Z         Zb
         // |<-D0a<-|H|<-D1a<-|B|<-0
         // |->D0b->| |->D1b->| |->out
+        //
+        // 4 本の遅延線は 1 本のリングに D0a, D0b, D1a, D1b の順に続けて置き、カーソル 1 つで回す
+        // ナットの反射は符号が変わるだけなので、D0b には書かずに D0a に書いたものを符号を変えて読む
+        // カーソル (このサンプルを書く位置) から戻った距離で
+        //   0                    : D0a に書く / D1b から読む (ちょうど 1 周前に書いたもの)
+        //   tap0b_               : D0b から読む / D1a に書く
+        //   tap0b_ + getDelay1a(): D1a から読む
+        //   tap1b_               : D1b に書く
+        // 1 サンプルの中では全部読んでから書く
+        uint16_t delay0_{};     // D0a, D0b の遅延
+        uint16_t delay1aMax_{}; // D1a の一番長い遅延 (詳細度で変わる)
+        uint16_t delay1b_{};
+        uint16_t tap0b_{};  // delay0_ * 2
+        uint16_t tap1b_{};  // tap0b_ + delay1aMax_
+        uint16_t ringSize_{}; // tap1b_ + delay1b_
+
+        ImpedanceRatioT alpha12_;
+
+        size_t minBlockDelay_ = 1;
 
         int M_ = 0;
         ThirianDispersionFilterT dispersion_[4];
         LossFilterT lowpass_;
         ThirianFilterT fracDelay_;
+
+        // 詳細度を落としたときに差し替えるもの
+        ThirianDispersionFilterT dispersionLow_;        // 1 段で全体の分散を近似する
+        FirstOrderThirianFilterT fracDelayLow_[N_DETAIL_LEVELS - 1];
+        uint16_t delay1a_[N_DETAIL_LEVELS]{};
+        uint8_t maxDetailLevel_ = 0;
     };
 
 } // namespace physical_modeling_piano
@@ -8,7 +8,30 @@
 #include "fixed.h"
 #include <stdint.h>
 
+#ifndef USE_FIXED_POINT
 #define USE_FIXED_POINT 1
+#endif
+
+// 弦の遅延線のサンプルを 16bit と弦ごとの指数で持つ (固定小数点のみ)
+#ifndef USE_COMPACT_DELAY
+#define USE_COMPACT_DELAY 0
+#endif
+
+#if USE_COMPACT_DELAY && !USE_FIXED_POINT
+#error "USE_COMPACT_DELAY needs USE_FIXED_POINT"
+#endif
+
+// 低音の弦を半分のレートで計算できるようにする (SystemParameters::halfRateFrequency)
+// 固定小数点では倍音の減衰の速さが全レートと合わない (pm_piano_multirate) ので、既定では float のときだけ
+#ifndef USE_HALF_RATE
+#define USE_HALF_RATE (!USE_FIXED_POINT)
+#endif
+
+// 鍵ごとの係数を Note::initialize() で計算せず、ビルドのときに作った表から読む (coefficients.h)
+// Note::initialize() を呼ばなくなるので、係数の計算に使う浮動小数点の関数はリンクされない
+#ifndef USE_PREBUILT_NOTE_TABLE
+#define USE_PREBUILT_NOTE_TABLE 0
+#endif
 
 namespace physical_modeling_piano
 {
@@ -27,6 +50,18 @@ namespace physical_modeling_piano
 
         float tune[3] = {1, 1.0003f, 0.9996f};
 
+        // ハンマーが離れた後、ボイスの出力の振幅がこれ未満のまま
+        // voiceSilenceTime 続いたら発音を止める (0 で止めない)
+        float voiceSilenceLevel = 1.0f / 32768;
+        float voiceSilenceTime = 0.1f; // [sec]
+
+        // 負荷に応じて詳細度を落とすとき、振幅がこれ未満のボイスから先に落とす
+        float voiceQuietLevel = 1.0f / 256;
+
+        // 基本周波数がこれ未満の音は弦を sampleRate / 2 で計算して補間する (0 なら全部そのまま)
+        // USE_HALF_RATE でなければ見ない
+        float halfRateFrequency = 0; // [Hz]
+
         //    1/44100 *(2^23) = 190.21786848072563
         //    (2^23)/190 = 44150.56842105263 0.1%
         //     190: 8bit
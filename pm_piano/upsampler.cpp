@@ -0,0 +1,92 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 15:11:40
+ */
+
+#include "upsampler.h"
+#include <math.h>
+
+namespace physical_modeling_piano
+{
+    namespace
+    {
+        // 0 次の第 1 種変形ベッセル関数
+        float besselI0(float x)
+        {
+            float sum = 1;
+            float term = 1;
+            for (int k = 1; k < 20; ++k)
+            {
+                const float t = x / (2 * k);
+                term *= t * t;
+                sum += term;
+            }
+            return sum;
+        }
+    }
+
+    void
+    HalfbandUpsampler::initialize()
+    {
+        constexpr float PI = 3.1415927f;
+        constexpr float beta = 6.0f;
+        constexpr float halfSpan = TAPS + 0.5f;
+
+        // Kaiser 窓をかけた sinc を間の位置でサンプルし、直流の利得を 1 にそろえる
+        float c[TAPS];
+        float sum = 0;
+        for (int i = 0; i < TAPS; ++i)
+        {
+            const float t = i + 0.5f;
+            const float r = t / halfSpan;
+            const float w = besselI0(beta * sqrtf(1 - r * r)) / besselI0(beta);
+            c[i] = sinf(PI * t) / (PI * t) * w;
+            sum += 2 * c[i];
+        }
+        for (int i = 0; i < TAPS; ++i)
+        {
+            coefs_[i] = c[i] / sum;
+        }
+    }
+
+    void
+    HalfbandUpsampler::process(SampleT *dst, size_t nOut, const SampleT *src, State &s) const
+    {
+        auto *history = s.history.data();
+        size_t pos = s.pos;
+        int phase = s.phase;
+
+        for (size_t i = 0; i < nOut; ++i)
+        {
+            // w[0..HISTORY) が古い順の入力
+            SampleT out;
+            if (phase == 0)
+            {
+                history[pos] = *src;
+                history[pos + HISTORY] = *src;
+                ++src;
+                pos = pos + 1 < HISTORY ? pos + 1 : 0;
+
+                out = history[pos + TAPS - 1];
+            }
+            else
+            {
+                const auto *w = history + pos;
+                AccT acc = 0;
+                for (int j = 0; j < TAPS; ++j)
+                {
+                    HistoryT pair;
+                    add(pair, w[TAPS - 1 - j], w[TAPS + j]);
+                    madd(acc, acc, pair, coefs_[j]);
+                }
+                out = acc;
+            }
+            add(dst[i], dst[i], out);
+            phase ^= 1;
+        }
+
+        s.pos = pos;
+        s.phase = phase;
+    }
+
+} // namespace physical_modeling_piano
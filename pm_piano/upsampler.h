@@ -0,0 +1,81 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 15:06:12
+ */
+#ifndef _D4A01499_5DAF_456F_90DB_65EF1053BCDA
+#define _D4A01499_5DAF_456F_90DB_65EF1053BCDA
+
+#include "fixed.h"
+#include "sys_params.h"
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+namespace physical_modeling_piano
+{
+    // 半分のレートの信号を 2 倍に補間する half-band FIR (polyphase)
+    // 入力のある位置の出力は入力をそのまま遅らせたもの、間の位置は対称な TAPS * 2 タップの FIR なので、
+    // 出力 2 サンプルあたりの積は TAPS 回
+    // 遅延は出力のレートで TAPS * 2 サンプル
+    class HalfbandUpsampler
+    {
+    public:
+#if USE_FIXED_POINT
+        using SampleT = FixedPoint<int32_t, 25>;  // String::SampleT
+        using HistoryT = FixedPoint<int32_t, 18>; // 1 ボイスの出力は 0.1 もないので 18bit で足りる
+        using CoefT = FixedPoint<int16_t, 12>;
+        using AccT = FixedPoint<int32_t, 30>; // History * Coef
+#else
+        using SampleT = float;
+        using HistoryT = float;
+        using CoefT = float;
+        using AccT = float;
+#endif
+
+        // 片側のタップ数 (Kaiser 窓 β = 6: 4kHz まで平坦、8kHz 以上の折り返しは -54dB)
+        static constexpr int TAPS = 6;
+        static constexpr int HISTORY = TAPS * 2;
+
+        struct State
+        {
+            // 同じものを 2 回並べて、どこからでも HISTORY 個続けて読めるようにする
+            std::array<HistoryT, HISTORY * 2> history{};
+            uint8_t pos{};   // 次に書く位置 (一番古いものの位置)
+            uint8_t phase{}; // 1 なら次の出力は入力の間の位置
+
+            void clear()
+            {
+                history.fill(HistoryT(0));
+                pos = 0;
+                phase = 0;
+            }
+        };
+
+    public:
+        void initialize();
+
+        // 出力 nOut サンプルに使う入力の数
+        static size_t getInputCount(const State &s, size_t nOut) { return (nOut + 1 - s.phase) / 2; }
+
+        // src の getInputCount() 個を補間して dst に足す
+        void __time_critical_func(process)(SampleT *dst, size_t nOut, const SampleT *src, State &s) const;
+
+        // 係数の書き出し / 読み込み (coefficients.h)
+        template <class IO>
+        void transferCoefficients(IO &io)
+        {
+            for (auto &v : coefs_)
+            {
+                io.value(v);
+            }
+        }
+
+    private:
+        std::array<CoefT, TAPS> coefs_{}; // 間の位置から ±(i + 1/2) 離れた入力の重み
+    };
+
+} // namespace physical_modeling_piano
+
+#endif /* _D4A01499_5DAF_456F_90DB_65EF1053BCDA */
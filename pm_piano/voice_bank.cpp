@@ -0,0 +1,511 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 05:31:08
+ */
+
+#include "voice_bank.h"
+#include <algorithm>
+#include <string.h>
+
+namespace physical_modeling_piano
+{
+    namespace
+    {
+        using VecI = VoiceBank::VecI;
+        using VecF = VoiceBank::VecF;
+
+        // レーン単位の出し入れ
+        template <class TS, class TV, int S>
+        inline void
+        setLane(FixedPoint<TV, S> &v, int l, const FixedPoint<TS, S> &x)
+        {
+            auto t = v.get();
+            t[l] = x.get();
+            v.set(t);
+        }
+
+        inline void
+        setLane(VecF &v, int l, float x)
+        {
+            v[l] = x;
+        }
+
+        template <class TS, class TV, int S>
+        inline void
+        getLane(FixedPoint<TS, S> &dst, const FixedPoint<TV, S> &v, int l)
+        {
+            dst.set(v.get()[l]);
+        }
+
+        inline void
+        getLane(float &dst, const VecF &v, int l)
+        {
+            dst = v[l];
+        }
+
+        // mask が 0 のレーンを 0 にする
+        template <class TV, int S>
+        inline FixedPoint<TV, S>
+        gate(const FixedPoint<TV, S> &v, const VecI &mask)
+        {
+            FixedPoint<TV, S> r;
+            r.set(v.get() & mask);
+            return r;
+        }
+
+        inline VecF
+        gate(const VecF &v, const VecI &mask)
+        {
+            return (VecF)((VecI)v & mask);
+        }
+
+        // getAbsMask のレーン版
+        template <int S>
+        inline VecI
+        getAbsMask(const FixedPoint<VecI, S> &v)
+        {
+            auto r = v.get();
+            return r < 0 ? -r : r;
+        }
+
+        inline VecI
+        getAbsMask(const VecF &v)
+        {
+            return (VecI)v & 0x7fffffff;
+        }
+
+        // 浮動小数点版の演算
+        inline void add(VecF &dst, const VecF &a, const VecF &b) { dst = a + b; }
+        inline void sub(VecF &dst, const VecF &a, const VecF &b) { dst = a - b; }
+        inline void mul(VecF &dst, const VecF &a, const VecF &b) { dst = a * b; }
+        inline void neg(VecF &dst, const VecF &v) { dst = -v; }
+        inline void madd(VecF &dst, const VecF &c, const VecF &a, const VecF &b) { dst = c + a * b; }
+        inline void nmsub(VecF &dst, const VecF &c, const VecF &a, const VecF &b) { dst = c - a * b; }
+
+        // FixedPoint<int32_t, S> を通したときと同じ丸め
+        template <int S>
+        inline VecF
+        quantizeLanes(const VecF &v)
+        {
+            constexpr float scale = float(1u << S);
+            auto q = __builtin_convertvector(v * scale + 0.5f, VecI);
+            return __builtin_convertvector(q, VecF) * (1.0f / scale);
+        }
+
+        // IIRFilterConstant::_filter<N> のレーン版
+        template <size_t N, class TV, class TC, class TH>
+        inline TV
+        filterLanes(const TV &in, const TC *b, const TC *a, TH *h)
+        {
+            TV out;
+            madd(out, h[0], b[0], in);
+            for (size_t i = 1; i < N; ++i)
+            {
+                TH tmp;
+                madd(tmp, h[i], b[i], in);
+                nmsub(h[i - 1], tmp, a[i], out);
+            }
+            TH tmp;
+            mul(tmp, b[N], in);
+            nmsub(h[N - 1], tmp, a[N], out);
+            return out;
+        }
+    }
+
+    void
+    VoiceBank::update(SampleT *samples,
+                      size_t nSamples,
+                      const Voice *voices,
+                      size_t nVoices,
+                      const SystemParameters &sysParams)
+    {
+        // 弦の数が同じボイスを同じグループに寄せる
+        sorted_.assign(voices, voices + nVoices);
+        std::stable_sort(sorted_.begin(), sorted_.end(),
+                         [](const Voice &a, const Voice &b)
+                         { return a.state->nStrings > b.state->nStrings; });
+
+        size_t nGroups = (nVoices + LANES - 1) / LANES;
+        if (groups_.size() < nGroups)
+        {
+            groups_.resize(nGroups);
+        }
+
+        for (size_t gi = 0; gi < nGroups; ++gi)
+        {
+            auto &g = groups_[gi];
+            g.nStrings = 0;
+            for (int l = 0; l < LANES; ++l)
+            {
+                size_t idx = gi * LANES + l;
+                load(g, l, idx < nVoices ? &sorted_[idx] : nullptr);
+            }
+
+            updateGroup(samples, nSamples, g, sysParams);
+
+            for (int l = 0; l < LANES; ++l)
+            {
+                store(g, l, nSamples);
+            }
+        }
+    }
+
+    void
+    VoiceBank::deactivate(StringLanes &s, int lane)
+    {
+        s.active[lane] = 0;
+        setLane(s.prev0b, lane, StringSampleT(0));
+        setLane(s.prev1a, lane, StringSampleT(0));
+        s.ring[lane] = dummyBuffer_;
+        s.delayScale[lane] = {};
+        s.ringSize[lane] = 1;
+        s.cursor[lane] = 0;
+        s.tap0b[lane] = 0;
+        s.tap1a[lane] = 0;
+        s.tap1b[lane] = 0;
+        s.fadeTap1a[lane] = 0;
+        s.fadeRemaining[lane] = 0;
+        for (auto &h : s.dispersionH)
+        {
+            for (auto &v : h)
+            {
+                setLane(v, lane, FilterHistoryT(0));
+            }
+        }
+        setLane(s.lowpassH, lane, FilterHistoryT(0));
+        for (auto &v : s.fracDelayH)
+        {
+            setLane(v, lane, FilterHistoryT(0));
+        }
+    }
+
+    void
+    VoiceBank::load(Group &g, int lane, const Voice *v)
+    {
+        if (!v)
+        {
+            g.note[lane] = nullptr;
+            g.state[lane] = nullptr;
+            setLane(g.invNStrings, lane, FixedPoint<int32_t, 8>(0));
+            setLane(g.bridgeLoadRatio, lane, FixedPoint<int32_t, 25>(0));
+            g.hammerMask[lane] = 0;
+            setLane(g.lastOutput, lane, SampleT(0));
+            g.collapsed[0][lane] = 0;
+            g.collapsed[1][lane] = 0;
+            for (auto &s : g.strings)
+            {
+                deactivate(s, lane);
+            }
+            return;
+        }
+
+        const auto &note = *v->note;
+        auto &st = *v->state;
+
+        // 係数はレーンの音が変わったときだけ積み直す
+        bool reload = g.note[lane] != v->note;
+        g.note[lane] = v->note;
+        g.state[lane] = v->state;
+        setLane(g.invNStrings, lane, note.getInvNStrings(st));
+        setLane(g.bridgeLoadRatio, lane, note.getBridgeLoadRatio(st));
+        g.hammerMask[lane] = 0;
+        setLane(g.lastOutput, lane, st.lastOutput);
+        g.nStrings = std::max<int>(g.nStrings, st.nStrings);
+        g.collapsed[0][lane] = st.nStrings < note.nStrings_ && note.nStrings_ > 1 ? -1 : 0;
+        g.collapsed[1][lane] = st.nStrings < note.nStrings_ && note.nStrings_ > 2 ? -1 : 0;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            auto &s = g.strings[i];
+            if (i >= st.nStrings)
+            {
+                deactivate(s, lane);
+                continue;
+            }
+
+            const auto &str = note.strings_[i];
+            const auto &ss = st.strings[i];
+            const int detailLevel = ss.detailLevel;
+            const size_t fracDelayDim = detailLevel ? 1 : str.fracDelay_.getDim();
+
+            if (reload || s.detailLevel[lane] != detailLevel)
+            {
+                setLane(s.alpha12, lane, str.alpha12_);
+                for (int j = 0; j < N_DISPERSION; ++j)
+                {
+                    // 1 段にしたときは残りの段を素通しにする
+                    const auto &c = detailLevel >= 2 ? str.dispersionLow_.getCoefficients()
+                                                     : str.dispersion_[j].getCoefficients();
+                    const bool bypass = detailLevel >= 2 && j > 0;
+                    for (int k = 0; k <= DISPERSION_ORDER; ++k)
+                    {
+                        setLane(s.dispersionB[j][k], lane, bypass ? FilterConstT(k == 0 ? 1 : 0) : c.b[k]);
+                        setLane(s.dispersionA[j][k], lane, bypass ? FilterConstT(k == 0 ? 1 : 0) : c.a[k]);
+                    }
+                }
+                setLane(s.lowpassB0, lane, str.lowpass_.getB0());
+                setLane(s.lowpassMA1, lane, str.lowpass_.getMA1());
+
+                if (detailLevel)
+                {
+                    const auto &c = str.fracDelayLow_[detailLevel - 1].getCoefficients();
+                    for (size_t k = 0; k <= FRAC_DELAY_ORDER; ++k)
+                    {
+                        setLane(s.fracDelayB[k], lane, k <= 1 ? c.b[k] : FilterConstT(0));
+                        setLane(s.fracDelayA[k], lane, k <= 1 ? c.a[k] : FilterConstT(0));
+                    }
+                }
+                else
+                {
+                    const auto &c = str.fracDelay_.getCoefficients();
+                    for (size_t k = 0; k <= FRAC_DELAY_ORDER; ++k)
+                    {
+                        setLane(s.fracDelayB[k], lane, k <= fracDelayDim ? c.b[k] : FilterConstT(0));
+                        setLane(s.fracDelayA[k], lane, k <= fracDelayDim ? c.a[k] : FilterConstT(0));
+                    }
+                }
+                s.fracDelayDim[lane] = fracDelayDim;
+                s.detailLevel[lane] = detailLevel;
+            }
+
+            setLane(s.prev0b, lane, ss.prev0b);
+            setLane(s.prev1a, lane, ss.prev1a);
+            s.ring[lane] = ss.ring.getBuffer();
+            s.delayScale[lane] = ss.delayScale;
+            s.ringSize[lane] = ss.ring.getSize();
+            s.cursor[lane] = ss.ring.getCursor();
+            s.tap0b[lane] = str.tap0b_;
+            s.tap1a[lane] = str.tap0b_ + str.getDelay1a(ss);
+            s.tap1b[lane] = str.tap1b_;
+            s.fadeTap1a[lane] = str.tap0b_ + ss.fadeDelay1a;
+            s.fadeRemaining[lane] = ss.fadeRemaining;
+
+            for (int j = 0; j < N_DISPERSION; ++j)
+            {
+                for (int k = 0; k < DISPERSION_ORDER; ++k)
+                {
+                    setLane(s.dispersionH[j][k], lane, ss.dispersion[j].state[k]);
+                }
+            }
+            setLane(s.lowpassH, lane, ss.lowpass.h0);
+            // 次数より上の履歴は使われていないので 0 にしておく
+            for (size_t k = 0; k < FRAC_DELAY_ORDER; ++k)
+            {
+                setLane(s.fracDelayH[k], lane, k < fracDelayDim ? ss.fracDelay.state[k] : FilterHistoryT(0));
+            }
+            s.active[lane] = -1;
+        }
+    }
+
+    void
+    VoiceBank::store(const Group &g, int lane, size_t nSamples) const
+    {
+        auto *st = g.state[lane];
+        if (!st)
+        {
+            return;
+        }
+        const auto &note = *g.note[lane];
+
+        for (int i = 0; i < st->nStrings; ++i)
+        {
+            const auto &s = g.strings[i];
+            auto &ss = st->strings[i];
+
+            getLane(ss.prev0b, s.prev0b, lane);
+            getLane(ss.prev1a, s.prev1a, lane);
+            ss.ring.setCursor(s.cursor[lane]);
+            ss.delayScale = s.delayScale[lane];
+            ss.fadeRemaining = s.fadeRemaining[lane];
+
+            for (int j = 0; j < N_DISPERSION; ++j)
+            {
+                for (int k = 0; k < DISPERSION_ORDER; ++k)
+                {
+                    getLane(ss.dispersion[j].state[k], s.dispersionH[j][k], lane);
+                }
+            }
+            getLane(ss.lowpass.h0, s.lowpassH, lane);
+            for (size_t k = 0; k < s.fracDelayDim[lane]; ++k)
+            {
+                getLane(ss.fracDelay.state[k], s.fracDelayH[k], lane);
+            }
+        }
+
+        if (g.hammerMask[lane] == 0)
+        {
+            st->hammer.idle = true;
+        }
+        getLane(st->lastOutput, g.lastOutput, lane);
+        note.updateSilence(*st, g.level[lane], nSamples);
+        note.updateDelayScale(*st, nSamples);
+    }
+
+    void
+    VoiceBank::updateGroup(SampleT *samples,
+                           size_t nSamples,
+                           Group &g,
+                           const SystemParameters &sysParams)
+    {
+        using StringSampleV = LaneT<StringSampleT>;
+        using BridgeSampleV = LaneT<BridgeSampleT>;
+        using FilterSampleV = LaneT<FilterSampleT>;
+
+        const int nStrings = g.nStrings;
+        const auto ref = g.lastOutput;
+        VecI level{};
+
+        while (nSamples)
+        {
+            // Note::updateSamples と同じ手順
+            StringSampleV vString{};
+            StringSampleV load{};
+
+            for (int i = 0; i < nStrings; ++i)
+            {
+                auto &s = g.strings[i];
+
+                StringSampleV v;
+                add(v, s.prev0b, s.prev1a);
+                add(vString, vString, v);
+
+                // リングのタップはレーンごとにばらばらなのでスカラーで読む
+                StringSampleV r0b;
+                for (int l = 0; l < LANES; ++l)
+                {
+                    const auto *buf = s.ring[l];
+                    const auto &ds = s.delayScale[l];
+                    const auto c = s.cursor[l];
+                    const auto size = s.ringSize[l];
+                    setLane(s.v1b, l, ds.load(buf[c]));
+                    setLane(r0b, l, ds.load(buf[wrapDelayIndex(c + size - s.tap0b[l], size)]));
+                    auto v1a = ds.load(buf[wrapDelayIndex(c + size - s.tap1a[l], size)]);
+                    if (s.fadeRemaining[l])
+                    {
+                        const auto prev = ds.load(buf[wrapDelayIndex(c + size - s.fadeTap1a[l], size)]);
+                        v1a = String::crossfadeDelay1a(v1a, prev, s.fadeRemaining[l]--);
+                    }
+                    setLane(s.v1a, l, v1a);
+                }
+                neg(s.v0b, r0b);
+
+                add(load, load, s.v1b);
+            }
+
+            BridgeSampleV bload;
+            mul(bload, load, g.bridgeLoadRatio);
+
+            LaneT<Hammer::VelocityT> vStringAve;
+#if USE_FIXED_POINT
+            LaneT<FixedPoint<int32_t, 18>> vStringTmp = vString;
+#else
+            auto vStringTmp = quantizeLanes<18>(vString);
+#endif
+            mul(vStringAve, vStringTmp, g.invNStrings);
+
+            // ハンマーは接触中のボイスだけなのでスカラーで回す
+            Hammer::VelocityT vin[LANES];
+            memcpy(vin, &vStringAve, sizeof(vin));
+            String::HammerLoadT hl[LANES];
+            for (int l = 0; l < LANES; ++l)
+            {
+                hl[l] = 0;
+                if (auto *st = g.state[l])
+                {
+                    if (!st->hammer.idle)
+                    {
+                        const auto *note = g.note[l];
+                        (note->hammer_.*note->hammerUpdateFunc_)(st->hammer, vin[l], sysParams);
+                    }
+                    const auto &f = st->hammer.F_2Z;
+                    g.hammerMask[l] |= getAbsMask(f);
+                    hl[l] = f;
+                }
+            }
+            LaneT<String::HammerLoadT> hload;
+            memcpy(&hload, hl, sizeof(hl));
+
+            BridgeSampleV out{};
+            for (int i = 0; i < nStrings; ++i)
+            {
+                auto &s = g.strings[i];
+
+                // String::update
+                // 使っていないレーンには何も入れない
+                StringSampleV loadH;
+                add(loadH, s.v0b, s.v1a);
+                add(loadH, loadH, gate(hload, s.active));
+
+                BridgeSampleV loadB;
+                mul(loadB, s.alpha12, s.v1b);
+
+                BridgeSampleV loadB1d;
+                add(loadB1d, loadB, gate(bload, s.active));
+                StringSampleV loadB1 = loadB1d;
+
+                StringSampleV in0a;
+                sub(in0a, loadH, s.v0b);
+
+                StringSampleV tmp1b;
+                sub(tmp1b, loadH, s.v1a);
+                FilterSampleV yh = tmp1b;
+                for (int j = 0; j < N_DISPERSION; ++j)
+                {
+                    yh = filterLanes<DISPERSION_ORDER>(yh, s.dispersionB[j], s.dispersionA[j], s.dispersionH[j]);
+                }
+                StringSampleV in1b = yh;
+
+                StringSampleV tmp1a;
+                sub(tmp1a, loadB1, s.v1b);
+                FilterSampleV yb = tmp1a;
+                FilterSampleV y;
+                madd(y, s.lowpassH, s.lowpassB0, yb);
+                mul(s.lowpassH, s.lowpassMA1, y);
+                StringSampleV in1a = filterLanes<FRAC_DELAY_ORDER>(y, s.fracDelayB, s.fracDelayA, s.fracDelayH);
+
+                // 読んだのと同じカーソルの位置に書いて進める
+                for (int l = 0; l < LANES; ++l)
+                {
+                    auto *buf = s.ring[l];
+                    auto &ds = s.delayScale[l];
+                    const auto c = s.cursor[l];
+                    const auto size = s.ringSize[l];
+                    StringSampleT v0a, v1a, v1b;
+                    getLane(v0a, in0a, l);
+                    getLane(v1a, in1a, l);
+                    getLane(v1b, in1b, l);
+                    buf[c] = ds.store(v0a);
+                    buf[wrapDelayIndex(c + size - s.tap0b[l], size)] = ds.store(v1a);
+                    buf[wrapDelayIndex(c + size - s.tap1b[l], size)] = ds.store(v1b);
+                    s.cursor[l] = wrapDelayIndex(c + 1, size);
+                }
+                s.prev0b = s.v0b;
+                s.prev1a = s.v1a;
+
+                add(out, out, loadB);
+                if (i == 0)
+                {
+                    // まとめた弦は残りの本数分も足す
+                    add(out, out, gate(loadB, g.collapsed[0]));
+                    add(out, out, gate(loadB, g.collapsed[1]));
+                }
+            }
+
+            BridgeSampleV d;
+            sub(d, out, ref);
+            level |= getAbsMask(d);
+            g.lastOutput = out;
+
+            SampleT o[LANES];
+            memcpy(o, &out, sizeof(o));
+            for (int l = 0; l < LANES; ++l)
+            {
+                add(*samples, *samples, o[l]);
+            }
+            ++samples;
+            --nSamples;
+        }
+        g.level = level;
+    }
+
+} // namespace physical_modeling_piano
@@ -0,0 +1,176 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 05:12:40
+ */
+#ifndef _7E41C0A2_5134_1A3F_2C61_9D0B3E85F214
+#define _7E41C0A2_5134_1A3F_2C61_9D0B3E85F214
+
+#include "note.h"
+#include <vector>
+
+#include "platform.h"
+
+namespace physical_modeling_piano
+{
+    namespace detail
+    {
+        constexpr int VOICE_LANES = 8;
+
+        using VoiceLaneI = int32_t __attribute__((vector_size(VOICE_LANES * sizeof(int32_t))));
+        using VoiceLaneF = float __attribute__((vector_size(VOICE_LANES * sizeof(float))));
+
+        template <class T>
+        struct VoiceLane;
+        template <int S>
+        struct VoiceLane<FixedPoint<int32_t, S>>
+        {
+            using type = FixedPoint<VoiceLaneI, S>;
+        };
+        template <int S>
+        struct VoiceLane<FixedPoint<int16_t, S>>
+        {
+            using type = FixedPoint<VoiceLaneI, S>;
+        };
+        template <>
+        struct VoiceLane<float>
+        {
+            using type = VoiceLaneF;
+        };
+    }
+
+    // ホスト向けの多ボイス処理
+    // LANES 個のボイスの同じ弦の状態をベクタ型 (GCC/Clang の vector_size) に並べて (SoA)、
+    // String::update と同じ計算をレーン方向にまとめて行う
+    // SSE/AVX2/NEON のどれになるかはコンパイラのターゲット次第
+    // Note::State との間で update() ごとに状態を出し入れするので、
+    // NoteManager 側の管理はそのまま使える
+    // 演算の順序と型は Note::update と同じなので固定小数点では結果がビット単位で一致する
+    // (浮動小数点では弦とボイスを足し合わせる順序が違うぶんだけずれる)
+    class VoiceBank
+    {
+    public:
+        static constexpr int LANES = detail::VOICE_LANES;
+
+        using VecI = detail::VoiceLaneI;
+        using VecF = detail::VoiceLaneF;
+
+        // スカラーの型に対応するレーンの型
+        // 中身はスカラーの型を LANES 個並べたものと同じ並び
+        template <class T>
+        using LaneT = typename detail::VoiceLane<T>::type;
+
+        struct Voice
+        {
+            const Note *note;
+            Note::State *state;
+        };
+
+        using SampleT = Note::SampleT;
+
+    public:
+        // voices は updateSustain() を通ったもの
+        void update(SampleT *samples,
+                    size_t nSamples,
+                    const Voice *voices,
+                    size_t nVoices,
+                    const SystemParameters &sysParams);
+
+    private:
+        using StringSampleT = String::StringSampleT;
+        using DelaySampleT = String::DelaySampleT;
+        using BridgeSampleT = String::BridgeSampleT;
+        using FilterSampleT = String::FilterSampleT;
+        using FilterConstT = String::FilterConstT;
+        using FilterHistoryT = String::FilterHistoryT;
+        using ImpedanceRatioT = String::ImpedanceRatioT;
+
+        // Note 側はどちらの演算でも固定小数点で持っている
+#if USE_FIXED_POINT
+        using InvNStringsLaneT = LaneT<FixedPoint<int32_t, 8>>;
+        using LoadRatioLaneT = LaneT<FixedPoint<int32_t, 25>>;
+#else
+        using InvNStringsLaneT = VecF;
+        using LoadRatioLaneT = VecF;
+#endif
+
+        static constexpr int N_DISPERSION = 4;
+        static constexpr int DISPERSION_ORDER = 2;
+        static constexpr int FRAC_DELAY_ORDER = 7;
+
+        // 弦 1 本分をレーン方向に並べたもの
+        struct StringLanes
+        {
+            // 係数
+            LaneT<ImpedanceRatioT> alpha12;
+            LaneT<FilterConstT> dispersionB[N_DISPERSION][DISPERSION_ORDER + 1];
+            LaneT<FilterConstT> dispersionA[N_DISPERSION][DISPERSION_ORDER + 1];
+            LaneT<FilterConstT> lowpassB0;
+            LaneT<FilterConstT> lowpassMA1;
+            // 次数の低いレーンは係数 0 で埋めて 7 次として計算する
+            LaneT<FilterConstT> fracDelayB[FRAC_DELAY_ORDER + 1];
+            LaneT<FilterConstT> fracDelayA[FRAC_DELAY_ORDER + 1];
+            uint8_t fracDelayDim[LANES];
+            uint8_t detailLevel[LANES]; // 係数を積んだときの String::State::detailLevel
+
+            // 状態
+            LaneT<StringSampleT> prev0b; // String::State::prev0b
+            LaneT<StringSampleT> prev1a;
+            LaneT<StringSampleT> v0b; // このサンプルの遅延線の出力 (ハンマーの前に読んでおく)
+            LaneT<StringSampleT> v1a;
+            LaneT<StringSampleT> v1b;
+            LaneT<FilterHistoryT> dispersionH[N_DISPERSION][DISPERSION_ORDER];
+            LaneT<FilterHistoryT> lowpassH;
+            LaneT<FilterHistoryT> fracDelayH[FRAC_DELAY_ORDER];
+
+            // 遅延線のリングはレーンごとに Note::State のバッファを直接使う
+            // タップはカーソルから戻る距離 (String の private を参照)
+            DelaySampleT *ring[LANES];
+            String::DelayScale delayScale[LANES];
+            uint32_t ringSize[LANES];
+            uint32_t cursor[LANES];
+            uint32_t tap0b[LANES];
+            uint32_t tap1a[LANES];
+            uint32_t tap1b[LANES];
+            uint32_t fadeTap1a[LANES];     // String::State::fadeDelay1a の位置
+            uint8_t fadeRemaining[LANES]; // String::State::fadeRemaining
+
+            VecI active; // 使っているレーンは -1
+        };
+
+        struct Group
+        {
+            StringLanes strings[3];
+            int nStrings; // レーン中の最大の弦の数
+
+            const Note *note[LANES];
+            Note::State *state[LANES];
+
+            InvNStringsLaneT invNStrings;
+            LoadRatioLaneT bridgeLoadRatio;
+            uint32_t hammerMask[LANES];
+            LaneT<SampleT> lastOutput;
+            VecI level; // Note::State::level
+            // ユニゾンをまとめたレーンで 1 本目の弦を 2, 3 本目の分として足すマスク
+            VecI collapsed[2];
+        };
+
+        void load(Group &g, int lane, const Voice *v);
+        void store(const Group &g, int lane, size_t nSamples) const;
+        void deactivate(StringLanes &s, int lane);
+
+        void __time_critical_func(updateGroup)(SampleT *samples,
+                                               size_t nSamples,
+                                               Group &g,
+                                               const SystemParameters &sysParams);
+
+    private:
+        std::vector<Group> groups_;
+        std::vector<Voice> sorted_;
+
+        // 使わないレーンの遅延線 (常に 0 を読み書きする)
+        DelaySampleT dummyBuffer_[1]{};
+    };
+
+} // namespace physical_modeling_piano
+
+#endif /* _7E41C0A2_5134_1A3F_2C61_9D0B3E85F214 */
@@ -5,10 +5,25 @@
 #pragma once
 
 #include <stdint.h>
+
+#if PICO_PIANO_HOST
+#include <mutex>
+#else
 #include "hardware/sync.h"
+#endif
 
 namespace util
 {
+#if PICO_PIANO_HOST
+    class SpinLock
+    {
+        std::mutex mutex_;
+
+    public:
+        void lock() { mutex_.lock(); }
+        void unlock() { mutex_.unlock(); }
+    };
+#else
     class SpinLock
     {
         uint32_t idx_;
@@ -40,4 +55,5 @@ namespace util
             spin_unlock(get(), irqState_);
         }
     };
+#endif
 }
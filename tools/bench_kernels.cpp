@@ -0,0 +1,501 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 02:20:14
+ */
+
+// 合成カーネル単体のマイクロベンチマーク
+// 結果は JSON で出力する
+
+#include <pm_piano/delay.h>
+#include <pm_piano/filter.h>
+#include <pm_piano/hammer.h>
+#include <pm_piano/note.h>
+#include <pm_piano/partitioned_convolver.h>
+#include <pm_piano/soundboard.h>
+#include <pm_piano/string.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace physical_modeling_piano;
+
+namespace
+{
+    struct Result
+    {
+        std::string name;
+        std::string params;
+        size_t samplesPerCall;
+        size_t calls;
+        double nsPerCall;
+    };
+
+    double minTimeSec_ = 0.05;
+    std::vector<Result> results_;
+
+    volatile uint32_t sink_;
+
+    template <class T>
+    void consume(const T &v)
+    {
+        uint32_t r = 0;
+        memcpy(&r, &v, std::min(sizeof(r), sizeof(v)));
+        sink_ = sink_ + r;
+    }
+
+    // 一回あたり callsPerRun 回呼ぶ関数 f を十分な時間回して、ベストの ns/call を記録する
+    template <class Func>
+    void measure(const char *name, const std::string &params,
+                 size_t samplesPerCall, size_t callsPerRun, Func &&f)
+    {
+        using clock = std::chrono::steady_clock;
+
+        f(); // warm up
+
+        double best = 1e30;
+        size_t total = 0;
+        for (int rep = 0; rep < 5; ++rep)
+        {
+            size_t calls = 0;
+            auto t0 = clock::now();
+            double elapsed = 0;
+            do
+            {
+                f();
+                calls += callsPerRun;
+                elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+            } while (elapsed < minTimeSec_ / 5);
+
+            best = std::min(best, elapsed * 1e9 / calls);
+            total += calls;
+        }
+
+        results_.push_back({name, params, samplesPerCall, total, best});
+        fprintf(stderr, "%-28s %-24s %10.2f ns/call %8.3f ns/sample\n",
+                name, params.c_str(), best, best / samplesPerCall);
+    }
+
+    std::string format(const char *fmt, double a, double b = 0)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), fmt, a, b);
+        return buf;
+    }
+
+    // 入力として使う適当な信号
+    template <class T>
+    std::vector<T> makeSignal(size_t n, float amp)
+    {
+        std::vector<T> r(n);
+        uint32_t x = 12345;
+        for (auto &v : r)
+        {
+            x = x * 1664525 + 1013904223;
+            v = amp * ((int32_t)(x >> 8) * (1.0f / (1 << 23)));
+        }
+        return r;
+    }
+
+    constexpr size_t N_SIGNAL = 256;
+
+    ////
+    void benchDelay()
+    {
+        using T = String::StringSampleT;
+        const size_t delay = 300;
+        const size_t size = computeDelayBufferSize(delay);
+        std::vector<T> buffer(size);
+        DelayState<T> state(buffer.data(), size);
+        state.clear(delay);
+        auto in = makeSignal<T>(N_SIGNAL, 1.0f);
+
+        measure("DelayState::update", format("delay=%g", delay), 1, N_SIGNAL,
+                [&]
+                {
+                    T acc = 0;
+                    for (auto &v : in)
+                    {
+                        add(acc, acc, state.update(v, delay));
+                    }
+                    consume(acc);
+                });
+    }
+
+    void benchLossFilter()
+    {
+        String::LossFilterT filter;
+        String::LossFilterT::State st;
+        filter.initialize(440, SystemParameters::sampleRate, 0.25f, 5.85f);
+        filter.clear(st);
+        auto in = makeSignal<String::FilterSampleT>(N_SIGNAL, 1.0f);
+
+        measure("LossFilter::filter", "f0=440", 1, N_SIGNAL,
+                [&]
+                {
+                    String::FilterSampleT acc = 0;
+                    for (auto &v : in)
+                    {
+                        add(acc, acc, filter.filter(v, st));
+                    }
+                    consume(acc);
+                });
+    }
+
+    void benchDispersionFilter()
+    {
+        for (int M : {1, 4})
+        {
+            String::ThirianDispersionFilterT filter;
+            String::ThirianDispersionFilterT::State st;
+            filter.initialize(0.0002f, 110, M);
+            filter.clear(st);
+            auto in = makeSignal<String::FilterSampleT>(N_SIGNAL, 1.0f);
+
+            measure("ThirianDispersionFilter", format("M=%g", M), 1, N_SIGNAL,
+                    [&]
+                    {
+                        String::FilterSampleT acc = 0;
+                        for (auto &v : in)
+                        {
+                            add(acc, acc, filter.filter(v, st));
+                        }
+                        consume(acc);
+                    });
+        }
+    }
+
+    void benchThirianFilter()
+    {
+        for (int order = 1; order <= 7; ++order)
+        {
+            String::ThirianFilterT filter;
+            String::ThirianFilterT::State st;
+            filter.initialize(order + 0.3f, order);
+            filter.clear(st);
+            auto in = makeSignal<String::FilterSampleT>(N_SIGNAL, 1.0f);
+
+            measure("ThirianFilter", format("order=%g", order), 1, N_SIGNAL,
+                    [&]
+                    {
+                        String::FilterSampleT acc = 0;
+                        for (auto &v : in)
+                        {
+                            add(acc, acc, filter.filter(v, st));
+                        }
+                        consume(acc);
+                    });
+        }
+    }
+
+    void benchHammer()
+    {
+        SystemParameters sysParams;
+
+        struct Variant
+        {
+            const char *name;
+            Hammer::UpdateFunc func;
+        };
+        static const Variant variants[] = {
+            {"Hammer::update", &Hammer::update},
+            {"Hammer::update2", &Hammer::update2},
+            {"Hammer::update4", &Hammer::update4},
+        };
+
+        // Note::initialize の中音域相当のパラメータ
+        const float keyRate = 0.5f;
+        const float p = 2.0f + keyRate;
+        const float m = 0.06f - 0.058f * powf(keyRate, 0.1f);
+        const float K = 40.0f * powf(0.7e-3f, -p);
+        const float Z = 1.0f;
+
+        for (auto &v : variants)
+        {
+            Hammer hammer;
+            hammer.initialize(m, K, p, Z, 0.1e-4f * keyRate, sysParams);
+            Hammer::State st;
+            auto vin = makeSignal<Hammer::VelocityT>(N_SIGNAL, 0.01f);
+
+            measure(v.name, "keyRate=0.5", 1, N_SIGNAL,
+                    [&]
+                    {
+                        // 打鍵直後の接触状態を計る
+                        st.reset(5.0f);
+                        for (auto &in : vin)
+                        {
+                            (hammer.*v.func)(st, in, sysParams);
+                        }
+                        consume(st.F_2Z);
+                    });
+        }
+    }
+
+    void benchString()
+    {
+        SystemParameters sysParams;
+
+        for (float f : {55.0f, 440.0f, 1760.0f})
+        {
+            String string;
+            string.initialize(f, 0.0002f, 1.0f, sysParams.bridgeImpedance, sysParams);
+
+            std::vector<uint32_t> buffer((string.getStateSize() + 3) / 4);
+            SimpleLinearAllocator allocator(buffer.data(), buffer.size() * 4);
+            String::State st;
+            string.reset(st, allocator);
+
+            auto hload = makeSignal<String::HammerLoadT>(N_SIGNAL, 0.1f);
+
+            measure("String::update", format("f=%g", f), 1, N_SIGNAL,
+                    [&]
+                    {
+                        String::SampleT acc = 0;
+                        for (auto &h : hload)
+                        {
+                            add(acc, acc, string.update(st, 0, h));
+                        }
+                        consume(acc);
+                    });
+        }
+    }
+
+    void benchNote()
+    {
+        SystemParameters sysParams;
+        PedalState pedal;
+        pedal.setDamper(true);
+
+        constexpr size_t BLOCK = 64;
+
+        for (int key : {21, 60, 108})
+        {
+            float f = 440 * powf(2.0f, (key - 69) / 12.0f);
+            auto note = std::make_unique<Note>();
+            note->initialize(f, sysParams);
+
+            std::vector<uint32_t> delayMemory((note->computeAllocatorSize() + 3) / 4);
+            Note::State st;
+            st.delayMemory = delayMemory.data();
+            note->keyOn(st, 5.0f);
+
+            Note::SampleT out[BLOCK];
+            measure("Note::update", format("key=%g", key), BLOCK, 1,
+                    [&]
+                    {
+                        memset(out, 0, sizeof(out));
+                        note->update(out, BLOCK, st, sysParams, pedal);
+                        consume(out[BLOCK - 1]);
+                    });
+        }
+    }
+
+    // updateSamples() と updateBlocks() を外から呼べるようにする
+    class NotePaths : public Note
+    {
+    public:
+        using Note::updateBlocks;
+        using Note::updateSamples;
+    };
+
+    // ブロック単位で回せる鍵を、サンプル単位とブロック単位の両方で回して比べる
+    // どちらも出力は同じ (Note::update はブロック単位の方を使う)
+    // 負荷の揺れが片方にだけ乗らないように、同時に打鍵した 2 つのボイスを交互に少しずつ回して、
+    // それぞれ一番速かった回を取る
+    void benchNotePaths()
+    {
+        using clock = std::chrono::steady_clock;
+
+        SystemParameters sysParams;
+
+        constexpr size_t BLOCK = 64;
+        constexpr size_t CALLS_PER_ROUND = 16;
+        constexpr int MIN_ROUNDS = 20;
+
+        for (int key : {21, 25, 30, 35})
+        {
+            float f = 440 * powf(2.0f, (key - 69) / 12.0f);
+            auto note = std::make_unique<NotePaths>();
+            note->initialize(f, sysParams);
+            if (!note->getBlockSize())
+            {
+                continue;
+            }
+
+            std::vector<uint32_t> delayMemory[2];
+            Note::State st[2];
+            for (int path = 0; path < 2; ++path)
+            {
+                delayMemory[path].resize((note->computeAllocatorSize() + 3) / 4);
+                st[path].delayMemory = delayMemory[path].data();
+                note->keyOn(st[path], 5.0f);
+            }
+
+            Note::SampleT out[BLOCK];
+            auto run = [&](int path)
+            {
+                for (size_t i = 0; i < CALLS_PER_ROUND; ++i)
+                {
+                    memset(out, 0, sizeof(out));
+                    if (path)
+                    {
+                        note->updateBlocks(out, BLOCK, st[path], sysParams);
+                    }
+                    else
+                    {
+                        note->updateSamples(out, BLOCK, st[path], sysParams);
+                    }
+                    consume(out[BLOCK - 1]);
+                }
+            };
+
+            double best[2] = {1e30, 1e30};
+            size_t calls = 0;
+            double elapsed = 0;
+            for (int round = 0; round < MIN_ROUNDS || elapsed < minTimeSec_; ++round)
+            {
+                for (int path = 0; path < 2; ++path)
+                {
+                    auto t0 = clock::now();
+                    run(path);
+                    const double t = std::chrono::duration<double>(clock::now() - t0).count();
+                    best[path] = std::min(best[path], t * 1e9 / CALLS_PER_ROUND);
+                    elapsed += t;
+                }
+                calls += CALLS_PER_ROUND;
+            }
+
+            const auto params = format("key=%g block=%g", key, note->getBlockSize());
+            results_.push_back({"Note::updateSamples", params, BLOCK, calls, best[0]});
+            results_.push_back({"Note::updateBlocks", params, BLOCK, calls, best[1]});
+            fprintf(stderr, "%-28s %-24s %10.2f ns/call %8.3f ns/sample\n",
+                    "Note::updateSamples", params.c_str(), best[0], best[0] / BLOCK);
+            fprintf(stderr, "%-28s %-24s %10.2f ns/call %8.3f ns/sample  %.2fx\n",
+                    "Note::updateBlocks", params.c_str(), best[1], best[1] / BLOCK, best[0] / best[1]);
+        }
+    }
+
+    void benchSoundboard()
+    {
+        SystemParameters sysParams;
+        Soundboard soundboard;
+        soundboard.initialize(sysParams);
+
+        constexpr size_t BLOCK = 64;
+        auto in = makeSignal<Soundboard::ValueT>(BLOCK, 0.1f);
+        Soundboard::ResultT out[BLOCK];
+
+        measure("Soundboard::update", format("block=%g", BLOCK), BLOCK, 1,
+                [&]
+                {
+                    soundboard.update(out, in.data(), BLOCK);
+                    consume(out[BLOCK - 1]);
+                });
+    }
+
+    void benchConvolution()
+    {
+        // 1 秒で -60dB になる雑音をインパルス応答にする
+        constexpr size_t IR_LENGTH = SystemParameters::sampleRate;
+        auto ir = makeSignal<float>(IR_LENGTH, 0.1f);
+        for (size_t i = 0; i < IR_LENGTH; ++i)
+        {
+            ir[i] *= powf(10.0f, -3.0f * i / IR_LENGTH);
+        }
+
+        // FFT は partition サンプルごとなので、1024 サンプル分をまとめて測る
+        constexpr size_t BLOCK = 64;
+        constexpr size_t N_BLOCKS = 1024 / BLOCK;
+        auto in = makeSignal<float>(BLOCK * N_BLOCKS, 0.1f);
+        float out[BLOCK];
+
+        for (size_t partition : {16, 64, 256, 1024})
+        {
+            PartitionedConvolver convolver;
+            convolver.initialize(ir.data(), ir.size(), partition);
+
+            measure("PartitionedConvolver", format("ir=%g partition=%g", IR_LENGTH, partition),
+                    BLOCK, N_BLOCKS,
+                    [&]
+                    {
+                        for (size_t k = 0; k < N_BLOCKS; ++k)
+                        {
+                            convolver.process(out, &in[k * BLOCK], BLOCK);
+                            consume(out[BLOCK - 1]);
+                        }
+                    });
+        }
+    }
+
+    void writeJSON(FILE *fp)
+    {
+        fprintf(fp, "{\n");
+        fprintf(fp, "  \"sampleRate\": %u,\n", (unsigned)SystemParameters::sampleRate);
+        fprintf(fp, "  \"fixedPoint\": %s,\n", USE_FIXED_POINT ? "true" : "false");
+        fprintf(fp, "  \"kernels\": [\n");
+        for (size_t i = 0; i < results_.size(); ++i)
+        {
+            const auto &r = results_[i];
+            fprintf(fp,
+                    "    {\"name\": \"%s\", \"params\": \"%s\", \"samplesPerCall\": %zd, "
+                    "\"calls\": %zd, \"nsPerCall\": %.3f, \"nsPerSample\": %.4f}%s\n",
+                    r.name.c_str(),
+                    r.params.c_str(),
+                    r.samplesPerCall,
+                    r.calls,
+                    r.nsPerCall,
+                    r.nsPerCall / r.samplesPerCall,
+                    i + 1 < results_.size() ? "," : "");
+        }
+        fprintf(fp, "  ]\n}\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // エンジン側の初期化ログが stdout に出るので結果はファイルに書く
+    const char *output = "bench_kernels.json";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+        {
+            minTimeSec_ = atof(argv[++i]) * 1e-3;
+        }
+        else
+        {
+            printf("usage: pm_piano_bench_kernels [-t min_ms_per_kernel] [-o result.json]\n");
+            return 1;
+        }
+    }
+
+    benchDelay();
+    benchLossFilter();
+    benchDispersionFilter();
+    benchThirianFilter();
+    benchHammer();
+    benchString();
+    benchNote();
+    benchNotePaths();
+    benchSoundboard();
+    benchConvolution();
+
+    FILE *fp = fopen(output, "w");
+    if (!fp)
+    {
+        printf("%s: cannot open.\n", output);
+        return 1;
+    }
+    writeJSON(fp);
+    fclose(fp);
+    fprintf(stderr, "wrote %s\n", output);
+    return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 03:40:09
+ */
+
+// 高負荷シナリオでのブロック単位レンダリング時間 (p50/p99/max) を計る
+
+#include "scenario.h"
+#include <pm_piano/piano.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace physical_modeling_piano;
+
+namespace
+{
+    // audio.cpp の HALF_RING_SAMPLES
+    constexpr size_t BLOCK_SAMPLES = 64;
+
+    struct Result
+    {
+        std::string scenario;
+        int nPoly;
+        size_t blocks;
+        size_t maxNotes;
+        double p50;
+        double p99;
+        double max;
+        size_t overruns;  // 締め切りを超えたブロック数
+        size_t minLimit;  // -g のとき LoadGovernor が下げた同時発音数の最小
+        int maxBias;      // -g のとき LoadGovernor が上げた詳細度のバイアスの最大
+        double meanImbalance; // 2 コアに振り分けたときの見込みの偏り (差 / 合計) の平均
+        double maxImbalance;
+    };
+
+    double percentile(const std::vector<double> &sorted, double q)
+    {
+        size_t i = size_t(q * sorted.size() + 0.999999);
+        return sorted[std::min(sorted.size(), std::max<size_t>(i, 1)) - 1];
+    }
+
+    // governorDeadline が 0 でなければ、その締め切りで Piano::reportLoad に処理時間を渡す
+    Result run(const scenario::Scenario &s, int nPoly, bool voiceBank, double deadline, double governorDeadline)
+    {
+        auto piano = std::make_unique<Piano>();
+        piano->initialize(nPoly);
+        piano->setUseVoiceBank(voiceBank);
+
+        io::MidiMessageQueue midiIn;
+        midiIn.setActive(true);
+        scenario::Player player(s);
+
+        std::vector<double> times;
+        times.reserve(s.length / BLOCK_SAMPLES + 1);
+        size_t maxNotes = 0;
+        size_t overruns = 0;
+        size_t minLimit = nPoly;
+        int maxBias = 0;
+        double sumImbalance = 0;
+        uint32_t maxImbalance = 0;
+
+        int16_t block[BLOCK_SAMPLES];
+        for (size_t pos = 0; pos < s.length; pos += BLOCK_SAMPLES)
+        {
+            player.feed(midiIn, pos + BLOCK_SAMPLES);
+
+            auto t0 = std::chrono::steady_clock::now();
+            piano->update(block, BLOCK_SAMPLES, midiIn);
+            auto t1 = std::chrono::steady_clock::now();
+
+            double us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+            times.push_back(us);
+            maxNotes = std::max(maxNotes, piano->getCurrentNoteCount());
+
+            // ホストでは worker() を回さないので見込みの方を見る
+            const auto imbalance = NoteManager::WorkBalance::imbalance(piano->getWorkBalance().planned);
+            sumImbalance += imbalance;
+            maxImbalance = std::max(maxImbalance, imbalance);
+
+            if (governorDeadline > 0)
+            {
+                // 1/10 us 単位で渡す
+                piano->reportLoad(uint32_t(us * 10), uint32_t(governorDeadline * 10));
+                minLimit = std::min(minLimit, piano->getPolyphonyLimit());
+                maxBias = std::max(maxBias, piano->getDetailBias());
+            }
+            if (us > (governorDeadline > 0 ? governorDeadline : deadline))
+            {
+                ++overruns;
+            }
+        }
+
+        std::sort(times.begin(), times.end());
+        return {s.name, nPoly, times.size(), maxNotes,
+                percentile(times, 0.5), percentile(times, 0.99), times.back(),
+                overruns, minLimit, maxBias,
+                sumImbalance / 1024 / times.size(), maxImbalance / 1024.0};
+    }
+
+    std::vector<int> parseList(const char *s)
+    {
+        std::vector<int> r;
+        while (*s)
+        {
+            r.push_back(atoi(s));
+            while (*s && *s != ',')
+            {
+                ++s;
+            }
+            if (*s)
+            {
+                ++s;
+            }
+        }
+        return r;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> polys = {9, 16, 32, 64};
+    const char *filter = nullptr;
+    const char *output = "bench_scenarios.json";
+    bool voiceBank = false;
+    double governorDeadline = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc)
+        {
+            polys = parseList(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-b"))
+        {
+            voiceBank = true;
+        }
+        else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+        {
+            governorDeadline = atof(argv[++i]);
+        }
+        else
+        {
+            printf("usage: pm_piano_bench_scenarios [-p poly,poly,...] [-s scenario] [-b] [-g deadline_us] [-o result.json]\n");
+            printf("  -g: let the load governor adapt polyphony and detail to this per-block deadline\n");
+            return 1;
+        }
+    }
+
+    constexpr auto sampleRate = SystemParameters::sampleRate;
+    const double deadline = BLOCK_SAMPLES * 1e6 / sampleRate;
+
+    std::vector<Result> results;
+    for (const auto &s : scenario::makeAllScenarios(sampleRate))
+    {
+        if (filter && s.name != filter)
+        {
+            continue;
+        }
+        for (int nPoly : polys)
+        {
+            auto r = run(s, nPoly, voiceBank, deadline, governorDeadline);
+            fprintf(stderr, "%-22s poly %3d: notes %3zd  p50 %8.2f us  p99 %8.2f us  max %8.2f us  (max %5.1f%% of %.1f us)  overruns %zd",
+                    r.scenario.c_str(), r.nPoly, r.maxNotes, r.p50, r.p99, r.max,
+                    r.max * 100 / deadline, deadline, r.overruns);
+            if (governorDeadline > 0)
+            {
+                fprintf(stderr, "  limit >= %zd  bias <= %d", r.minLimit, r.maxBias);
+            }
+            fprintf(stderr, "  imbalance %4.1f%% (max %5.1f%%)\n", r.meanImbalance * 100, r.maxImbalance * 100);
+            results.push_back(r);
+        }
+    }
+
+    FILE *fp = fopen(output, "w");
+    if (!fp)
+    {
+        printf("%s: cannot open.\n", output);
+        return 1;
+    }
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"sampleRate\": %u,\n", (unsigned)sampleRate);
+    fprintf(fp, "  \"blockSamples\": %zd,\n", BLOCK_SAMPLES);
+    fprintf(fp, "  \"deadlineUs\": %.3f,\n", deadline);
+    fprintf(fp, "  \"voiceBank\": %s,\n", voiceBank ? "true" : "false");
+    fprintf(fp, "  \"governorDeadlineUs\": %.3f,\n", governorDeadline);
+    fprintf(fp, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const auto &r = results[i];
+        fprintf(fp,
+                "    {\"scenario\": \"%s\", \"polyphony\": %d, \"blocks\": %zd, \"maxNotes\": %zd, "
+                "\"p50Us\": %.3f, \"p99Us\": %.3f, \"maxUs\": %.3f, \"overruns\": %zd, "
+                "\"minPolyphonyLimit\": %zd, \"maxDetailBias\": %d, "
+                "\"meanImbalance\": %.4f, \"maxImbalance\": %.4f}%s\n",
+                r.scenario.c_str(), r.nPoly, r.blocks, r.maxNotes, r.p50, r.p99, r.max,
+                r.overruns, r.minLimit, r.maxBias, r.meanImbalance, r.maxImbalance,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    fprintf(stderr, "wrote %s\n", output);
+    return 0;
+}
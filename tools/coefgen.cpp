@@ -0,0 +1,112 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 16:16:08
+ */
+
+// 鍵ごとの Note の係数を計算して、表 (note_table) にした C++ のソースを出す
+// USE_PREBUILT_NOTE_TABLE でビルドするときにリンクすると、起動時の Note::initialize() がなくなる
+// 表はこのツールと同じ USE_FIXED_POINT とサンプリング周波数のエンジンでしか読めない
+
+#include "sys_params_option.h"
+#include <pm_piano/coefficients.h>
+#include <pm_piano/note.h>
+#include <pm_piano/note_manager.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace physical_modeling_piano;
+
+namespace
+{
+    constexpr int N_NOTES = NoteManager::NOTE_END - NoteManager::NOTE_BEGIN;
+
+    void usage()
+    {
+        printf("usage: pm_piano_coefgen [-H note] [-P name=value]... [-o file]\n");
+        printf("  writes the per-key Note coefficients for the given parameters as a C++ source\n");
+        printf("  defining prebuiltNoteTable (link it with USE_PREBUILT_NOTE_TABLE=1)\n");
+        printf("  -H: half-rate strings below this MIDI note (Piano::setHalfRateBelow)\n");
+        printf("  -P: override a SystemParameters value\n");
+        sys_params_option::printNames();
+    }
+
+    bool writeSource(FILE *fp, const std::vector<uint32_t> &words, const SystemParameters &sysParams)
+    {
+        fprintf(fp, "// generated by pm_piano_coefgen: do not edit\n");
+        fprintf(fp, "// sampleRate %u, %s, halfRateFrequency %g Hz\n",
+                unsigned(SystemParameters::sampleRate),
+                USE_FIXED_POINT ? "fixed point" : "floating point",
+                sysParams.halfRateFrequency);
+        fprintf(fp, "\n#include <pm_piano/coefficients.h>\n\n");
+        fprintf(fp, "namespace physical_modeling_piano\n{\n");
+        fprintf(fp, "    const uint32_t prebuiltNoteTable[] = {");
+        for (size_t i = 0; i < words.size(); ++i)
+        {
+            fprintf(fp, "%s0x%08x,", i % 8 ? " " : "\n        ", unsigned(words[i]));
+        }
+        fprintf(fp, "\n    };\n");
+        fprintf(fp, "    const size_t prebuiltNoteTableSize = %zu;\n", words.size());
+        fprintf(fp, "} // namespace physical_modeling_piano\n");
+        return !ferror(fp);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    SystemParameters sysParams;
+    const char *output = nullptr;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-H") && i + 1 < argc)
+        {
+            if (!sys_params_option::setHalfRateBelow(sysParams, atoi(argv[++i])))
+            {
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-P") && i + 1 < argc)
+        {
+            if (!sys_params_option::parse(sysParams, argv[++i]))
+            {
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    // NoteManager::initialize() と同じ周波数
+    std::vector<Note> notes(N_NOTES);
+    for (int i = 0; i < N_NOTES; ++i)
+    {
+        notes[i].initialize(440 * powf(2.0f, (i + NoteManager::NOTE_BEGIN - 69) / 12.0f), sysParams);
+    }
+
+    CoefficientWriter w;
+    note_table::write(w, notes.data(), notes.size(), sysParams);
+
+    FILE *fp = output ? fopen(output, "w") : stdout;
+    if (!fp)
+    {
+        printf("%s: cannot open.\n", output);
+        return 1;
+    }
+    const bool ok = writeSource(fp, w.getWords(), sysParams);
+    if (output && fclose(fp) != 0)
+    {
+        printf("%s: write failed.\n", output);
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 15:47:13
+ */
+
+// 遅延線のバッファに使う SRAM を、長さそのままの場合と 2 のべきに丸めた場合で比べる
+// ボイスごとの確保量は一番大きい音 (NoteManager の allocatorSize) で決まる
+// -r で音域ごとにボイスを分けたときの組ごとの大きさと合計も出す
+
+#include "voice_register.h"
+#include <pm_piano/note.h>
+#include <pm_piano/soundboard.h>
+#include <pm_piano/sys_params.h>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace physical_modeling_piano;
+
+namespace
+{
+    constexpr int KEY_LOW = 21;
+    constexpr int KEY_HIGH = 108;
+
+    size_t roundUpPow2(size_t n)
+    {
+        size_t r = 1;
+        while (r < n)
+        {
+            r <<= 1;
+        }
+        return r;
+    }
+
+    struct Usage
+    {
+        size_t exact = 0; // [サンプル]
+        size_t pow2 = 0;
+    };
+
+    Usage
+    noteUsage(const Note &note)
+    {
+        Usage u;
+        for (int i = 0; i < note.getStringCount(); ++i)
+        {
+            const auto &s = note.getString(i);
+            for (int j = 0; j < 4; ++j)
+            {
+                const size_t n = s.getRailLength(j);
+                u.exact += n;
+                u.pow2 += roundUpPow2(n);
+            }
+        }
+        return u;
+    }
+
+    void usage()
+    {
+        printf("usage: pm_piano_memory [-p polyphony] [-H note] [-r registers] [-v]\n");
+        printf("  reports the delay-line SRAM per voice with exact-length buffers against\n");
+        printf("  buffers rounded up to a power of two (-v: every key)\n");
+        printf("  -r: also size per-register voice pools, e.g. 48:4,72:8,109:16, against\n");
+        printf("      the same number of voices sized for the worst note\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int polyphony = 12;
+    int halfRateBelow = 0;
+    bool verbose = false;
+    std::vector<NoteManager::VoiceRegister> registers;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc)
+        {
+            polyphony = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-H") && i + 1 < argc)
+        {
+            halfRateBelow = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+        {
+            if (!voice_register::parse(registers, argv[++i]))
+            {
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-v"))
+        {
+            verbose = true;
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if (!USE_HALF_RATE && halfRateBelow > 0)
+    {
+        printf("half rate: not available in this build (USE_HALF_RATE=0)\n");
+        return 1;
+    }
+
+    SystemParameters sysParams;
+    // Piano::setHalfRateBelow() と同じ境目
+    sysParams.halfRateFrequency = halfRateBelow > 0 ? 440 * powf(2.0f, (halfRateBelow - 69.5f) / 12.0f) : 0;
+
+    constexpr size_t sampleBytes = sizeof(String::DelaySampleT);
+
+    size_t worstExact = 0; // [bytes]
+    size_t worstPow2 = 0;
+    int worstExactKey = KEY_LOW;
+    int worstPow2Key = KEY_LOW;
+    size_t sumExact = 0;
+    size_t sumPow2 = 0;
+    std::vector<size_t> unitSize(registers.size()); // 音域の中で一番大きい音 [bytes]
+    size_t reg = 0;
+    for (int key = KEY_LOW; key <= KEY_HIGH; ++key)
+    {
+        Note note;
+        note.initialize(440 * powf(2.0f, (key - 69) / 12.0f), sysParams);
+
+        const auto u = noteUsage(note);
+        // NoteManager が 1 ボイスに確保する量
+        const size_t bytes = note.computeAllocatorSize();
+        const size_t pow2Bytes = u.pow2 * sampleBytes;
+        if (verbose)
+        {
+            printf("key %3d: %d strings x%d, %5zu bytes (pow2 %5zu, %2.0f%% saved)\n",
+                   key, note.getStringCount(), note.getDecimation(), bytes, pow2Bytes,
+                   100.0 * (pow2Bytes - bytes) / pow2Bytes);
+        }
+        if (bytes > worstExact)
+        {
+            worstExact = bytes;
+            worstExactKey = key;
+        }
+        if (pow2Bytes > worstPow2)
+        {
+            worstPow2 = pow2Bytes;
+            worstPow2Key = key;
+        }
+        sumExact += bytes;
+        sumPow2 += pow2Bytes;
+
+        if (!registers.empty())
+        {
+            while (key >= registers[reg].noteEnd)
+            {
+                ++reg;
+            }
+            unitSize[reg] = std::max(unitSize[reg], bytes);
+        }
+    }
+
+    Soundboard soundboard;
+    soundboard.initialize(sysParams);
+    Usage board;
+    for (int i = 0; i < 8; ++i)
+    {
+        const size_t n = soundboard.getDelayBufferLength(i);
+        board.exact += n;
+        board.pow2 += roundUpPow2(n);
+    }
+
+    const size_t saved = worstPow2 - worstExact;
+    printf("delay memory per voice (worst note): %zu bytes (key %d), pow2 %zu bytes (key %d), %zu bytes saved\n",
+           worstExact, worstExactKey, worstPow2, worstPow2Key, saved);
+    printf("average over the keys: %zu bytes, pow2 %zu bytes\n",
+           sumExact / (KEY_HIGH - KEY_LOW + 1), sumPow2 / (KEY_HIGH - KEY_LOW + 1));
+    printf("%d voices: %zu bytes saved\n", polyphony, saved * polyphony);
+    printf("soundboard: %zu bytes, pow2 %zu bytes\n",
+           board.exact * sizeof(Soundboard::ValueT), board.pow2 * sizeof(Soundboard::ValueT));
+
+    if (!registers.empty())
+    {
+        // NoteManager と同じく組ごとの一番大きい音で 1 つ分を決める
+        size_t nVoices = 0;
+        size_t total = 0;
+        int low = KEY_LOW;
+        for (size_t i = 0; i < registers.size(); ++i)
+        {
+            const int high = std::min(registers[i].noteEnd, KEY_HIGH + 1) - 1;
+            printf("keys %3d-%3d: %2zu voices x %5zu bytes = %6zu bytes\n",
+                   low, high, registers[i].nVoices, unitSize[i], registers[i].nVoices * unitSize[i]);
+            nVoices += registers[i].nVoices;
+            total += registers[i].nVoices * unitSize[i];
+            low = high + 1;
+        }
+        const size_t uniform = nVoices * worstExact;
+        printf("%zu voices by register: %zu bytes, uniform %zu bytes (%zu bytes, %.0f%% saved)\n",
+               nVoices, total, uniform, uniform - total, 100.0 * (uniform - total) / uniform);
+        printf("uniform voices in the same memory: %zu\n", total / worstExact);
+    }
+    return 0;
+}
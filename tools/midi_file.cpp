@@ -0,0 +1,270 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 00:13:05
+ */
+
+#include "midi_file.h"
+#include <algorithm>
+#include <stdio.h>
+
+namespace io
+{
+    namespace
+    {
+        struct TrackEvent
+        {
+            uint64_t tick;
+            bool tempo;
+            uint32_t usPerQuarter;
+            MidiMessage message;
+        };
+
+        class Reader
+        {
+            const uint8_t *p_;
+            const uint8_t *tail_;
+
+        public:
+            Reader(const uint8_t *p, const uint8_t *tail)
+                : p_(p), tail_(tail)
+            {
+            }
+
+            bool remain(size_t n) const { return tail_ - p_ >= (ptrdiff_t)n; }
+            bool empty() const { return p_ >= tail_; }
+            const uint8_t *get() const { return p_; }
+            void skip(size_t n) { p_ += n; }
+
+            uint8_t u8() { return *p_++; }
+
+            uint32_t be(int n)
+            {
+                uint32_t v = 0;
+                while (n--)
+                {
+                    v = (v << 8) | *p_++;
+                }
+                return v;
+            }
+
+            bool varLen(uint32_t *v)
+            {
+                *v = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    if (empty())
+                    {
+                        return false;
+                    }
+                    auto c = u8();
+                    *v = (*v << 7) | (c & 0x7f);
+                    if (!(c & 0x80))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+        };
+
+        bool parseTrack(std::vector<TrackEvent> &events, Reader r)
+        {
+            uint64_t tick = 0;
+            uint8_t status = 0;
+
+            while (!r.empty())
+            {
+                uint32_t delta;
+                if (!r.varLen(&delta) || r.empty())
+                {
+                    return false;
+                }
+                tick += delta;
+
+                auto c = r.u8();
+                if (c == 0xff)
+                {
+                    // meta event
+                    uint32_t len;
+                    if (!r.remain(1))
+                    {
+                        return false;
+                    }
+                    auto type = r.u8();
+                    if (!r.varLen(&len) || !r.remain(len))
+                    {
+                        return false;
+                    }
+                    if (type == 0x51 && len == 3)
+                    {
+                        TrackEvent e{tick, true, 0, {}};
+                        e.usPerQuarter = r.be(3);
+                        events.push_back(e);
+                    }
+                    else
+                    {
+                        r.skip(len);
+                        if (type == 0x2f)
+                        {
+                            return true;
+                        }
+                    }
+                    continue;
+                }
+                if (c == 0xf0 || c == 0xf7)
+                {
+                    // sysex はエンジン側で使わないので読み飛ばす
+                    uint32_t len;
+                    if (!r.varLen(&len) || !r.remain(len))
+                    {
+                        return false;
+                    }
+                    r.skip(len);
+                    continue;
+                }
+
+                if (c > 0xf0)
+                {
+                    return false;
+                }
+
+                uint8_t d[3] = {};
+                int pos = 0;
+                if (c & 0x80)
+                {
+                    status = c;
+                }
+                else
+                {
+                    // running status
+                    if (!status)
+                    {
+                        return false;
+                    }
+                    d[1] = c;
+                    pos = 1;
+                }
+                d[0] = status;
+
+                int size = ((status & 0xf0) == 0xc0 || (status & 0xf0) == 0xd0) ? 2 : 3;
+                if (!r.remain(size - 1 - pos))
+                {
+                    return false;
+                }
+                for (int i = pos + 1; i < size; ++i)
+                {
+                    d[i] = r.u8();
+                }
+
+                if ((d[0] & 0xf0) == 0x90 && d[2] == 0)
+                {
+                    // velocity 0 の note on は note off
+                    d[0] = 0x80 | (d[0] & 0x0f);
+                }
+
+                TrackEvent e{tick, false, 0, {}};
+                e.message = size == 2 ? MidiMessage(d[0], d[1]) : MidiMessage(d[0], d[1], d[2]);
+                events.push_back(e);
+            }
+            return true;
+        }
+    }
+
+    bool
+    MidiFile::load(const char *filename)
+    {
+        auto fp = fopen(filename, "rb");
+        if (!fp)
+        {
+            printf("%s: cannot open.\n", filename);
+            return false;
+        }
+
+        std::vector<uint8_t> data;
+        uint8_t buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        {
+            data.insert(data.end(), buf, buf + n);
+        }
+        fclose(fp);
+
+        if (!parse(data))
+        {
+            printf("%s: not a supported standard MIDI file.\n", filename);
+            return false;
+        }
+        return true;
+    }
+
+    bool
+    MidiFile::parse(const std::vector<uint8_t> &data)
+    {
+        events_.clear();
+
+        Reader r(data.data(), data.data() + data.size());
+        if (!r.remain(14) || r.be(4) != 0x4d546864 /* MThd */)
+        {
+            return false;
+        }
+        auto headerSize = r.be(4);
+        if (headerSize < 6 || !r.remain(headerSize))
+        {
+            return false;
+        }
+        auto format = r.be(2);
+        auto nTracks = r.be(2);
+        auto division = r.be(2);
+        r.skip(headerSize - 6);
+
+        if (format > 1 || (division & 0x8000) || division == 0)
+        {
+            // format 2 と SMPTE timecode は非対応
+            return false;
+        }
+
+        std::vector<TrackEvent> events;
+        for (uint32_t i = 0; i < nTracks; ++i)
+        {
+            if (!r.remain(8))
+            {
+                return false;
+            }
+            auto id = r.be(4);
+            auto size = r.be(4);
+            if (!r.remain(size))
+            {
+                return false;
+            }
+            if (id == 0x4d54726b /* MTrk */ &&
+                !parseTrack(events, Reader(r.get(), r.get() + size)))
+            {
+                return false;
+            }
+            r.skip(size);
+        }
+
+        std::stable_sort(events.begin(), events.end(),
+                         [](const TrackEvent &a, const TrackEvent &b)
+                         { return a.tick < b.tick; });
+
+        double time = 0;
+        uint64_t prevTick = 0;
+        double secPerTick = 0.5 / division; // 120 BPM
+        for (auto &e : events)
+        {
+            time += (e.tick - prevTick) * secPerTick;
+            prevTick = e.tick;
+
+            if (e.tempo)
+            {
+                secPerTick = e.usPerQuarter * 1e-6 / division;
+            }
+            else
+            {
+                events_.push_back({time, e.message});
+            }
+        }
+        return true;
+    }
+}
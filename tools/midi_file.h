@@ -0,0 +1,34 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 00:12:40
+ */
+#pragma once
+
+#include "midi.h"
+#include <vector>
+
+namespace io
+{
+    // Standard MIDI File (format 0/1) を読んで時刻順のイベント列にする
+    class MidiFile
+    {
+    public:
+        struct Event
+        {
+            double time; // [sec]
+            MidiMessage message;
+        };
+
+    public:
+        bool load(const char *filename);
+
+        const std::vector<Event> &getEvents() const { return events_; }
+        double getLength() const { return events_.empty() ? 0.0 : events_.back().time; }
+
+    protected:
+        bool parse(const std::vector<uint8_t> &data);
+
+    private:
+        std::vector<Event> events_;
+    };
+}
@@ -0,0 +1,318 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 15:24:51
+ */
+
+// 低音の弦を半分のレートで回したときの音程と減衰を、そのままのレートで回したものと比べる
+// 響板を通さない 1 音の出力で、倍音ごとの周波数と減衰の速さ、1 ブロックの処理時間を測る
+
+#include <pm_piano/fft.h>
+#include <pm_piano/note.h>
+#include <pm_piano/sys_params.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace physical_modeling_piano;
+
+static_assert(USE_HALF_RATE, "pm_piano_multirate needs the engine built with USE_HALF_RATE=1");
+
+namespace
+{
+    constexpr size_t BLOCK_SAMPLES = 64;
+    constexpr int N_PARTIALS = 8;
+
+    constexpr double PITCH_WINDOW_SEC = 0.1; // 音程を測る窓の始まり
+    // 減衰はこの間の窓ごとの大きさに直線を当てはめて測る (ユニゾンのうなりをならす)
+    constexpr double DECAY_BEGIN_SEC = 0.2;
+    constexpr double DECAY_END_SEC = 1.8;
+    constexpr double DECAY_STEP_SEC = 0.1;
+    constexpr double LENGTH_SEC = 2.2;
+    constexpr size_t PITCH_FFT = 32768;
+    constexpr size_t DECAY_FFT = 8192;
+
+    // 半分のレートで許す差 (これを超えたら終了コード 1)
+    // 倍音の減衰はユニゾンのうなりで回帰の傾きが揺れるので、float でも 3.5dB/s ほど違う
+    constexpr double TOLERANCE_F1_CENTS = 1.0;
+    constexpr double TOLERANCE_F1_DECAY = 0.5; // [dB/s]
+    constexpr double TOLERANCE_PARTIAL_CENTS = 5.0;
+    constexpr double TOLERANCE_PARTIAL_DECAY = 5.0; // [dB/s]
+
+    struct Rendered
+    {
+        std::vector<float> samples;
+        double usPerBlock = 0;
+    };
+
+    float keyFrequency(int key)
+    {
+        return 440 * powf(2.0f, (key - 69) / 12.0f);
+    }
+
+    Rendered
+    renderNote(int key, int velocity, float halfRateFrequency)
+    {
+        SystemParameters sysParams;
+        sysParams.halfRateFrequency = halfRateFrequency;
+
+        Note note;
+        note.initialize(keyFrequency(key), sysParams);
+        std::vector<uint32_t> delayMemory((note.computeAllocatorSize() + 3) / 4);
+        Note::State state;
+        state.delayMemory = delayMemory.data();
+        note.keyOn(state, Hammer::VelocityT(velocity * (10 / 127.0f)));
+
+        PedalState pedal{};
+        const size_t nBlocks = size_t(LENGTH_SEC * SystemParameters::sampleRate) / BLOCK_SAMPLES;
+
+        Rendered r;
+        r.samples.reserve(nBlocks * BLOCK_SAMPLES);
+        std::chrono::steady_clock::duration t{};
+        for (size_t b = 0; b < nBlocks; ++b)
+        {
+            Note::SampleT buf[BLOCK_SAMPLES];
+            for (auto &v : buf)
+            {
+                v = 0;
+            }
+            auto t0 = std::chrono::steady_clock::now();
+            note.update(buf, BLOCK_SAMPLES, state, sysParams, pedal);
+            t += std::chrono::steady_clock::now() - t0;
+
+            for (auto &v : buf)
+            {
+                r.samples.push_back(float(v));
+            }
+        }
+        r.usPerBlock = std::chrono::duration<double, std::micro>(t).count() / nBlocks;
+        return r;
+    }
+
+    // start から n サンプルに Hann 窓をかけた振幅スペクトル [dB]
+    std::vector<float>
+    spectrum(const std::vector<float> &x, size_t start, size_t n)
+    {
+        RealFFT fft;
+        fft.initialize(n);
+        std::vector<float> in(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            const float w = 0.5f - 0.5f * cosf(2 * 3.1415927f * i / n);
+            in[i] = x[start + i] * w;
+        }
+        std::vector<RealFFT::Complex> out(fft.getBinCount());
+        fft.forward(out.data(), in.data());
+
+        std::vector<float> db(out.size());
+        for (size_t i = 0; i < out.size(); ++i)
+        {
+            db[i] = 10 * log10f(std::norm(out[i]) + 1e-30f);
+        }
+        return db;
+    }
+
+    struct Peak
+    {
+        double freq; // [Hz]
+        double level; // [dB]
+    };
+
+    // [lo, hi) Hz で一番大きいビンを放物線で補間する
+    Peak
+    findPeak(const std::vector<float> &db, size_t fftSize, double lo, double hi)
+    {
+        const double binHz = double(SystemParameters::sampleRate) / fftSize;
+        size_t b0 = std::max<size_t>(1, size_t(lo / binHz));
+        size_t b1 = std::min(db.size() - 1, size_t(hi / binHz) + 1);
+        size_t best = b0;
+        for (size_t b = b0; b < b1; ++b)
+        {
+            if (db[b] > db[best])
+            {
+                best = b;
+            }
+        }
+        const double a = db[best - 1];
+        const double c = db[best];
+        const double e = db[best + 1];
+        const double den = a - 2 * c + e;
+        const double d = den != 0 ? 0.5 * (a - e) / den : 0;
+        return {(best + d) * binHz, c - 0.25 * (a - e) * d};
+    }
+
+    struct Partials
+    {
+        double freq[N_PARTIALS];
+        double decay[N_PARTIALS]; // [dB/s]
+        double level[N_PARTIALS]; // 減衰を測る最初の窓での大きさ [dB]
+    };
+
+    // ref が nullptr なら倍音を探し、あればその周波数の近くで測る
+    Partials
+    analyze(const std::vector<float> &x, float f0, const Partials *ref)
+    {
+        const size_t sr = SystemParameters::sampleRate;
+        const auto pitch = spectrum(x, size_t(PITCH_WINDOW_SEC * sr), PITCH_FFT);
+
+        const double window = double(DECAY_FFT) / sr;
+        std::vector<std::vector<float>> frames;
+        std::vector<double> times;
+        for (double t = DECAY_BEGIN_SEC; t + window <= DECAY_END_SEC; t += DECAY_STEP_SEC)
+        {
+            frames.push_back(spectrum(x, size_t(t * sr), DECAY_FFT));
+            times.push_back(t);
+        }
+
+        Partials p;
+        double prev = 0;
+        double spacing = f0;
+        for (int k = 0; k < N_PARTIALS; ++k)
+        {
+            // 倍音は不調和性で少しずつ広がるので、前の間隔から次を見込む
+            const double center = ref ? ref->freq[k] : prev + spacing;
+            const double range = ref ? 0.25 * f0 : 0.4 * f0;
+            p.freq[k] = findPeak(pitch, PITCH_FFT, center - range, center + range).freq;
+            if (!ref)
+            {
+                spacing = p.freq[k] - prev;
+                prev = p.freq[k];
+            }
+
+            // 最小二乗で傾きを求める
+            const double r = 0.25 * f0;
+            double st = 0, sl = 0, stt = 0, stl = 0;
+            for (size_t i = 0; i < frames.size(); ++i)
+            {
+                const double l = findPeak(frames[i], DECAY_FFT, p.freq[k] - r, p.freq[k] + r).level;
+                if (i == 0)
+                {
+                    p.level[k] = l;
+                }
+                st += times[i];
+                sl += l;
+                stt += times[i] * times[i];
+                stl += times[i] * l;
+            }
+            const double n = double(frames.size());
+            p.decay[k] = -(n * stl - st * sl) / (n * stt - st * st);
+        }
+        return p;
+    }
+
+    void usage()
+    {
+        printf("usage: pm_piano_multirate [-H note] [-k low-high] [-v velocity]\n");
+        printf("  compares each key below the half-rate crossover note (default 48) rendered at\n");
+        printf("  half rate against the same key at the full rate: partial frequencies, decay and cost\n");
+        printf("  exits with 1 when the worst difference is outside the tolerances\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int crossover = 48;
+    int keyLow = 21;
+    int keyHigh = -1;
+    int velocity = 100;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-H") && i + 1 < argc)
+        {
+            crossover = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-k") && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%d-%d", &keyLow, &keyHigh) != 2)
+            {
+                usage();
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-v") && i + 1 < argc)
+        {
+            velocity = atoi(argv[++i]);
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (keyHigh < 0)
+    {
+        keyHigh = crossover - 1;
+    }
+    keyHigh = std::min(keyHigh, crossover - 1);
+    if (keyLow > keyHigh)
+    {
+        usage();
+        return 1;
+    }
+
+    // Piano::setHalfRateBelow() と同じ境目
+    const float halfRateFrequency = 440 * powf(2.0f, (crossover - 69.5f) / 12.0f);
+
+    double worstF1Cents = 0;
+    double worstF1Decay = 0;
+    double worstCents = 0;
+    double worstDecay = 0;
+    double fullUs = 0;
+    double halfUs = 0;
+    for (int key = keyLow; key <= keyHigh; ++key)
+    {
+        const float f0 = keyFrequency(key);
+        const auto full = renderNote(key, velocity, 0);
+        const auto half = renderNote(key, velocity, halfRateFrequency);
+
+        const auto pf = analyze(full.samples, f0, nullptr);
+        const auto ph = analyze(half.samples, f0, &pf);
+
+        // 一番大きい倍音から 40dB 以内のものだけ比べる
+        double top = pf.level[0];
+        for (int k = 1; k < N_PARTIALS; ++k)
+        {
+            top = std::max(top, pf.level[k]);
+        }
+        double cents = 0;
+        double decay = 0;
+        for (int k = 0; k < N_PARTIALS; ++k)
+        {
+            if (pf.level[k] < top - 40)
+            {
+                continue;
+            }
+            cents = std::max(cents, fabs(1200 * log2(ph.freq[k] / pf.freq[k])));
+            decay = std::max(decay, fabs(ph.decay[k] - pf.decay[k]));
+        }
+        const double f1Cents = 1200 * log2(ph.freq[0] / pf.freq[0]);
+        worstF1Cents = std::max(worstF1Cents, fabs(f1Cents));
+        worstF1Decay = std::max(worstF1Decay, fabs(ph.decay[0] - pf.decay[0]));
+        worstCents = std::max(worstCents, cents);
+        worstDecay = std::max(worstDecay, decay);
+        fullUs += full.usPerBlock;
+        halfUs += half.usPerBlock;
+
+        printf("key %3d %7.2f Hz  f1 %+6.2f cents (partials max %5.2f)  f1 decay %6.2f / %6.2f dB/s (partials max diff %5.2f)  cost %6.2f / %6.2f us\n",
+               key, f0,
+               f1Cents, cents,
+               pf.decay[0], ph.decay[0], decay,
+               full.usPerBlock, half.usPerBlock);
+    }
+
+    printf("keys %d-%d: worst f1 pitch %.2f cents, f1 decay %.2f dB/s; worst partial pitch %.2f cents, partial decay %.2f dB/s; cost %.0f%% of full rate\n",
+           keyLow, keyHigh, worstF1Cents, worstF1Decay, worstCents, worstDecay, 100 * halfUs / fullUs);
+
+    const bool pass = worstF1Cents <= TOLERANCE_F1_CENTS &&
+                      worstF1Decay <= TOLERANCE_F1_DECAY &&
+                      worstCents <= TOLERANCE_PARTIAL_CENTS &&
+                      worstDecay <= TOLERANCE_PARTIAL_DECAY;
+    printf("%s (tolerances: f1 %.1f cents, %.1f dB/s; partials %.1f cents, %.1f dB/s)\n",
+           pass ? "PASS" : "FAIL",
+           TOLERANCE_F1_CENTS, TOLERANCE_F1_DECAY, TOLERANCE_PARTIAL_CENTS, TOLERANCE_PARTIAL_DECAY);
+    return pass ? 0 : 1;
+}
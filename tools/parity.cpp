@@ -0,0 +1,240 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 06:31:37
+ */
+
+// 固定小数点版と浮動小数点版 (-c なら遅延線を 16bit で持つ版) で同じ入力をレンダリングして、
+// 1 音ごとの誤差 (SNR, 最大偏差) と処理時間を比べる
+
+#include "midi_file.h"
+#include "piano_variant.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // audio.cpp の HALF_RING_SAMPLES
+    constexpr size_t BLOCK_SAMPLES = 64;
+
+    struct Event
+    {
+        size_t sample;
+        io::MidiMessage message;
+    };
+
+    struct Rendered
+    {
+        std::vector<int16_t> samples;
+        double renderSec = 0;
+    };
+
+    Rendered
+    render(parity::Renderer &r, const std::vector<Event> &events, size_t length)
+    {
+        io::MidiMessageQueue midiIn;
+        midiIn.setActive(true);
+
+        Rendered out;
+        out.samples.resize((length + BLOCK_SAMPLES - 1) / BLOCK_SAMPLES * BLOCK_SAMPLES);
+
+        std::chrono::steady_clock::duration t{};
+        auto ev = events.begin();
+        for (size_t pos = 0; pos < out.samples.size(); pos += BLOCK_SAMPLES)
+        {
+            while (ev != events.end() && ev->sample < pos + BLOCK_SAMPLES)
+            {
+                midiIn.put(ev->message);
+                ++ev;
+            }
+
+            auto t0 = std::chrono::steady_clock::now();
+            r.update(out.samples.data() + pos, BLOCK_SAMPLES, midiIn);
+            t += std::chrono::steady_clock::now() - t0;
+        }
+        out.renderSec = std::chrono::duration<double>(t).count();
+        return out;
+    }
+
+    struct Result
+    {
+        std::string name;
+        double snr;     // [dB] 固定小数点版を基準にした誤差
+        int peak;       // [LSB] 最大偏差
+        double level;   // [dB] 比べる版の RMS / 固定小数点版の RMS
+        double fixedUs; // 1 ブロックあたりの処理時間
+        double variantUs;
+    };
+
+    using MakeRenderer = std::unique_ptr<parity::Renderer> (*)(int nPoly);
+
+    Result
+    compare(const std::string &name, MakeRenderer makeVariant,
+            const std::vector<Event> &events, size_t length, int nPoly)
+    {
+        auto fixed = render(*parity::makeFixedPointRenderer(nPoly), events, length);
+        auto other = render(*makeVariant(nPoly), events, length);
+
+        double signal = 0;
+        double noise = 0;
+        double signalOther = 0;
+        int peak = 0;
+        for (size_t i = 0; i < fixed.samples.size(); ++i)
+        {
+            int a = fixed.samples[i];
+            int d = other.samples[i] - a;
+            signal += double(a) * a;
+            signalOther += double(other.samples[i]) * other.samples[i];
+            noise += double(d) * d;
+            peak = std::max(peak, abs(d));
+        }
+
+        double blocks = double(fixed.samples.size() / BLOCK_SAMPLES);
+        return {name,
+                noise > 0 ? 10 * log10(signal / noise) : INFINITY,
+                peak,
+                signal > 0 ? 10 * log10(signalOther / signal) : 0.0,
+                fixed.renderSec * 1e6 / blocks,
+                other.renderSec * 1e6 / blocks};
+    }
+
+    void usage()
+    {
+        printf("usage: pm_piano_parity [-c] [-k low-high] [-v velocity] [-d hold_sec] [-p polyphony] [-o result.json] [input.mid]\n");
+        printf("  renders every key in low-high alone, and input.mid if given, with both arithmetic variants\n");
+        printf("  -c: compare the 16-bit delay-line variant (USE_COMPACT_DELAY) instead of floating point\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const uint32_t sampleRate = parity::getSampleRate();
+    int keyLow = 21;
+    int keyHigh = 108;
+    int velocity = 100;
+    double hold = 1.0;
+    int nPoly = 9;
+    const char *input = nullptr;
+    const char *output = "parity.json";
+    const char *variant = "float";
+    MakeRenderer makeVariant = parity::makeFloatRenderer;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-c"))
+        {
+            variant = "compact";
+            makeVariant = parity::makeCompactRenderer;
+        }
+        else if (!strcmp(argv[i], "-k") && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%d-%d", &keyLow, &keyHigh) != 2)
+            {
+                usage();
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-v") && i + 1 < argc)
+        {
+            velocity = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+        {
+            hold = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+        {
+            nPoly = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (argv[i][0] != '-' && !input)
+        {
+            input = argv[i];
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (keyLow > keyHigh || nPoly <= 0)
+    {
+        usage();
+        return 1;
+    }
+
+    std::vector<Result> results;
+    auto report = [&](const Result &r)
+    {
+        fprintf(stderr, "%-10s SNR %7.2f dB  peak %5d LSB  level %+6.2f dB  fixed %8.2f us  %s %8.2f us  (%s/fixed %.2f)\n",
+                r.name.c_str(), r.snr, r.peak, r.level, r.fixedUs, variant, r.variantUs, variant, r.variantUs / r.fixedUs);
+        results.push_back(r);
+    };
+
+    // 1 音ずつ: hold 秒押して離し、0.5 秒の余韻まで
+    const size_t holdSamples = size_t(hold * sampleRate);
+    const size_t length = holdSamples + sampleRate / 2;
+    for (int key = keyLow; key <= keyHigh; ++key)
+    {
+        std::vector<Event> events = {
+            {0, io::MidiMessage(0x90, key, velocity)},
+            {holdSamples, io::MidiMessage(0x80, key, 0)},
+        };
+        report(compare("key " + std::to_string(key), makeVariant, events, length, nPoly));
+    }
+
+    if (input)
+    {
+        io::MidiFile midiFile;
+        if (!midiFile.load(input))
+        {
+            return 1;
+        }
+        std::vector<Event> events;
+        for (const auto &e : midiFile.getEvents())
+        {
+            events.push_back({size_t(e.time * sampleRate), e.message});
+        }
+        report(compare("midi", makeVariant, events, size_t((midiFile.getLength() + 3.0) * sampleRate), nPoly));
+    }
+
+    FILE *fp = fopen(output, "w");
+    if (!fp)
+    {
+        printf("%s: cannot open.\n", output);
+        return 1;
+    }
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"sampleRate\": %u,\n", (unsigned)sampleRate);
+    fprintf(fp, "  \"blockSamples\": %zd,\n", BLOCK_SAMPLES);
+    fprintf(fp, "  \"velocity\": %d,\n", velocity);
+    fprintf(fp, "  \"variant\": \"%s\",\n", variant);
+    fprintf(fp, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const auto &r = results[i];
+        // JSON に inf は書けないので一致したときは null
+        char snr[32] = "null";
+        if (isfinite(r.snr))
+        {
+            snprintf(snr, sizeof(snr), "%.3f", r.snr);
+        }
+        fprintf(fp,
+                "    {\"name\": \"%s\", \"snrDb\": %s, \"peakLsb\": %d, \"levelDb\": %.3f, "
+                "\"fixedUsPerBlock\": %.3f, \"%sUsPerBlock\": %.3f}%s\n",
+                r.name.c_str(), snr, r.peak, r.level, r.fixedUs, variant, r.variantUs,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    fprintf(stderr, "wrote %s\n", output);
+    return 0;
+}
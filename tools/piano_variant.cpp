@@ -0,0 +1,54 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 06:22:51
+ */
+
+// pm_piano, pm_piano_float, pm_piano_compact のそれぞれに対してビルドする
+// どれになるかは sys_params.h の USE_FIXED_POINT と USE_COMPACT_DELAY で決まる
+
+#include "piano_variant.h"
+#include <pm_piano/piano.h>
+
+namespace parity
+{
+    namespace
+    {
+        class PianoRenderer : public Renderer
+        {
+            physical_modeling_piano::Piano piano_;
+
+        public:
+            explicit PianoRenderer(int nPoly) { piano_.initialize(nPoly); }
+
+            void update(int16_t *dst, size_t nSamples, io::MidiMessageQueue &midiIn) override
+            {
+                piano_.update(dst, nSamples, midiIn);
+            }
+
+            size_t getCurrentNoteCount() const override
+            {
+                return piano_.getCurrentNoteCount();
+            }
+        };
+    }
+
+#if USE_FIXED_POINT && !USE_COMPACT_DELAY
+    uint32_t
+    getSampleRate()
+    {
+        return physical_modeling_piano::SystemParameters::sampleRate;
+    }
+#endif
+
+    std::unique_ptr<Renderer>
+#if USE_COMPACT_DELAY
+    makeCompactRenderer(int nPoly)
+#elif USE_FIXED_POINT
+    makeFixedPointRenderer(int nPoly)
+#else
+    makeFloatRenderer(int nPoly)
+#endif
+    {
+        return std::make_unique<PianoRenderer>(nPoly);
+    }
+}
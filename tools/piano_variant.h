@@ -0,0 +1,28 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 06:20:14
+ */
+#pragma once
+
+#include "midi.h"
+#include <memory>
+
+namespace parity
+{
+    // 固定小数点版と浮動小数点版 (と遅延線を 16bit で持つ版) の Piano を同じ実行ファイルから使うための窓口
+    // それぞれ別の名前空間でビルドされたライブラリにつながる
+    class Renderer
+    {
+    public:
+        virtual ~Renderer() = default;
+        virtual void update(int16_t *dst, size_t nSamples, io::MidiMessageQueue &midiIn) = 0;
+        virtual size_t getCurrentNoteCount() const = 0;
+    };
+
+    // 両方で共通
+    uint32_t getSampleRate();
+
+    std::unique_ptr<Renderer> makeFixedPointRenderer(int nPoly);
+    std::unique_ptr<Renderer> makeFloatRenderer(int nPoly);
+    std::unique_ptr<Renderer> makeCompactRenderer(int nPoly);
+}
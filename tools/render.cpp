@@ -0,0 +1,335 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 01:05:33
+ */
+
+// Standard MIDI File を Piano::update で WAV にオフラインレンダリングする
+
+#include "midi_file.h"
+#include "sys_params_option.h"
+#include "voice_register.h"
+#include "wav_reader.h"
+#include "wav_writer.h"
+#include <pm_piano/note_cache.h>
+#include <pm_piano/piano.h>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+using namespace physical_modeling_piano;
+
+namespace
+{
+    // audio.cpp の HALF_RING_SAMPLES と同じ単位で回す
+    constexpr size_t BLOCK_SAMPLES = 64;
+
+    // -c fdn のときのインパルス応答の長さ (FDN はこれで -90dB 程度まで減衰する)
+    constexpr size_t FDN_IR_SAMPLES = 8192;
+
+    void usage()
+    {
+        printf("usage: pm_piano_render [-p polyphony] [-t tail_sec] [-b] [-l detail_bias] [-d] [-s] [-w] [-c ir.wav|fdn] [-C partition] [-S] [-k pan] [-W width] [-H note] [-r registers] [-P name=value]... [-N cache] input.mid output.wav\n");
+        printf("  -b: render voices with the SoA VoiceBank\n");
+        printf("  -d: pipeline the soundboard one block behind the strings (output is 1 block late)\n");
+        printf("  -s: split the soundboard branches between the two cores\n");
+        printf("  -w: run NoteManager::worker on a second thread like core0 on the Pico\n");
+        printf("  -l: lower the voices' level of detail (0: full, max %d)\n", NoteManager::MAX_DETAIL_BIAS);
+        printf("  -c: convolve with an impulse response instead of the soundboard FDN (fdn: the FDN's own response)\n");
+        printf("  -C: partition size of the convolution (power of 2, at least 4, default %zd)\n", BLOCK_SAMPLES);
+        printf("  -S: render stereo (L/R from one soundboard)\n");
+        printf("  -k: pan the strings by key position (0..1, implies -S)\n");
+        printf("  -W: stereo width of the soundboard (0: mono, default 1, implies -S)\n");
+        printf("  -H: run the strings of the keys below this MIDI note at half the sample rate\n");
+        printf("  -r: voices per register instead of -p, e.g. 48:4,72:8,109:16 (keys below 48: 4 voices, ...)\n");
+        printf("  -P: override a SystemParameters value\n");
+        printf("  -N: load the per-key coefficients from this file, or compute and store them there\n");
+        sys_params_option::printNames();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int nPoly = 9;
+    double tail = 3.0;
+    bool voiceBank = false;
+    int detailBias = 0;
+    bool pipelined = false;
+    bool worker = false;
+    bool parallelSoundboard = false;
+    const char *impulseResponse = nullptr;
+    size_t partitionSize = BLOCK_SAMPLES;
+    bool stereo = false;
+    float keyPanning = 0;
+    float stereoWidth = 1;
+    int halfRateBelow = 0;
+    std::vector<NoteManager::VoiceRegister> registers;
+    SystemParameters sysParams;
+    const char *noteCachePath = nullptr;
+    const char *input = nullptr;
+    const char *output = nullptr;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc)
+        {
+            nPoly = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+        {
+            tail = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-b"))
+        {
+            voiceBank = true;
+        }
+        else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+        {
+            detailBias = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-d"))
+        {
+            pipelined = true;
+        }
+        else if (!strcmp(argv[i], "-s"))
+        {
+            parallelSoundboard = true;
+        }
+        else if (!strcmp(argv[i], "-w"))
+        {
+            worker = true;
+        }
+        else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+        {
+            impulseResponse = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-C") && i + 1 < argc)
+        {
+            partitionSize = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-S"))
+        {
+            stereo = true;
+        }
+        else if (!strcmp(argv[i], "-k") && i + 1 < argc)
+        {
+            keyPanning = atof(argv[++i]);
+            stereo = true;
+        }
+        else if (!strcmp(argv[i], "-W") && i + 1 < argc)
+        {
+            stereoWidth = atof(argv[++i]);
+            stereo = true;
+        }
+        else if (!strcmp(argv[i], "-H") && i + 1 < argc)
+        {
+            halfRateBelow = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+        {
+            if (!voice_register::parse(registers, argv[++i]))
+            {
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-P") && i + 1 < argc)
+        {
+            if (!sys_params_option::parse(sysParams, argv[++i]))
+            {
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-N") && i + 1 < argc)
+        {
+            noteCachePath = argv[++i];
+        }
+        else if (!input)
+        {
+            input = argv[i];
+        }
+        else if (!output)
+        {
+            output = argv[i];
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (!input || !output || nPoly <= 0 ||
+        partitionSize < 4 || (partitionSize & (partitionSize - 1)))
+    {
+        usage();
+        return 1;
+    }
+
+    io::MidiFile midiFile;
+    if (!midiFile.load(input))
+    {
+        return 1;
+    }
+
+    constexpr auto sampleRate = SystemParameters::sampleRate;
+
+    std::vector<float> ir;
+    if (impulseResponse && !strcmp(impulseResponse, "fdn"))
+    {
+        Soundboard soundboard;
+        soundboard.initialize(SystemParameters());
+        ir.resize(FDN_IR_SAMPLES);
+        soundboard.computeImpulseResponse(ir.data(), ir.size());
+    }
+    else if (impulseResponse)
+    {
+        io::WavReader irFile;
+        if (!irFile.load(impulseResponse))
+        {
+            return 1;
+        }
+        if (irFile.getSampleRate() != sampleRate)
+        {
+            printf("%s: sample rate must be %u.\n", impulseResponse, (unsigned)sampleRate);
+            return 1;
+        }
+        ir = irFile.getSamples();
+    }
+
+    io::WavWriter wav;
+    if (!wav.open(output, sampleRate, stereo ? 2 : 1))
+    {
+        return 1;
+    }
+
+    auto piano = std::make_unique<Piano>();
+    piano->setSystemParameters(sysParams);
+    if (!piano->setHalfRateBelow(halfRateBelow))
+    {
+        return 1;
+    }
+    std::unique_ptr<NoteCache> noteCache;
+    if (noteCachePath)
+    {
+        noteCache = std::make_unique<NoteCache>(noteCachePath);
+        piano->setNoteTable(noteCache->getWords(), noteCache->getWordCount());
+    }
+    auto initStart = std::chrono::steady_clock::now();
+    if (registers.empty())
+    {
+        piano->initialize(nPoly);
+    }
+    else
+    {
+        piano->initialize(registers.data(), registers.size());
+    }
+    const double initMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - initStart).count();
+    if (noteCache)
+    {
+        const bool loaded = piano->isNoteTableLoaded();
+        if (!loaded)
+        {
+            CoefficientWriter w;
+            piano->writeNoteTable(w);
+            if (!noteCache->store(w.getWords().data(), w.getWords().size()))
+            {
+                return 1;
+            }
+        }
+        printf("%s: %s, initialize %.3f ms\n", noteCachePath, loaded ? "loaded" : "computed and stored", initMs);
+    }
+    piano->setUseVoiceBank(voiceBank);
+    piano->setDetailBias(detailBias);
+    piano->setPipelined(pipelined);
+    piano->setParallelSoundboard(parallelSoundboard);
+    piano->setKeyPanning(keyPanning);
+    piano->setStereoWidth(stereoWidth);
+    if (!ir.empty())
+    {
+        piano->setBodyImpulseResponse(ir.data(), ir.size(), partitionSize);
+    }
+    if (worker)
+    {
+        // 戻ってこないので終了まで放っておく
+        std::thread([&piano]
+                    { piano->worker(); })
+            .detach();
+    }
+
+    io::MidiMessageQueue midiIn;
+    midiIn.setActive(true);
+
+    const auto &events = midiFile.getEvents();
+    const size_t totalSamples = (size_t)((midiFile.getLength() + tail) * sampleRate);
+
+    std::chrono::steady_clock::duration renderTime{};
+    size_t maxNotes = 0;
+
+    auto ev = events.begin();
+    int16_t block[BLOCK_SAMPLES];
+    int16_t right[BLOCK_SAMPLES];
+    int16_t interleaved[BLOCK_SAMPLES * 2];
+    for (size_t pos = 0; pos < totalSamples; pos += BLOCK_SAMPLES)
+    {
+        // このブロックの終わりまでに来るイベントを流し込む
+        double blockEnd = double(pos + BLOCK_SAMPLES) / sampleRate;
+        while (ev != events.end() && ev->time < blockEnd)
+        {
+            midiIn.put(ev->message);
+            ++ev;
+        }
+
+        auto t0 = std::chrono::steady_clock::now();
+        if (stereo)
+        {
+            piano->update(block, right, BLOCK_SAMPLES, midiIn);
+        }
+        else
+        {
+            piano->update(block, BLOCK_SAMPLES, midiIn);
+        }
+        renderTime += std::chrono::steady_clock::now() - t0;
+
+        maxNotes = std::max(maxNotes, piano->getCurrentNoteCount());
+
+        const int16_t *out = block;
+        if (stereo)
+        {
+            for (size_t i = 0; i < BLOCK_SAMPLES; ++i)
+            {
+                interleaved[i * 2] = block[i];
+                interleaved[i * 2 + 1] = right[i];
+            }
+            out = interleaved;
+        }
+        if (!wav.write(out, BLOCK_SAMPLES))
+        {
+            printf("%s: write error.\n", output);
+            return 1;
+        }
+    }
+
+    if (!wav.close())
+    {
+        printf("%s: write error.\n", output);
+        return 1;
+    }
+
+    double audioSec = double(totalSamples) / sampleRate;
+    double renderSec = std::chrono::duration<double>(renderTime).count();
+    printf("%zd events, %.2f sec audio, %.3f sec render, %.1fx real time, max %zd notes\n",
+           events.size(),
+           audioSec,
+           renderSec,
+           renderSec > 0 ? audioSec / renderSec : 0.0,
+           maxNotes);
+
+    if (worker)
+    {
+        // worker スレッドがまだ参照しているので解放しない
+        piano.release();
+    }
+    return 0;
+}
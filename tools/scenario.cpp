@@ -0,0 +1,176 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 03:03:30
+ */
+
+#include "scenario.h"
+#include <algorithm>
+
+namespace scenario
+{
+    namespace
+    {
+        constexpr int KEY_LOW = 21;
+        constexpr int KEY_HIGH = 108;
+
+        class Builder
+        {
+            Scenario s_;
+            uint32_t sampleRate_;
+
+        public:
+            Builder(const char *name, uint32_t sampleRate)
+                : sampleRate_(sampleRate)
+            {
+                s_.name = name;
+                s_.length = 0;
+            }
+
+            size_t toSample(double sec) const { return size_t(sec * sampleRate_); }
+
+            void put(double sec, const io::MidiMessage &m)
+            {
+                auto t = toSample(sec);
+                s_.events.push_back({t, m});
+                s_.length = std::max(s_.length, t);
+            }
+
+            void noteOn(double sec, int key, int vel) { put(sec, io::MidiMessage(0x90, key, vel)); }
+            void noteOff(double sec, int key) { put(sec, io::MidiMessage(0x80, key, 0)); }
+            void damper(double sec, bool on) { put(sec, io::MidiMessage(0xb0, 64, on ? 127 : 0)); }
+
+            Scenario finish(double tailSec)
+            {
+                std::stable_sort(s_.events.begin(), s_.events.end(),
+                                 [](const Event &a, const Event &b)
+                                 { return a.sample < b.sample; });
+                s_.length += toSample(tailSec);
+                return std::move(s_);
+            }
+        };
+
+        // 再現性のある乱数
+        class Random
+        {
+            uint32_t x_;
+
+        public:
+            explicit Random(uint32_t seed) : x_(seed) {}
+            uint32_t operator()(uint32_t n)
+            {
+                x_ ^= x_ << 13;
+                x_ ^= x_ >> 17;
+                x_ ^= x_ << 5;
+                return x_ % n;
+            }
+        };
+    }
+
+    Scenario
+    makeGlissando(uint32_t sampleRate)
+    {
+        // 白鍵グリッサンドを 1 音 15ms で鍵盤の端から端まで往復、後半はペダルを踏んだまま
+        Builder b("glissando", sampleRate);
+        static constexpr bool whiteKey[12] = {1, 0, 1, 0, 1, 1, 0, 1, 0, 1, 0, 1};
+
+        double t = 0;
+        for (int pass = 0; pass < 4; ++pass)
+        {
+            if (pass == 2)
+            {
+                b.damper(t, true);
+            }
+            for (int i = 0; i <= KEY_HIGH - KEY_LOW; ++i)
+            {
+                int key = (pass & 1) ? KEY_HIGH - i : KEY_LOW + i;
+                if (!whiteKey[key % 12])
+                {
+                    continue;
+                }
+                b.noteOn(t, key, 90);
+                b.noteOff(t + 0.04, key);
+                t += 0.015;
+            }
+        }
+        b.damper(t + 0.5, false);
+        return b.finish(1.0);
+    }
+
+    Scenario
+    makePedalChords(uint32_t sampleRate)
+    {
+        // ダンパーペダルを踏んだまま 10 音の和音を 0.5 秒ごとに弾き続ける
+        Builder b("pedal_chords", sampleRate);
+        static constexpr int chord[10] = {0, 7, 12, 16, 19, 24, 28, 31, 36, 40};
+        static constexpr int roots[] = {24, 29, 31, 26, 33, 28};
+
+        b.damper(0, true);
+        double t = 0.01;
+        for (int i = 0; i < 16; ++i)
+        {
+            int root = roots[i % 6];
+            for (int n : chord)
+            {
+                b.noteOn(t, root + n, 100);
+                b.noteOff(t + 0.3, root + n);
+            }
+            t += 0.5;
+        }
+        b.damper(t + 1.0, false);
+        return b.finish(1.0);
+    }
+
+    Scenario
+    makeRepeatedNotes(uint32_t sampleRate)
+    {
+        // ペダルを踏んだまま同じ鍵を 30ms 間隔で連打
+        // 発音中のノードを keyOn で再トリガーする経路
+        Builder b("repeated_notes", sampleRate);
+        static constexpr int keys[] = {33, 45, 57, 64, 69, 76};
+
+        b.damper(0, true);
+        double t = 0.01;
+        for (int i = 0; i < 200; ++i)
+        {
+            for (int k : keys)
+            {
+                b.noteOn(t, k, 60 + (i * 7) % 60);
+                b.noteOff(t + 0.02, k);
+            }
+            t += 0.03;
+        }
+        b.damper(t, false);
+        return b.finish(1.0);
+    }
+
+    Scenario
+    makeVoiceStealingStorm(uint32_t sampleRate)
+    {
+        // 同時発音数を大きく超えるランダムな打鍵
+        Builder b("voice_stealing_storm", sampleRate);
+        Random rnd(0x2545f491);
+
+        b.damper(0, true);
+        double t = 0.01;
+        for (int i = 0; i < 600; ++i)
+        {
+            int key = KEY_LOW + rnd(KEY_HIGH - KEY_LOW + 1);
+            b.noteOn(t, key, 40 + rnd(87));
+            b.noteOff(t + 0.05 + rnd(200) * 0.001, key);
+            t += 0.008 + rnd(8) * 0.001;
+        }
+        b.damper(t, false);
+        return b.finish(1.0);
+    }
+
+    std::vector<Scenario>
+    makeAllScenarios(uint32_t sampleRate)
+    {
+        std::vector<Scenario> r;
+        r.push_back(makeGlissando(sampleRate));
+        r.push_back(makePedalChords(sampleRate));
+        r.push_back(makeRepeatedNotes(sampleRate));
+        r.push_back(makeVoiceStealingStorm(sampleRate));
+        return r;
+    }
+}
@@ -0,0 +1,53 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 03:02:47
+ */
+#pragma once
+
+#include "midi.h"
+#include <string>
+#include <vector>
+
+namespace scenario
+{
+    // 負荷の厳しい演奏パターン
+    struct Event
+    {
+        size_t sample;
+        io::MidiMessage message;
+    };
+
+    struct Scenario
+    {
+        std::string name;
+        std::vector<Event> events; // sample 順
+        size_t length;             // [samples]
+    };
+
+    Scenario makeGlissando(uint32_t sampleRate);
+    Scenario makePedalChords(uint32_t sampleRate);
+    Scenario makeRepeatedNotes(uint32_t sampleRate);
+    Scenario makeVoiceStealingStorm(uint32_t sampleRate);
+
+    std::vector<Scenario> makeAllScenarios(uint32_t sampleRate);
+
+    // ブロック単位でイベントを MidiMessageQueue に流し込む
+    class Player
+    {
+        const Scenario *scenario_{};
+        size_t next_ = 0;
+
+    public:
+        explicit Player(const Scenario &s) : scenario_(&s) {}
+
+        void feed(io::MidiMessageQueue &q, size_t blockEnd)
+        {
+            const auto &events = scenario_->events;
+            while (next_ < events.size() && events[next_].sample < blockEnd)
+            {
+                q.put(events[next_].message);
+                ++next_;
+            }
+        }
+    };
+}
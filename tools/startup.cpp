@@ -0,0 +1,152 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 16:19:31
+ */
+
+// 起動時に鍵ごとの Note を用意する時間を、Note::initialize() で計算する場合と
+// ビルドのときに作った表 (prebuiltNoteTable) から読む場合で比べる
+// 読んだ係数が計算したものと同じで、同じ音が出ることも確かめる
+
+#include <pm_piano/coefficients.h>
+#include <pm_piano/note.h>
+#include <pm_piano/note_manager.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace physical_modeling_piano;
+
+namespace
+{
+    constexpr int N_NOTES = NoteManager::NOTE_END - NoteManager::NOTE_BEGIN;
+    constexpr size_t BLOCK_SAMPLES = 64;
+
+    using Clock = std::chrono::steady_clock;
+
+    double elapsedUs(Clock::time_point t0)
+    {
+        return std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+    }
+
+    void computeNotes(std::vector<Note> &notes, const SystemParameters &sysParams)
+    {
+        for (int i = 0; i < N_NOTES; ++i)
+        {
+            notes[i].initialize(440 * powf(2.0f, (i + NoteManager::NOTE_BEGIN - 69) / 12.0f), sysParams);
+        }
+    }
+
+    std::vector<uint32_t> save(std::vector<Note> &notes)
+    {
+        CoefficientWriter w;
+        for (auto &n : notes)
+        {
+            n.transferCoefficients(w);
+        }
+        return w.getWords();
+    }
+
+    // 1 音を鳴らした出力
+    std::vector<Note::SampleT> render(const Note &note, const SystemParameters &sysParams, size_t nBlocks)
+    {
+        std::vector<uint32_t> delayMemory((note.computeAllocatorSize() + 3) / 4);
+        Note::State state;
+        state.delayMemory = delayMemory.data();
+        note.keyOn(state, Hammer::VelocityT(5.0f));
+
+        PedalState pedal{};
+        std::vector<Note::SampleT> out(nBlocks * BLOCK_SAMPLES);
+        for (size_t b = 0; b < nBlocks; ++b)
+        {
+            auto *buf = out.data() + b * BLOCK_SAMPLES;
+            for (size_t i = 0; i < BLOCK_SAMPLES; ++i)
+            {
+                buf[i] = 0;
+            }
+            note.update(buf, BLOCK_SAMPLES, state, sysParams, pedal);
+        }
+        return out;
+    }
+
+    void usage()
+    {
+        printf("usage: pm_piano_startup [-n repeat] [-s seconds]\n");
+        printf("  times preparing the %d keys with Note::initialize() against loading the table\n", N_NOTES);
+        printf("  generated at build time, and checks that both play the same (-s: per key, 0 to skip)\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int repeat = 20;
+    float seconds = 0.5f;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            repeat = std::max(1, atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            seconds = float(atof(argv[++i]));
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    // 表はこのビルドの既定のパラメータで作ってある (tools/CMakeLists.txt)
+    SystemParameters sysParams;
+
+    std::vector<Note> computed(N_NOTES);
+    std::vector<Note> loaded(N_NOTES);
+    double computeUs = 1e30;
+    double loadUs = 1e30;
+    for (int r = 0; r < repeat; ++r)
+    {
+        auto t0 = Clock::now();
+        computeNotes(computed, sysParams);
+        computeUs = std::min(computeUs, elapsedUs(t0));
+
+        t0 = Clock::now();
+        const bool ok = note_table::read(loaded.data(), loaded.size(),
+                                         prebuiltNoteTable, prebuiltNoteTableSize, &sysParams);
+        loadUs = std::min(loadUs, elapsedUs(t0));
+        if (!ok)
+        {
+            printf("the prebuilt table does not match this build.\n");
+            return 1;
+        }
+    }
+    printf("%d keys: compute %.1f us, load %.1f us (%.0fx), table %zu bytes\n",
+           N_NOTES, computeUs, loadUs, computeUs / loadUs, prebuiltNoteTableSize * sizeof(uint32_t));
+
+    if (save(computed) != save(loaded))
+    {
+        printf("loaded coefficients differ from computed ones.\n");
+        return 1;
+    }
+
+    const size_t nBlocks = size_t(seconds * SystemParameters::sampleRate) / BLOCK_SAMPLES;
+    if (nBlocks)
+    {
+        for (int i = 0; i < N_NOTES; ++i)
+        {
+            const auto a = render(computed[i], sysParams, nBlocks);
+            const auto b = render(loaded[i], sysParams, nBlocks);
+            if (memcmp(a.data(), b.data(), a.size() * sizeof(a[0])))
+            {
+                printf("key %d: output differs.\n", i + NoteManager::NOTE_BEGIN);
+                return 1;
+            }
+        }
+    }
+    printf("coefficients identical%s\n", nBlocks ? ", output identical" : "");
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 16:14:52
+ */
+
+#include "sys_params_option.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace sys_params_option
+{
+    using physical_modeling_piano::SystemParameters;
+
+    namespace
+    {
+        struct Entry
+        {
+            const char *name;
+            float SystemParameters::*member;
+        };
+
+        const Entry entries[] = {
+            {"youngsModulus", &SystemParameters::youngsModulus},
+            {"stringDensity", &SystemParameters::stringDensity},
+            {"bridgeImpedance", &SystemParameters::bridgeImpedance},
+            {"stringLossC1", &SystemParameters::stringLossC1},
+            {"stringLossC3", &SystemParameters::stringLossC3},
+            {"soundboardLossC1", &SystemParameters::soundboardLossC1},
+            {"soundboardLossC3", &SystemParameters::soundboardLossC3},
+            {"soundboardFeedback", &SystemParameters::soundboardFeedback},
+            {"hammerPosition", &SystemParameters::hammerPosition},
+            {"voiceSilenceLevel", &SystemParameters::voiceSilenceLevel},
+            {"voiceSilenceTime", &SystemParameters::voiceSilenceTime},
+            {"voiceQuietLevel", &SystemParameters::voiceQuietLevel},
+        };
+    }
+
+    bool parse(SystemParameters &dst, const char *str)
+    {
+        const char *eq = strchr(str, '=');
+        char *end = nullptr;
+        const float v = eq ? strtof(eq + 1, &end) : 0;
+        if (!eq || end == eq + 1 || *end)
+        {
+            printf("%s: expected name=value.\n", str);
+            return false;
+        }
+        const size_t len = eq - str;
+
+        for (auto &e : entries)
+        {
+            if (strlen(e.name) == len && !strncmp(str, e.name, len))
+            {
+                dst.*e.member = v;
+                return true;
+            }
+        }
+        if (len == 5 && !strncmp(str, "tune", 4) && str[4] >= '0' && str[4] <= '2')
+        {
+            dst.tune[str[4] - '0'] = v;
+            return true;
+        }
+        printf("%.*s: unknown parameter.\n", int(len), str);
+        return false;
+    }
+
+    bool setHalfRateBelow(SystemParameters &dst, int note)
+    {
+        if (!USE_HALF_RATE && note > 0)
+        {
+            printf("half rate: not available in this build (USE_HALF_RATE=0)\n");
+            dst.halfRateFrequency = 0;
+            return false;
+        }
+        dst.halfRateFrequency = note > 0 ? 440 * powf(2.0f, (note - 69.5f) / 12.0f) : 0;
+        return true;
+    }
+
+    void printNames()
+    {
+        printf("  parameters:");
+        for (auto &e : entries)
+        {
+            printf(" %s", e.name);
+        }
+        printf(" tune0 tune1 tune2\n");
+    }
+}
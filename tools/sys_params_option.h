@@ -0,0 +1,20 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 16:14:40
+ */
+#pragma once
+
+#include <pm_piano/sys_params.h>
+
+namespace sys_params_option
+{
+    // "stringLossC1=0.3" のように「名前=値」で SystemParameters の 1 つを書き換える
+    // tune は tune0, tune1, tune2
+    bool parse(physical_modeling_piano::SystemParameters &dst, const char *str);
+
+    // Piano::setHalfRateBelow() と同じく MIDI ノート番号 note から下を半分のレートにする (0 ならしない)
+    // USE_HALF_RATE でないビルドでは使わずに false
+    bool setHalfRateBelow(physical_modeling_piano::SystemParameters &dst, int note);
+
+    void printNames();
+}
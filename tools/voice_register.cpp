@@ -0,0 +1,59 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 16:03:05
+ */
+
+#include "voice_register.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace voice_register
+{
+    using physical_modeling_piano::NoteManager;
+
+    bool parse(std::vector<NoteManager::VoiceRegister> &dst, const char *str)
+    {
+        dst.clear();
+        const char *p = str;
+        while (*p)
+        {
+            char *end;
+            const long noteEnd = strtol(p, &end, 10);
+            if (end == p || *end != ':')
+            {
+                break;
+            }
+            p = end + 1;
+            const long nVoices = strtol(p, &end, 10);
+            if (end == p || nVoices < 0)
+            {
+                break;
+            }
+            if (!dst.empty() && noteEnd <= dst.back().noteEnd)
+            {
+                printf("%s: registers must be in ascending order.\n", str);
+                return false;
+            }
+            dst.push_back({int(noteEnd), size_t(nVoices)});
+
+            p = end;
+            if (*p == ',')
+            {
+                ++p;
+            }
+            else if (*p)
+            {
+                break;
+            }
+        }
+        if (*p || dst.empty())
+        {
+            printf("%s: expected note:voices[,note:voices...].\n", str);
+            return false;
+        }
+
+        dst.back().noteEnd = std::max(dst.back().noteEnd, NoteManager::NOTE_END);
+        return true;
+    }
+}
@@ -0,0 +1,15 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 16:02:38
+ */
+#pragma once
+
+#include <pm_piano/note_manager.h>
+#include <vector>
+
+namespace voice_register
+{
+    // "48:4,72:8,109:16" のように「音域の上端 + 1:ボイス数」を並べたもの
+    // 最後の音域は NoteManager::NOTE_END 以上まで伸ばす
+    bool parse(std::vector<physical_modeling_piano::NoteManager::VoiceRegister> &dst, const char *str);
+}
@@ -0,0 +1,136 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 14:58:40
+ */
+
+#include "wav_reader.h"
+#include <cstdio>
+#include <cstring>
+
+namespace io
+{
+    namespace
+    {
+        uint32_t get16(const uint8_t *p)
+        {
+            return p[0] | (p[1] << 8);
+        }
+
+        uint32_t get32(const uint8_t *p)
+        {
+            return get16(p) | (get16(p + 2) << 16);
+        }
+    }
+
+    bool
+    WavReader::load(const char *filename)
+    {
+        auto fp = fopen(filename, "rb");
+        if (!fp)
+        {
+            printf("%s: cannot open.\n", filename);
+            return false;
+        }
+
+        std::vector<uint8_t> data;
+        uint8_t buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        {
+            data.insert(data.end(), buf, buf + n);
+        }
+        fclose(fp);
+
+        if (!parse(data))
+        {
+            printf("%s: not a supported WAV file.\n", filename);
+            return false;
+        }
+        return true;
+    }
+
+    bool
+    WavReader::parse(const std::vector<uint8_t> &data)
+    {
+        samples_.clear();
+
+        if (data.size() < 12 ||
+            memcmp(&data[0], "RIFF", 4) != 0 ||
+            memcmp(&data[8], "WAVE", 4) != 0)
+        {
+            return false;
+        }
+
+        uint32_t format = 0;
+        uint32_t nChannels = 0;
+        uint32_t bits = 0;
+        bool hasFormat = false;
+
+        size_t pos = 12;
+        while (pos + 8 <= data.size())
+        {
+            const uint8_t *chunk = &data[pos];
+            const size_t size = get32(chunk + 4);
+            const size_t body = pos + 8;
+            if (body + size > data.size())
+            {
+                return false;
+            }
+
+            if (!memcmp(chunk, "fmt ", 4) && size >= 16)
+            {
+                format = get16(chunk + 8);
+                nChannels = get16(chunk + 10);
+                sampleRate_ = get32(chunk + 12);
+                bits = get16(chunk + 22);
+                if (format == 0xfffe && size >= 40)
+                {
+                    // WAVE_FORMAT_EXTENSIBLE はサブフォーマットの先頭 2 バイトが形式
+                    format = get16(chunk + 32);
+                }
+                hasFormat = true;
+            }
+            else if (!memcmp(chunk, "data", 4))
+            {
+                if (!hasFormat || !nChannels)
+                {
+                    return false;
+                }
+
+                const bool pcm = format == 1 && (bits == 16 || bits == 24 || bits == 32);
+                const bool ieee = format == 3 && bits == 32;
+                if (!pcm && !ieee)
+                {
+                    return false;
+                }
+
+                const size_t frameBytes = nChannels * bits / 8;
+                const size_t nFrames = size / frameBytes;
+                samples_.resize(nFrames);
+                for (size_t i = 0; i < nFrames; ++i)
+                {
+                    const uint8_t *p = &data[body + i * frameBytes];
+                    if (ieee)
+                    {
+                        uint32_t v = get32(p);
+                        memcpy(&samples_[i], &v, sizeof(float));
+                    }
+                    else
+                    {
+                        // 上位に詰めて 32bit として読む
+                        uint32_t v = 0;
+                        for (uint32_t b = 0; b < bits / 8; ++b)
+                        {
+                            v |= uint32_t(p[b]) << (32 - bits + b * 8);
+                        }
+                        samples_[i] = int32_t(v) * (1.0f / 2147483648.0f);
+                    }
+                }
+                return true;
+            }
+
+            pos = body + size + (size & 1);
+        }
+        return false;
+    }
+}
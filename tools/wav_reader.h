@@ -0,0 +1,28 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 14:52:16
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace io
+{
+    // WAV (16/24/32bit PCM と 32bit float) を読んで、先頭のチャンネルだけを [-1, 1) の float にする
+    class WavReader
+    {
+    public:
+        bool load(const char *filename);
+
+        const std::vector<float> &getSamples() const { return samples_; }
+        uint32_t getSampleRate() const { return sampleRate_; }
+
+    protected:
+        bool parse(const std::vector<uint8_t> &data);
+
+    private:
+        std::vector<float> samples_;
+        uint32_t sampleRate_ = 0;
+    };
+}
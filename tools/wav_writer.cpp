@@ -0,0 +1,109 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 00:42:51
+ */
+
+#include "wav_writer.h"
+#include <algorithm>
+
+namespace io
+{
+    namespace
+    {
+        void put16(uint8_t *&p, uint32_t v)
+        {
+            *p++ = v;
+            *p++ = v >> 8;
+        }
+
+        void put32(uint8_t *&p, uint32_t v)
+        {
+            put16(p, v);
+            put16(p, v >> 16);
+        }
+    }
+
+    bool
+    WavWriter::open(const char *filename, uint32_t sampleRate, uint32_t nChannels)
+    {
+        close();
+
+        fp_ = fopen(filename, "wb");
+        if (!fp_)
+        {
+            printf("%s: cannot open.\n", filename);
+            return false;
+        }
+        nChannels_ = nChannels;
+        dataBytes_ = 0;
+        return writeHeader(sampleRate);
+    }
+
+    bool
+    WavWriter::writeHeader(uint32_t sampleRate)
+    {
+        uint8_t header[44];
+        auto *p = header;
+        put32(p, 0x46464952); // RIFF
+        put32(p, 36 + dataBytes_);
+        put32(p, 0x45564157); // WAVE
+        put32(p, 0x20746d66); // fmt
+        put32(p, 16);
+        put16(p, 1); // PCM
+        put16(p, nChannels_);
+        put32(p, sampleRate);
+        put32(p, sampleRate * nChannels_ * 2);
+        put16(p, nChannels_ * 2);
+        put16(p, 16);
+        put32(p, 0x61746164); // data
+        put32(p, dataBytes_);
+
+        return fwrite(header, sizeof(header), 1, fp_) == 1;
+    }
+
+    bool
+    WavWriter::write(const int16_t *samples, size_t nFrames)
+    {
+        uint8_t buf[1024];
+        size_t n = nFrames * nChannels_;
+        while (n)
+        {
+            size_t ct = std::min(n, sizeof(buf) / 2);
+            auto *p = buf;
+            for (size_t i = 0; i < ct; ++i)
+            {
+                put16(p, static_cast<uint16_t>(samples[i]));
+            }
+            if (fwrite(buf, 2, ct, fp_) != ct)
+            {
+                return false;
+            }
+            dataBytes_ += ct * 2;
+            samples += ct;
+            n -= ct;
+        }
+        return true;
+    }
+
+    bool
+    WavWriter::close()
+    {
+        if (!fp_)
+        {
+            return true;
+        }
+
+        // サイズ欄を確定させる
+        uint8_t buf[4];
+        auto *p = buf;
+        put32(p, 36 + dataBytes_);
+        bool r = fseek(fp_, 4, SEEK_SET) == 0 && fwrite(buf, 4, 1, fp_) == 1;
+        p = buf;
+        put32(p, dataBytes_);
+        r = r && fseek(fp_, 40, SEEK_SET) == 0 && fwrite(buf, 4, 1, fp_) == 1;
+
+        r = fclose(fp_) == 0 && r;
+        fp_ = nullptr;
+        return r;
+    }
+}
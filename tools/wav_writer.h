@@ -0,0 +1,36 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sat Oct 17 2026 00:41:18
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+namespace io
+{
+    // 16bit PCM の WAV をストリーム書き出しする
+    // ヘッダのサイズ欄は close() で埋める
+    class WavWriter
+    {
+        FILE *fp_{};
+        uint32_t nChannels_{};
+        uint32_t dataBytes_{};
+
+    public:
+        WavWriter() = default;
+        WavWriter(const WavWriter &) = delete;
+        WavWriter &operator=(const WavWriter &) = delete;
+        ~WavWriter() { close(); }
+
+        bool open(const char *filename, uint32_t sampleRate, uint32_t nChannels);
+        bool write(const int16_t *samples, size_t nFrames);
+        bool close();
+
+        explicit operator bool() const { return fp_; }
+
+    protected:
+        bool writeHeader(uint32_t sampleRate);
+    };
+}